@@ -1,7 +1,7 @@
 htmldocs: docs/html/index.html Doxyfile
 
-docs/html/index.html: macros.h config.h extension.c php_pmta.h pmta_common.c pmta_common.h pmta_connection.c pmta_connection.h pmta_error.c pmta_error.h pmta_message.c pmta_message.h pmta_recipient.c pmta_recipient.h Doxyfile
+docs/html/index.html: macros.h config.h extension.c php_pmta.h pmta_async.c pmta_async.h pmta_body.c pmta_body.h pmta_common.c pmta_common.h pmta_connection.c pmta_connection.h pmta_csv.c pmta_csv.h pmta_encode.c pmta_encode.h pmta_error.c pmta_error.h pmta_merge.c pmta_merge.h pmta_message.c pmta_message.h pmta_mime.c pmta_mime.h pmta_pool.c pmta_pool.h pmta_recipient.c pmta_recipient.h pmta_recipient_list.c pmta_recipient_list.h pmta_recipients_view.c pmta_recipients_view.h pmta_template.c pmta_template.h Doxyfile
 	doxygen Doxyfile
 
-macros.h: extension.c pmta_common.c pmta_connection.c pmta_error.c pmta_message.c pmta_recipient.c
+macros.h: extension.c pmta_async.c pmta_body.c pmta_common.c pmta_connection.c pmta_csv.c pmta_encode.c pmta_error.c pmta_merge.c pmta_message.c pmta_mime.c pmta_pool.c pmta_recipient.c pmta_recipient_list.c pmta_recipients_view.c pmta_template.c
 	$(CPP) $(COMMON_FLAGS) -DDOXYGEN -DHAVE_CONFIG_H -dD $^ | $(CPP) $(DEFS) $(CPPFLAGS) -DDOXYGEN -DHAVE_CONFIG_H -dM - > $@
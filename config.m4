@@ -22,8 +22,27 @@ if test "$PHP_PMTA" != "no"; then
 		[AC_MSG_ERROR([Invalid PMTA library, PmtaConnAlloc() not found])]
 	)
 
+	AC_CHECK_HEADER([pthread.h], [
+		PHP_CHECK_LIBRARY(
+			[pthread],
+			[pthread_create],
+			[
+				PHP_ADD_LIBRARY([pthread],, PMTA_SHARED_LIBADD)
+				AC_DEFINE([HAVE_PMTA_THREADS], [1], [Whether PmtaConnection::submitAsync() can use a background thread])
+			]
+		)
+
+		PHP_CHECK_LIBRARY(
+			[pthread],
+			[pthread_mutex_consistent],
+			[
+				AC_DEFINE([HAVE_PTHREAD_MUTEX_CONSISTENT], [1], [Whether the template storage can use a robust process-shared mutex])
+			]
+		)
+	])
+
 	PHP_SUBST(PMTA_SHARED_LIBADD)
-	PHP_NEW_EXTENSION(pmta, [extension.c pmta_common.c pmta_error.c pmta_connection.c pmta_recipient.c pmta_message.c], $ext_shared,, [-Wall])
+	PHP_NEW_EXTENSION(pmta, [extension.c pmta_common.c pmta_error.c pmta_connection.c pmta_recipient.c pmta_message.c pmta_pool.c pmta_async.c pmta_csv.c pmta_recipient_list.c pmta_recipients_view.c pmta_body.c pmta_template.c pmta_merge.c pmta_encode.c pmta_mime.c], $ext_shared,, [-Wall])
 
 	PHP_ADD_MAKEFILE_FRAGMENT
 fi
@@ -11,7 +11,22 @@
 #include "pmta_connection.h"
 #include "pmta_error.h"
 #include "pmta_message.h"
+#include "pmta_pool.h"
+#include "pmta_async.h"
+#include "pmta_recipient_list.h"
+#include "pmta_recipients_view.h"
+#include "pmta_template.h"
+#include "pmta_merge.h"
+#include "pmta_mime.h"
+#include "pmta_encode.h"
 #include "pmta_recipient.h"
+#include "pmta_common.h"
+
+#ifdef PHP_WIN32
+#	include <process.h>
+#else
+#	include <unistd.h>
+#endif
 
 ZEND_DECLARE_MODULE_GLOBALS(pmta);
 
@@ -25,6 +40,15 @@ ZEND_DECLARE_MODULE_GLOBALS(pmta);
  * <TR><TH>@c pmta.port</TH><TD>@c 25</TD><TD>@c PHP_INI_ALL</TD><TD>Default port to use in @c PmtaConnection::__construct()</TD></TR>
  * <TR><TH>@c pmta.username</TH><TD>@c null</TD><TD>@c PHP_INI_ALL</TD><TD>Default username to use in @c PmtaConnection::__construct()</TD></TR>
  * <TR><TH>@c pmta.password</TH><TD>@c null</TD><TD>@c PHP_INI_ALL</TD><TD>Default password to use in @c PmtaConnection::__construct()</TD></TR>
+ * <TR><TH>@c pmta.servers</TH><TD>@c null</TD><TD>@c PHP_INI_ALL</TD><TD>Default comma separated list of <tt>host[:port]</tt> to use in @c PmtaConnectionPool::__construct()</TD></TR>
+ * <TR><TH>@c pmta.persistent</TH><TD>@c 0</TD><TD>@c PHP_INI_ALL</TD><TD>Whether @c PmtaConnection::__construct() reuses persistent connections by default</TD></TR>
+ * <TR><TH>@c pmta.lazy_connect</TH><TD>@c 0</TD><TD>@c PHP_INI_ALL</TD><TD>Whether @c PmtaConnection::__construct() defers connecting until the first submission by default</TD></TR>
+ * <TR><TH>@c pmta.persistent_max_idle</TH><TD>@c 60</TD><TD>@c PHP_INI_ALL</TD><TD>Persistent connections idle for longer than this (seconds) are not reused; 0 disables the check</TD></TR>
+ * <TR><TH>@c pmta.persistent_max_lifetime</TH><TD>@c 3600</TD><TD>@c PHP_INI_ALL</TD><TD>Persistent connections older than this (seconds) are not reused; 0 disables the check</TD></TR>
+ * <TR><TH>@c pmta.retain_recipients</TH><TD>@c 1</TD><TD>@c PHP_INI_ALL</TD><TD>Default value of @c PmtaMessage::$retain_recipients; when off, @c PmtaMessage::addRecipient() does not keep @c PmtaRecipient objects</TD></TR>
+ * <TR><TH>@c pmta.template_shm_size</TH><TD>@c 4M</TD><TD>@c PHP_INI_SYSTEM</TD><TD>Size of the storage for @c PmtaTemplate, shared by the worker processes where possible; 0 disables templates</TD></TR>
+ * <TR><TH>@c pmta.part_cache_size</TH><TD>@c 16M</TD><TD>@c PHP_INI_SYSTEM</TD><TD>Maximum total size of the parts cached by @c PmtaMessage::addCachedPart() in every process; 0 disables the cache</TD></TR>
+ * <TR><TH>@c pmta.body_spill_threshold</TH><TD>@c 0</TD><TD>@c PHP_INI_ALL</TD><TD>Once the body of a @c PmtaMessage takes more memory than this, further body data is kept in a temporary file until the submission; 0 keeps everything in memory</TD></TR>
  * </TABLE>
  */
 PHP_INI_BEGIN()
@@ -33,6 +57,15 @@ PHP_INI_BEGIN()
 	STD_PHP_INI_ENTRY("pmta.port",     "25", PHP_INI_ALL, OnUpdateLong,   port,     zend_pmta_globals, pmta_globals)
 	STD_PHP_INI_ENTRY("pmta.username", NULL, PHP_INI_ALL, OnUpdateString, username, zend_pmta_globals, pmta_globals)
 	STD_PHP_INI_ENTRY("pmta.password", NULL, PHP_INI_ALL, OnUpdateString, password, zend_pmta_globals, pmta_globals)
+	STD_PHP_INI_ENTRY("pmta.servers",  NULL, PHP_INI_ALL, OnUpdateString, servers,  zend_pmta_globals, pmta_globals)
+	STD_PHP_INI_BOOLEAN("pmta.persistent", "0", PHP_INI_ALL, OnUpdateBool, persistent, zend_pmta_globals, pmta_globals)
+	STD_PHP_INI_BOOLEAN("pmta.lazy_connect", "0", PHP_INI_ALL, OnUpdateBool, lazy_connect, zend_pmta_globals, pmta_globals)
+	STD_PHP_INI_ENTRY("pmta.persistent_max_idle",     "60",   PHP_INI_ALL, OnUpdateLong, pconn_max_idle, zend_pmta_globals, pmta_globals)
+	STD_PHP_INI_ENTRY("pmta.persistent_max_lifetime", "3600", PHP_INI_ALL, OnUpdateLong, pconn_max_life, zend_pmta_globals, pmta_globals)
+	STD_PHP_INI_BOOLEAN("pmta.retain_recipients", "1", PHP_INI_ALL, OnUpdateBool, retain_rcpts, zend_pmta_globals, pmta_globals)
+	STD_PHP_INI_ENTRY("pmta.template_shm_size", "4M", PHP_INI_SYSTEM, OnUpdateLong, tpl_shm_size, zend_pmta_globals, pmta_globals)
+	STD_PHP_INI_ENTRY("pmta.part_cache_size", "16M", PHP_INI_SYSTEM, OnUpdateLong, part_cache_size, zend_pmta_globals, pmta_globals)
+	STD_PHP_INI_ENTRY("pmta.body_spill_threshold", "0", PHP_INI_ALL, OnUpdateLong, spill_threshold, zend_pmta_globals, pmta_globals)
 PHP_INI_END()
 
 zend_class_entry* pmta_error_connection_class;
@@ -41,6 +74,22 @@ zend_class_entry* pmta_error_message_class;
 zend_class_entry* pmta_conn_class;
 zend_class_entry* pmta_rcpt_class;
 zend_class_entry* pmta_msg_class;
+zend_class_entry* pmta_pool_class;
+zend_class_entry* pmta_future_class;
+zend_class_entry* pmta_rcptlist_class;
+zend_class_entry* pmta_view_class;
+zend_class_entry* pmta_template_class;
+zend_class_entry* pmta_merge_class;
+zend_class_entry* pmta_mime_class;
+
+/**
+ * @brief Frees a part cached by @c PmtaMessage::addCachedPart()
+ * @param p @c pmta_cached_part
+ */
+static void pmta_cached_part_dtor(void* p)
+{
+	pefree(((pmta_cached_part*)p)->data, 1);
+}
 
 /**
  * @brief Globals constructor
@@ -53,6 +102,39 @@ static PHP_GINIT_FUNCTION(pmta)
 	pmta_globals->server         = NULL;
 	pmta_globals->username       = NULL;
 	pmta_globals->password       = NULL;
+	pmta_globals->servers        = NULL;
+	pmta_globals->persistent     = 0;
+	pmta_globals->lazy_connect   = 0;
+	pmta_globals->pconn_max_idle = 60;
+	pmta_globals->pconn_max_life = 3600;
+	pmta_globals->retain_rcpts   = 1;
+	pmta_globals->tpl_shm_size   = 4194304;
+	pmta_globals->date_time      = 0;
+	pmta_globals->date_len       = 0;
+	pmta_globals->msgid_pid      = (zend_uint)getpid();
+	pmta_globals->msgid_counter  = 0;
+	pmta_globals->msgid_seed     = 0;
+
+	pmta_globals->part_cache_size = 16777216;
+	pmta_globals->part_cache_used = 0;
+	pmta_globals->part_cache_hits = 0;
+	pmta_globals->part_cache_miss = 0;
+
+	pmta_globals->spill_threshold = 0;
+
+	zend_hash_init(&pmta_globals->node_stats, 8, NULL, NULL, 1);
+	zend_hash_init(&pmta_globals->part_cache, 8, NULL, pmta_cached_part_dtor, 1);
+}
+
+/**
+ * @brief Globals destructor
+ * @param pmta_globals Pointer to the PMTA globals
+ * @param tsrm_ls
+ */
+static PHP_GSHUTDOWN_FUNCTION(pmta)
+{
+	zend_hash_destroy(&pmta_globals->node_stats);
+	zend_hash_destroy(&pmta_globals->part_cache);
 }
 
 /**
@@ -67,11 +149,24 @@ static PHP_GINIT_FUNCTION(pmta)
 static PHP_MINIT_FUNCTION(pmta)
 {
 	REGISTER_INI_ENTRIES();
+	pmta_encode_startup();
+	pmta_common_startup();
 
-	pmtaconn_register_class(TSRMLS_C);
+	if (PMTA_G(tpl_shm_size) > 0) {
+		pmta_template_startup((size_t)PMTA_G(tpl_shm_size));
+	}
+
+	pmtaconn_register_class(module_number TSRMLS_CC);
 	pmtaerror_register_class(TSRMLS_C);
 	pmtarcpt_register_class(TSRMLS_C);
 	pmtamsg_register_class(TSRMLS_C);
+	pmtapool_register_class(TSRMLS_C);
+	pmtafuture_register_class(TSRMLS_C);
+	pmtalist_register_class(TSRMLS_C);
+	pmtaview_register_class(TSRMLS_C);
+	pmtatpl_register_class(TSRMLS_C);
+	pmtamerge_register_class(TSRMLS_C);
+	pmtamime_register_class(TSRMLS_C);
 
 	return SUCCESS;
 }
@@ -84,10 +179,32 @@ static PHP_MINIT_FUNCTION(pmta)
  */
 static PHP_MSHUTDOWN_FUNCTION(pmta)
 {
+	pmta_template_shutdown();
 	UNREGISTER_INI_ENTRIES();
 	return SUCCESS;
 }
 
+/**
+ * @brief Request initialization function
+ * @param type Module type
+ * @param module_number Module number
+ * @param tsrm_ls
+ * @return Whether initialization succeeded
+ * @retval SUCCESS Yes
+ * @details The host seed used in Message-IDs is computed at the first request of the process
+ */
+static PHP_RINIT_FUNCTION(pmta)
+{
+	if (!PMTA_G(msgid_seed)) {
+		char* host = php_get_uname('n');
+
+		PMTA_G(msgid_seed) = pmta_hash(host, strlen(host)) ^ (zend_uint)pmta_time_ms();
+		efree(host);
+	}
+
+	return SUCCESS;
+}
+
 /**
  * @brief Module initialization function
  * @param zend_module Pointer to the module entry
@@ -125,13 +242,13 @@ zend_module_entry pmta_module_entry = {
 	NULL,
 	PHP_MINIT(pmta),
 	PHP_MSHUTDOWN(pmta),
-	NULL,
+	PHP_RINIT(pmta),
 	NULL,
 	PHP_MINFO(pmta),
 	PHP_PMTA_EXTVER,
 	PHP_MODULE_GLOBALS(pmta),
 	PHP_GINIT(pmta),
-	NULL,
+	PHP_GSHUTDOWN(pmta),
 	NULL,
 	STANDARD_MODULE_PROPERTIES_EX
 };
@@ -95,6 +95,13 @@ PHPPMTA_VISIBILITY_HIDDEN extern zend_class_entry* pmta_error_recipient_class;
 PHPPMTA_VISIBILITY_HIDDEN extern zend_class_entry* pmta_error_message_class;    /**< PmtaErrorMessage class */
 PHPPMTA_VISIBILITY_HIDDEN extern zend_class_entry* pmta_rcpt_class;             /**< PmtaRecipient class */
 PHPPMTA_VISIBILITY_HIDDEN extern zend_class_entry* pmta_msg_class;              /**< PmtaMessage class */
+PHPPMTA_VISIBILITY_HIDDEN extern zend_class_entry* pmta_pool_class;             /**< PmtaConnectionPool class */
+PHPPMTA_VISIBILITY_HIDDEN extern zend_class_entry* pmta_future_class;           /**< PmtaSubmitFuture class */
+PHPPMTA_VISIBILITY_HIDDEN extern zend_class_entry* pmta_rcptlist_class;         /**< PmtaRecipientList class */
+PHPPMTA_VISIBILITY_HIDDEN extern zend_class_entry* pmta_view_class;             /**< PmtaRecipientsView class */
+PHPPMTA_VISIBILITY_HIDDEN extern zend_class_entry* pmta_template_class;         /**< PmtaTemplate class */
+PHPPMTA_VISIBILITY_HIDDEN extern zend_class_entry* pmta_merge_class;            /**< PmtaMergeTemplate class */
+PHPPMTA_VISIBILITY_HIDDEN extern zend_class_entry* pmta_mime_class;             /**< PmtaMimeBuilder class */
 
 /**
  * @headerfile php_pmta.h
@@ -122,8 +129,28 @@ ZEND_BEGIN_MODULE_GLOBALS(pmta)
 	char* server;             /**< Default server to use in PmtaConnection::__construct() */
 	char* username;           /**< Default username to use in PmtaConnection::__construct() */
 	char* password;           /**< Default password to use in PmtaConnection::__construct() */
+	char* servers;            /**< Default server list to use in PmtaConnectionPool::__construct() */
 	int port;                 /**< Default port to use in PmtaConnection::__construct() */
 	zend_bool use_exceptions; /**< Whether to throw exceptions instead of returning error */
+	HashTable node_stats;     /**< Submission statistics of PowerMTA nodes (@c host:port => @c pmtapool_stats), survive requests */
+	zend_bool persistent;     /**< Whether PmtaConnection::__construct() uses persistent connections by default */
+	zend_bool lazy_connect;   /**< Whether PmtaConnection::__construct() defers connecting until the first submission by default */
+	long int pconn_max_idle;  /**< How long (seconds) a persistent connection may stay idle before it is dropped; 0 = forever */
+	long int pconn_max_life;  /**< How long (seconds) a persistent connection may live before it is dropped; 0 = forever */
+	zend_bool retain_rcpts;   /**< Default value of PmtaMessage::$retain_recipients */
+	long int tpl_shm_size;    /**< Size of the template storage created at MINIT */
+	long int date_time;       /**< Second @c date_hdr has been formatted for */
+	char date_hdr[48];        /**< Cached @c Date header (with CRLF) */
+	size_t date_len;          /**< Length of @c date_hdr */
+	zend_uint msgid_pid;      /**< Process ID used in Message-IDs, refreshed in forked children */
+	zend_uint msgid_counter;  /**< Counter of the generated Message-IDs */
+	zend_uint msgid_seed;     /**< Host seed (hash of the host name and the time of the first request) */
+	HashTable part_cache;     /**< Parts cached by PmtaMessage::addCachedPart() (key => @c pmta_cached_part), survive requests */
+	long int part_cache_size; /**< Maximum total size of the cached parts */
+	size_t part_cache_used;   /**< Total size of the cached parts */
+	long int part_cache_hits; /**< Number of PmtaMessage::addCachedPart() calls which found the part in the cache */
+	long int part_cache_miss; /**< Number of PmtaMessage::addCachedPart() calls which did not */
+	long int spill_threshold; /**< Size of the body journal above which body data is moved to a temporary file; 0 = never */
 ZEND_END_MODULE_GLOBALS(pmta);
 
 /**
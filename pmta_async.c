@@ -0,0 +1,717 @@
+/**
+ * @file pmta_async.c
+ * @brief Background submission worker and @c PmtaSubmitFuture class (implementation)
+ * @details Every @c PmtaConnection which calls @c submitAsync() gets one worker thread with its own @c PmtaConn.
+ * Jobs are processed in FIFO order; the message stays locked (cannot be modified or submitted again)
+ * until its @c PmtaSubmitFuture observes completion. A message freed before that (objects are freed in handle
+ * order at the end of the request) waits for the job, so that the worker never submits a freed @c PmtaMsg.
+@code{.php}
+final class PmtaSubmitFuture
+{
+	private $job;     // shared with the worker thread
+	private $message; // PmtaMessage, locked while the job is in flight
+
+	private function __construct() {}
+
+	public function __destruct()
+	{
+		$this->wait();
+	}
+
+	public function isDone()
+	{
+		return $this->wait(0);
+	}
+
+	public function wait($timeout = null)
+	{
+		// Blocks until the worker completes the job or $timeout seconds pass
+		return $this->job->done;
+	}
+
+	public function result()
+	{
+		$this->wait();
+		if (!$this->job->result && ini_get('pmta.always_throw_exceptions')) {
+			throw $this->getLastError();
+		}
+
+		return $this->job->result;
+	}
+
+	public function getLastError()
+	{
+		return new PmtaErrorConnection($this->job->error, $this->job->error_code);
+	}
+
+	private function __clone() {}
+}
+@endcode
+ */
+
+#include "pmta_async.h"
+#include "pmta_error.h"
+#include "pmta_message.h"
+#include "pmta_common.h"
+#include <submitter/PmtaConn.h>
+#include <PmtaApi.h>
+
+#ifdef HAVE_PMTA_THREADS
+#	include <pthread.h>
+#	include <errno.h>
+#	include <sys/time.h>
+#	define PMTA_LOCK(x)   pthread_mutex_lock(&(x)->lock)
+#	define PMTA_UNLOCK(x) pthread_mutex_unlock(&(x)->lock)
+#else
+#	define PMTA_LOCK(x)
+#	define PMTA_UNLOCK(x)
+#endif
+
+/**
+ * @brief Submission job, shared by the worker thread and @c PmtaSubmitFuture
+ * @note Allocated with @c malloc() because it is accessed from the worker thread
+ */
+struct _pmta_job {
+	struct _pmta_job* next; /**< Next job in the worker's queue */
+	PmtaMsg msg;            /**< Message to submit; @c NULL once @c PmtaMessage has been freed */
+	char* error;            /**< Error message (@c malloc'ed) */
+	int error_code;         /**< Error code */
+	int refcount;           /**< Number of owners (the worker, the future and the message) */
+	BOOL result;            /**< Submission result */
+	zend_bool done;         /**< Whether the job is complete */
+#ifdef HAVE_PMTA_THREADS
+	pthread_mutex_t lock;   /**< Protects @c refcount, @c done and the result */
+	pthread_cond_t cond;    /**< Signalled on completion */
+#endif
+};
+
+/**
+ * @brief Background submission worker
+ */
+struct _pmta_worker {
+#ifdef HAVE_PMTA_THREADS
+	pthread_t thread;      /**< Worker thread */
+	pthread_mutex_t lock;  /**< Protects the queue and @c stop */
+	pthread_cond_t cond;   /**< Signalled when a job is queued or the worker is asked to stop */
+#endif
+	pmta_job* head;        /**< First queued job */
+	pmta_job* tail;        /**< Last queued job */
+	PmtaConn conn;         /**< Connection owned by the worker thread */
+	char* server;          /**< PowerMTA server */
+	char* username;        /**< Username to authenticate with */
+	char* password;        /**< Password to authenticate with */
+	long int port;         /**< Server port */
+	int stop;              /**< Whether the worker should exit once the queue is empty */
+};
+
+/**
+ * @brief @c PmtaSubmitFuture object handlers
+ */
+static zend_object_handlers pmtafuture_object_handlers;
+
+/**
+ * @brief Internal properties of @c PmtaSubmitFuture
+ */
+typedef struct _pmtafuture_object {
+	zend_object obj; /**< Zend object data */
+	pmta_job* job;   /**< Submission job */
+	zval* message;   /**< @c PmtaMessage being submitted; released once the job is complete */
+} pmtafuture_object;
+
+/**
+ * @brief Fetches @c pmtafuture_object
+ * @see pmtafuture_object
+ * @param zobj @c PmtaSubmitFuture instance
+ * @return pmtafuture_object associated with @a zobj
+ * @pre <tt>Z_TYPE_P(zobj) == IS_OBJECT && instanceof_function(Z_OBJCE_P(zobj), pmta_future_class TSRMLS_CC)</tt>
+ */
+static inline pmtafuture_object* fetchPmtaFutureObject(zval* zobj TSRMLS_DC)
+{
+	return (pmtafuture_object*)zend_objects_get_address(zobj TSRMLS_CC);
+}
+
+/**
+ * @brief Allocates a job
+ * @param msg Message to submit
+ * @param refcount Initial number of owners
+ * @return Job or @c NULL if out of memory
+ */
+static pmta_job* pmta_job_new(PmtaMsg msg, int refcount)
+{
+	pmta_job* job = calloc(1, sizeof(pmta_job));
+	if (job) {
+		job->msg      = msg;
+		job->refcount = refcount;
+#ifdef HAVE_PMTA_THREADS
+		pthread_mutex_init(&job->lock, NULL);
+		pthread_cond_init(&job->cond, NULL);
+#endif
+	}
+
+	return job;
+}
+
+void pmta_job_addref(pmta_job* job)
+{
+	PMTA_LOCK(job);
+	++job->refcount;
+	PMTA_UNLOCK(job);
+}
+
+void pmta_job_release(pmta_job* job)
+{
+	int refcount;
+
+	PMTA_LOCK(job);
+	refcount = --job->refcount;
+	PMTA_UNLOCK(job);
+
+	if (!refcount) {
+#ifdef HAVE_PMTA_THREADS
+		pthread_cond_destroy(&job->cond);
+		pthread_mutex_destroy(&job->lock);
+#endif
+		free(job->error);
+		free(job);
+	}
+}
+
+/**
+ * @brief Stores the result of the job and wakes up the waiters
+ * @param job Job
+ * @param res Submission result
+ * @param code Error code
+ * @param error Error message (copied)
+ */
+static void pmta_job_complete(pmta_job* job, BOOL res, int code, const char* error)
+{
+	PMTA_LOCK(job);
+	job->result     = res;
+	job->error_code = code;
+	job->error      = (error && TRUE != res) ? strdup(error) : NULL;
+	job->done       = 1;
+#ifdef HAVE_PMTA_THREADS
+	pthread_cond_broadcast(&job->cond);
+#endif
+	PMTA_UNLOCK(job);
+}
+
+/**
+ * @brief Waits for the job to complete
+ * @param job Job
+ * @param timeout How long to wait, seconds; negative value means forever
+ * @return Whether the job is complete
+ */
+static int pmta_job_wait(pmta_job* job, double timeout)
+{
+	int done;
+
+#ifdef HAVE_PMTA_THREADS
+	pthread_mutex_lock(&job->lock);
+	if (!job->done && timeout < 0) {
+		while (!job->done) {
+			pthread_cond_wait(&job->cond, &job->lock);
+		}
+	}
+	else if (!job->done && timeout > 0) {
+		struct timeval now;
+		struct timespec until;
+		double t;
+
+		gettimeofday(&now, NULL);
+		t              = now.tv_sec + now.tv_usec / 1000000.0 + timeout;
+		until.tv_sec   = (time_t)t;
+		until.tv_nsec  = (long int)((t - (double)until.tv_sec) * 1000000000.0);
+
+		while (!job->done) {
+			if (ETIMEDOUT == pthread_cond_timedwait(&job->cond, &job->lock, &until)) {
+				break;
+			}
+		}
+	}
+
+	done = job->done;
+	pthread_mutex_unlock(&job->lock);
+#else
+	done = job->done;
+#endif
+
+	return done;
+}
+
+void pmta_job_detach_message(pmta_job* job)
+{
+	pmta_job_wait(job, -1);
+
+	PMTA_LOCK(job);
+	job->msg = NULL;
+	PMTA_UNLOCK(job);
+}
+
+/**
+ * @brief Returns whether the message of the job is still alive
+ * @param job Job
+ * @return Whether @c pmta_job_detach_message() has not been called
+ */
+static int pmta_job_has_message(pmta_job* job)
+{
+	int res;
+
+	PMTA_LOCK(job);
+	res = (NULL != job->msg);
+	PMTA_UNLOCK(job);
+	return res;
+}
+
+#ifdef HAVE_PMTA_THREADS
+/**
+ * @brief Submits one job over the worker's connection
+ * @param worker Worker
+ * @param job Job
+ */
+static void pmta_worker_run(pmta_worker* worker, pmta_job* job)
+{
+	BOOL res;
+
+	if (!worker->conn) {
+		worker->conn = PmtaConnAlloc();
+		if (!worker->conn) {
+			pmta_job_complete(job, FALSE, PmtaApiERROR_PHP_API, "PmtaConnAlloc() failed");
+			return;
+		}
+
+		if (worker->username && worker->password) {
+			res = PmtaConnConnectRemoteAuth(worker->conn, worker->server, worker->port, worker->username, worker->password);
+		}
+		else {
+			res = PmtaConnConnectRemote(worker->conn, worker->server, worker->port);
+		}
+
+		if (FALSE == res) {
+			pmta_job_complete(job, FALSE, PmtaConnGetLastErrorType(worker->conn), PmtaConnGetLastError(worker->conn));
+			PmtaConnFree(worker->conn);
+			worker->conn = NULL;
+			return;
+		}
+	}
+
+	res = PmtaConnSubmit(worker->conn, job->msg);
+	if (TRUE == res) {
+		pmta_job_complete(job, TRUE, 0, NULL);
+	}
+	else {
+		int code = PmtaConnGetLastErrorType(worker->conn);
+
+		pmta_job_complete(job, FALSE, code, PmtaConnGetLastError(worker->conn));
+		if (PmtaApiERROR_IO == code) {
+			PmtaConnFree(worker->conn);
+			worker->conn = NULL;
+		}
+	}
+}
+
+/**
+ * @brief Worker thread
+ * @param arg Worker
+ * @return @c NULL
+ */
+static void* pmta_worker_main(void* arg)
+{
+	pmta_worker* worker = arg;
+
+	for (;;) {
+		pmta_job* job;
+
+		pthread_mutex_lock(&worker->lock);
+		while (!worker->head && !worker->stop) {
+			pthread_cond_wait(&worker->cond, &worker->lock);
+		}
+
+		job = worker->head;
+		if (job) {
+			worker->head = job->next;
+			if (!worker->head) {
+				worker->tail = NULL;
+			}
+		}
+
+		pthread_mutex_unlock(&worker->lock);
+
+		if (!job) {
+			break;
+		}
+
+		pmta_worker_run(worker, job);
+		pmta_job_release(job);
+	}
+
+	if (worker->conn) {
+		PmtaConnFree(worker->conn);
+		worker->conn = NULL;
+	}
+
+	return NULL;
+}
+#endif
+
+pmta_worker* pmta_worker_start(const char* server, long int port, const char* username, const char* password)
+{
+#ifdef HAVE_PMTA_THREADS
+	pmta_worker* worker = calloc(1, sizeof(pmta_worker));
+	if (!worker) {
+		return NULL;
+	}
+
+	worker->server   = strdup(server);
+	worker->port     = port;
+	worker->username = username ? strdup(username) : NULL;
+	worker->password = password ? strdup(password) : NULL;
+
+	pthread_mutex_init(&worker->lock, NULL);
+	pthread_cond_init(&worker->cond, NULL);
+
+	if (!worker->server || 0 != pthread_create(&worker->thread, NULL, pmta_worker_main, worker)) {
+		pthread_cond_destroy(&worker->cond);
+		pthread_mutex_destroy(&worker->lock);
+		free(worker->server);
+		free(worker->username);
+		free(worker->password);
+		free(worker);
+		return NULL;
+	}
+
+	return worker;
+#else
+	return NULL;
+#endif
+}
+
+void pmta_worker_stop(pmta_worker* worker)
+{
+#ifdef HAVE_PMTA_THREADS
+	pthread_mutex_lock(&worker->lock);
+	worker->stop = 1;
+	pthread_cond_signal(&worker->cond);
+	pthread_mutex_unlock(&worker->lock);
+
+	pthread_join(worker->thread, NULL);
+
+	pthread_cond_destroy(&worker->cond);
+	pthread_mutex_destroy(&worker->lock);
+	free(worker->server);
+	free(worker->username);
+	free(worker->password);
+	free(worker);
+#endif
+}
+
+/**
+ * @brief Initializes @c PmtaSubmitFuture instance
+ * @param result @c PmtaSubmitFuture instance (output)
+ * @param job Job (the future takes over one reference)
+ * @param message @c PmtaMessage to keep alive and locked until the job is complete, or @c NULL
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmta_future_init(zval* result, pmta_job* job, zval* message TSRMLS_DC)
+{
+	pmtafuture_object* obj;
+
+	object_init_ex(result, pmta_future_class);
+	obj      = fetchPmtaFutureObject(result TSRMLS_CC);
+	obj->job = job;
+
+	if (message) {
+		Z_ADDREF_P(message);
+		obj->message = message;
+		lock_message(message, job TSRMLS_CC);
+	}
+}
+
+void pmta_worker_submit(pmta_worker* worker, zval* message, PmtaMsg msg, zval* result TSRMLS_DC)
+{
+	pmta_job* job = pmta_job_new(msg, 2);
+
+	if (!job) {
+		pmta_future_completed(result, FALSE, PmtaApiERROR_OutOfMemory, "Out of memory" TSRMLS_CC);
+		return;
+	}
+
+#ifdef HAVE_PMTA_THREADS
+	pthread_mutex_lock(&worker->lock);
+	if (worker->tail) {
+		worker->tail->next = job;
+	}
+	else {
+		worker->head = job;
+	}
+
+	worker->tail = job;
+	pthread_cond_signal(&worker->cond);
+	pthread_mutex_unlock(&worker->lock);
+#else
+	pmta_job_complete(job, FALSE, PmtaApiERROR_PHP_API, "Background submission is not supported");
+	--job->refcount;
+#endif
+
+	pmta_future_init(result, job, message TSRMLS_CC);
+}
+
+void pmta_future_completed(zval* result, BOOL res, int code, const char* error TSRMLS_DC)
+{
+	pmta_job* job = pmta_job_new(NULL, 1);
+
+	if (job) {
+		pmta_job_complete(job, res, code, error);
+	}
+
+	pmta_future_init(result, job, NULL TSRMLS_CC);
+}
+
+/**
+ * @brief Waits for the job and releases the message once the job is complete
+ * @param obj @c pmtafuture_object
+ * @param timeout How long to wait, seconds; negative value means forever
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the job is complete
+ */
+static int pmtafuture_wait(pmtafuture_object* obj, double timeout TSRMLS_DC)
+{
+	if (!obj->job) {
+		return 1;
+	}
+
+	if (!pmta_job_wait(obj->job, timeout)) {
+		return 0;
+	}
+
+	if (obj->message) {
+		if (pmta_job_has_message(obj->job)) {
+			unlock_message(obj->message TSRMLS_CC);
+		}
+
+		zval_ptr_dtor(&obj->message);
+		obj->message = NULL;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief @c PmtaSubmitFuture destructor
+ * @param v @c pmtafuture_object
+ * @param tsrm_ls Internally used by Zend
+ * @details Waits for the job to complete and frees all memory allocated for @c pmtafuture_object
+ */
+static void pmtafuture_dtor(void* v TSRMLS_DC)
+{
+	pmtafuture_object* obj = v;
+
+	if (obj->job) {
+		pmtafuture_wait(obj, -1 TSRMLS_CC);
+		pmta_job_release(obj->job);
+	}
+
+	zend_object_std_dtor(&(obj->obj) TSRMLS_CC);
+	efree(obj);
+}
+
+/**
+ * @brief @c PmtaSubmitFuture constructor
+ * @param ce Class Entry for @c PmtaSubmitFuture
+ * @param tsrm_ls Internally used by Zend
+ * @return Zend Object Value
+ * @details Allocates memory for @c pmtafuture_object and registers the destructor
+ */
+static zend_object_value pmtafuture_ctor(zend_class_entry* ce TSRMLS_DC)
+{
+	pmtafuture_object* obj = ecalloc(1, sizeof(pmtafuture_object));
+	zend_object_value retval;
+
+	zend_object_std_init(&obj->obj, ce TSRMLS_CC);
+#if PHP_VERSION_ID >= 50400
+	object_properties_init(&obj->obj, ce);
+#endif
+
+	retval.handle = zend_objects_store_put(
+		obj,
+		(zend_objects_store_dtor_t)zend_objects_destroy_object,
+		pmtafuture_dtor,
+		NULL TSRMLS_CC
+	);
+
+	retval.handlers = &pmtafuture_object_handlers;
+
+	return retval;
+}
+
+/**
+ * @brief public function isDone();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns whether the submission is complete (never blocks)
+ */
+static PHP_METHOD(PmtaSubmitFuture, isDone)
+{
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	RETURN_BOOL(pmtafuture_wait(fetchPmtaFutureObject(getThis() TSRMLS_CC), 0 TSRMLS_CC));
+}
+
+/**
+ * @brief public function wait($timeout = null);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Waits for at most @c $timeout seconds (forever if @c null) and returns whether the submission is complete
+ */
+static PHP_METHOD(PmtaSubmitFuture, wait)
+{
+	zval* ztimeout = NULL;
+	double timeout = -1;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|z", &ztimeout)) {
+		RETURN_NULL();
+	}
+
+	if (ztimeout && Z_TYPE_P(ztimeout) != IS_NULL) {
+		zval dval;
+		ZVAL_ZVAL(&dval, ztimeout, 1, 0);
+		convert_to_double(&dval);
+		timeout = Z_DVAL(dval);
+		zval_dtor(&dval);
+
+		if (timeout < 0) {
+			timeout = 0;
+		}
+	}
+
+	RETURN_BOOL(pmtafuture_wait(fetchPmtaFutureObject(getThis() TSRMLS_CC), timeout TSRMLS_CC));
+}
+
+/**
+ * @brief public function result();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_connection_class
+ *
+ * Waits for the submission to complete and returns its result, exactly like @c PmtaConnection::submitMessage() would
+ */
+static PHP_METHOD(PmtaSubmitFuture, result)
+{
+	pmtafuture_object* obj;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaFutureObject(getThis() TSRMLS_CC);
+	pmtafuture_wait(obj, -1 TSRMLS_CC);
+
+	if (obj->job && TRUE == obj->job->result) {
+		RETURN_TRUE;
+	}
+
+	if (PMTA_G(use_exceptions)) {
+		if (obj->job) {
+			throw_pmta_error(pmta_error_connection_class, obj->job->error_code, obj->job->error ? obj->job->error : "", NULL TSRMLS_CC);
+		}
+		else {
+			throw_pmta_error(pmta_error_connection_class, PmtaApiERROR_OutOfMemory, "Out of memory", NULL TSRMLS_CC);
+		}
+
+		RETURN_NULL();
+	}
+
+	RETURN_FALSE;
+}
+
+/**
+ * @brief public function getLastError();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns the submission error
+ */
+static PHP_METHOD(PmtaSubmitFuture, getLastError)
+{
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	if (return_value_used) {
+		pmtafuture_object* obj = fetchPmtaFutureObject(getThis() TSRMLS_CC);
+
+		if (!obj->job) {
+			throw_pmta_error(pmta_error_connection_class, PmtaApiERROR_OutOfMemory, "Out of memory", &return_value TSRMLS_CC);
+		}
+		else if (!pmtafuture_wait(obj, 0 TSRMLS_CC)) {
+			throw_pmta_error(pmta_error_connection_class, PmtaApiERROR_PHP_API, "Submission is in progress", &return_value TSRMLS_CC);
+		}
+		else {
+			throw_pmta_error(pmta_error_connection_class, obj->job->error_code, obj->job->error ? obj->job->error : "", &return_value TSRMLS_CC);
+		}
+	}
+}
+
+/**
+ * @brief arginfo for @c wait()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_wait, 0, 0, 0)
+	ZEND_ARG_INFO(0, timeout)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief @c PmtaSubmitFuture class methods
+ */
+static
+#if ZEND_MODULE_API_NO > 20060613
+const
+#endif
+zend_function_entry pmta_future_class_methods[] = {
+	PHP_ME(PmtaSubmitFuture, isDone,       arginfo_empty, ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaSubmitFuture, wait,         arginfo_wait,  ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaSubmitFuture, result,       arginfo_empty, ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaSubmitFuture, getLastError, arginfo_empty, ZEND_ACC_PUBLIC)
+	PHP_ME_MAPPING(__construct, empty_destructor, arginfo_empty, ZEND_ACC_PRIVATE | ZEND_ACC_CTOR)
+	PHP_ME_MAPPING(__destruct,  empty_destructor, arginfo_empty, ZEND_ACC_PUBLIC | ZEND_ACC_DTOR)
+	PHP_FE_END
+};
+
+/**
+ * Registers @c PmtaSubmitFuture class with Zend
+ */
+void pmtafuture_register_class(TSRMLS_D)
+{
+	zend_class_entry e;
+
+	INIT_CLASS_ENTRY(e, "PmtaSubmitFuture", pmta_future_class_methods);
+
+	pmta_future_class = zend_register_internal_class(&e TSRMLS_CC);
+
+	pmta_future_class->ce_flags     |= ZEND_ACC_FINAL_CLASS;
+	pmta_future_class->create_object = pmtafuture_ctor;
+	pmta_future_class->serialize     = zend_class_serialize_deny;
+	pmta_future_class->unserialize   = zend_class_unserialize_deny;
+
+	pmtafuture_object_handlers = *zend_get_std_object_handlers();
+	pmtafuture_object_handlers.clone_obj = NULL;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file pmta_async.h
+ * @brief Background submission worker and @c PmtaSubmitFuture class
+ * @details
+@code{.php}
+final class PmtaSubmitFuture
+{
+	private function __construct();
+	public function __destruct();
+	public function isDone();
+	public function wait($timeout = null);
+	public function result();
+	public function getLastError();
+	private function __clone();
+}
+@endcode
+ */
+
+#ifdef DOXYGEN
+#	undef PMTA_ASYNC_H
+#endif
+
+#ifndef PMTA_ASYNC_H
+#define PMTA_ASYNC_H
+
+#include "php_pmta.h"
+#include <submitter/PmtaMsg.h>
+
+/**
+ * @brief Background submission worker (opaque)
+ */
+typedef struct _pmta_worker pmta_worker;
+
+/**
+ * @brief Submission job (opaque)
+ */
+typedef struct _pmta_job pmta_job;
+
+/**
+ * @brief Starts a worker thread with its own connection to PowerMTA
+ * @param server PowerMTA server
+ * @param port Server port
+ * @param username Username (@c NULL if authentication is not required)
+ * @param password Password (@c NULL if authentication is not required)
+ * @return Worker or @c NULL if threads are not available
+ * @note The worker connects on its first job and reconnects after I/O errors
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern pmta_worker* pmta_worker_start(const char* server, long int port, const char* username, const char* password);
+
+/**
+ * @brief Stops the worker after it has processed all queued jobs
+ * @param worker Worker
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_worker_stop(pmta_worker* worker);
+
+/**
+ * @brief Queues the message for submission and returns @c PmtaSubmitFuture
+ * @param worker Worker
+ * @param message @c PmtaMessage instance; locked until the future observes completion
+ * @param msg Message handle of @a message
+ * @param result @c PmtaSubmitFuture instance (output)
+ * @param tsrm_ls Internally used by Zend
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_worker_submit(pmta_worker* worker, zval* message, PmtaMsg msg, zval* result TSRMLS_DC);
+
+/**
+ * @brief Creates an already completed @c PmtaSubmitFuture (used when threads are not available)
+ * @param result @c PmtaSubmitFuture instance (output)
+ * @param res Submission result
+ * @param code Error code (if @a res is @c FALSE)
+ * @param error Error message (if @a res is @c FALSE)
+ * @param tsrm_ls Internally used by Zend
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_future_completed(zval* result, BOOL res, int code, const char* error TSRMLS_DC);
+
+/**
+ * @brief Takes one more reference to the job
+ * @param job Job
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_job_addref(pmta_job* job);
+
+/**
+ * @brief Drops one reference to the job, frees the job when the last reference is gone
+ * @param job Job
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_job_release(pmta_job* job);
+
+/**
+ * @brief Waits until the worker is done with the message of the job and detaches the message
+ * @param job Job
+ * @details Called when @c PmtaMessage is freed while the job is pending (at the end of the request, objects
+ * are freed regardless of the references held by @c PmtaSubmitFuture); the future then no longer touches the message
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_job_detach_message(pmta_job* job);
+
+/**
+ * @brief Registers @c PmtaSubmitFuture class
+ * @param tsrm_ls Internally used by Zend
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmtafuture_register_class(TSRMLS_D);
+
+#endif /* PMTA_ASYNC_H */
@@ -0,0 +1,420 @@
+/**
+ * @file pmta_body.c
+ * @brief Message body journal (implementation)
+ */
+
+#include "pmta_body.h"
+
+/**
+ * @brief Size of the record header (operation and payload length)
+ */
+#define PMTA_BODY_HEADER (1 + sizeof(zend_uint))
+
+/**
+ * @brief Initial size of the journal
+ */
+#define PMTA_BODY_BLOCK 4096
+
+/**
+ * @brief Allocates a journal
+ * @param size Initial size of the buffer
+ * @return Journal with one owner
+ */
+static pmta_body* pmta_body_alloc(size_t size)
+{
+	pmta_body* body = emalloc(sizeof(pmta_body));
+
+	body->buf      = emalloc(size);
+	body->len      = 0;
+	body->size       = size;
+	body->refcount   = 1;
+	body->last       = (size_t)-1;
+	body->last_spill = (size_t)-1;
+	body->spill      = NULL;
+	return body;
+}
+
+pmta_body* pmta_body_append(pmta_body* body, size_t* len, enum pmta_body_op op, const char* data, size_t n)
+{
+	size_t need = *len + PMTA_BODY_HEADER + n;
+	zend_uint n32 = (zend_uint)n;
+	char* p;
+
+	if (!body) {
+		body = pmta_body_alloc(MAX(need, PMTA_BODY_BLOCK));
+	}
+	else if (body->len != *len) {
+		/* Someone else has appended to the shared journal: copy our part of it */
+		pmta_body* copy = pmta_body_alloc(MAX(need, PMTA_BODY_BLOCK));
+
+		memcpy(copy->buf, body->buf, *len);
+		copy->len = *len;
+		if (body->spill) {
+			/* Our records may refer to the spill file */
+			copy->spill = body->spill;
+			++copy->spill->refcount;
+		}
+
+		pmta_body_release(body);
+		body = copy;
+	}
+
+	if (need > body->size) {
+		size_t size = body->size;
+
+		while (size < need) {
+			size *= 2;
+		}
+
+		body->buf  = erealloc(body->buf, size);
+		body->size = size;
+	}
+
+	body->last = body->len;
+	p          = body->buf + body->len;
+	*p++       = (char)op;
+	memcpy(p, &n32, sizeof(zend_uint));
+	p += sizeof(zend_uint);
+	if (data && n) {
+		memcpy(p, data, n);
+	}
+
+	body->len = need;
+	*len      = need;
+	return body;
+}
+
+pmta_body* pmta_body_reserve(pmta_body* body, size_t* len, enum pmta_body_op op, size_t max, char** data)
+{
+	body  = pmta_body_append(body, len, op, NULL, max);
+	*data = body->buf + *len - max;
+	return body;
+}
+
+void pmta_body_finish(pmta_body* body, size_t* len, size_t max, size_t n)
+{
+	size_t start  = *len - max;
+	zend_uint n32 = (zend_uint)n;
+
+	if (!n) {
+		/* Drop the empty record */
+		start     -= PMTA_BODY_HEADER;
+		body->last = (size_t)-1;
+	}
+	else {
+		memcpy(body->buf + start - sizeof(zend_uint), &n32, sizeof(zend_uint));
+	}
+
+	body->len = start + n;
+	*len      = start + n;
+}
+
+int pmta_body_spill(pmta_body* body, size_t* len, size_t applied)
+{
+	size_t start            = body->last;
+	pmta_body_spilled* prev = NULL;
+	pmta_body_spilled spilled;
+	zend_uint n;
+
+	if ((size_t)-1 == start || start < applied || body->len != *len || PMTA_BODY_DATA != body->buf[start]) {
+		return FAILURE;
+	}
+
+	memcpy(&n, body->buf + start + 1, sizeof(zend_uint));
+
+	/* The data can be merged into the preceding spill record if nobody else sees that record */
+	if (
+		   body->spill
+		&& 1 == body->refcount
+		&& (size_t)-1 != body->last_spill
+		&& body->last_spill >= applied
+		&& body->last_spill + PMTA_BODY_HEADER + sizeof(pmta_body_spilled) == start
+	) {
+		memcpy(&spilled, body->buf + body->last_spill + PMTA_BODY_HEADER, sizeof(pmta_body_spilled));
+		if (spilled.offset + spilled.len == body->spill->len) {
+			prev = (pmta_body_spilled*)(body->buf + body->last_spill + PMTA_BODY_HEADER);
+		}
+	}
+
+	if (!prev && n <= sizeof(pmta_body_spilled)) {
+		/* The spill record would be larger than the data */
+		return FAILURE;
+	}
+
+	if (!body->spill) {
+		FILE* f = tmpfile();
+
+		if (!f) {
+			return FAILURE;
+		}
+
+		body->spill           = emalloc(sizeof(pmta_body_spill_file));
+		body->spill->f        = f;
+		body->spill->len      = 0;
+		body->spill->refcount = 1;
+	}
+
+	/* Reads move the file position; other copies of the journal may have written past our data */
+	if (
+		   0 != fseek(body->spill->f, (long int)body->spill->len, SEEK_SET)
+		|| n != fwrite(body->buf + start + PMTA_BODY_HEADER, 1, n, body->spill->f)
+	) {
+		return FAILURE;
+	}
+
+	/* Drop the data record */
+	body->len = start;
+	*len      = start;
+
+	if (prev) {
+		spilled.len += n;
+		memcpy(prev, &spilled, sizeof(pmta_body_spilled));
+		body->last = body->last_spill;
+	}
+	else {
+		spilled.offset = body->spill->len;
+		spilled.len    = n;
+		pmta_body_append(body, len, PMTA_BODY_SPILL, (const char*)&spilled, sizeof(pmta_body_spilled));
+		body->last_spill = start;
+	}
+
+	body->spill->len += n;
+
+	/* Give back the memory taken by large records */
+	if (body->size > PMTA_BODY_BLOCK && body->len < body->size / 4) {
+		body->size = MAX(2 * body->len, PMTA_BODY_BLOCK);
+		body->buf  = erealloc(body->buf, body->size);
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief Reads the spilled data in chunks and adds it to @c PmtaMsg
+ * @param spill Spill file
+ * @param data Payload of @c PMTA_BODY_SPILL record
+ * @param msg Message
+ * @param error Error message if the file could not be read (output)
+ * @return @c TRUE or @c FALSE
+ */
+static BOOL pmta_body_replay_spill(pmta_body_spill_file* spill, const char* data, PmtaMsg msg, const char** error)
+{
+	pmta_body_spilled spilled;
+	char* chunk;
+	BOOL res = TRUE;
+
+	memcpy(&spilled, data, sizeof(pmta_body_spilled));
+	if (!spill || 0 != fseek(spill->f, (long int)spilled.offset, SEEK_SET)) {
+		*error = "Unable to read the spilled body data";
+		return FALSE;
+	}
+
+	chunk = emalloc(PMTA_BODY_FILE_CHUNK);
+	while (TRUE == res && spilled.len) {
+		size_t want = MIN(spilled.len, PMTA_BODY_FILE_CHUNK);
+
+		if (want != fread(chunk, 1, want, spill->f)) {
+			*error = "Unable to read the spilled body data";
+			res    = FALSE;
+			break;
+		}
+
+		res          = PmtaMsgAddData(msg, chunk, want);
+		spilled.len -= want;
+	}
+
+	efree(chunk);
+	return res;
+}
+
+static int pmta_body_replay_records(pmta_body_spill_file* spill, const char* buf, size_t* from, size_t to, PmtaMsg msg, const char** error);
+
+/**
+ * @brief Applies one record to @c PmtaMsg
+ * @param spill Spill file of the journal, @c NULL if there is none
+ * @param op Operation
+ * @param data Payload
+ * @param n Length of @a data
+ * @param msg Message
+ * @param error Error message if the spill file could not be read (output)
+ * @return @c TRUE or @c FALSE
+ */
+static BOOL pmta_body_apply_record(pmta_body_spill_file* spill, int op, const char* data, size_t n, PmtaMsg msg, const char** error)
+{
+	int part;
+	pmta_body_ref ref;
+	size_t ref_pos;
+
+	switch (op) {
+		case PMTA_BODY_DATA:  return PmtaMsgAddData(msg, (char*)data, n);
+		case PMTA_BODY_MERGE: return PmtaMsgAddMergeData(msg, (char*)data, n);
+		case PMTA_BODY_DATE:  return PmtaMsgAddDateHeader(msg);
+		case PMTA_BODY_PART:
+			memcpy(&part, data, sizeof(int));
+			return PmtaMsgBeginPart(msg, part);
+
+		case PMTA_BODY_REF:
+			memcpy(&ref, data, sizeof(pmta_body_ref));
+			ref_pos = 0;
+			return (SUCCESS == pmta_body_replay_records(NULL, ref.buf, &ref_pos, ref.len, msg, error)) ? TRUE : FALSE;
+
+		case PMTA_BODY_SPILL: return pmta_body_replay_spill(spill, data, msg, error);
+		default:              return FALSE;
+	}
+}
+
+/**
+ * @brief Applies the records to @c PmtaMsg
+ * @param spill Spill file of the journal, @c NULL if there is none
+ * @param buf Records
+ * @param from Offset of the first record to apply (input); offset of the first record that has not been applied (output)
+ * @param to Offset of the end of the last record to apply
+ * @param msg Message
+ * @param error Error message if the spill file could not be read (output)
+ * @return @c SUCCESS or @c FAILURE
+ */
+static int pmta_body_replay_records(pmta_body_spill_file* spill, const char* buf, size_t* from, size_t to, PmtaMsg msg, const char** error)
+{
+	size_t pos = *from;
+	int result = SUCCESS;
+
+	while (pos < to) {
+		const char* p = buf + pos;
+		zend_uint n;
+
+		memcpy(&n, p + 1, sizeof(zend_uint));
+		if (FALSE == pmta_body_apply_record(spill, *p, p + PMTA_BODY_HEADER, n, msg, error)) {
+			result = FAILURE;
+			break;
+		}
+
+		pos += PMTA_BODY_HEADER + n;
+	}
+
+	*from = pos;
+	return result;
+}
+
+int pmta_body_replay(const pmta_body* body, size_t* from, size_t to, PmtaMsg msg, const char** error)
+{
+	*error = NULL;
+	return pmta_body_replay_records(body->spill, body->buf, from, to, msg, error);
+}
+
+int pmta_body_apply(enum pmta_body_op op, const char* data, size_t n, PmtaMsg msg, const char** error)
+{
+	*error = NULL;
+	return (TRUE == pmta_body_apply_record(NULL, op, data, n, msg, error)) ? SUCCESS : FAILURE;
+}
+
+void pmta_body_truncate(pmta_body* body, size_t* len, size_t to)
+{
+	if (body->len == *len) {
+		body->len = to;
+	}
+
+	if (body->last != (size_t)-1 && body->last >= to) {
+		body->last = (size_t)-1;
+	}
+
+	if (body->last_spill != (size_t)-1 && body->last_spill >= to) {
+		body->last_spill = (size_t)-1;
+	}
+
+	*len = to;
+}
+
+/**
+ * @brief Computes the number of body bytes recorded in @a buf
+ * @param buf Records
+ * @param from Offset of the first record
+ * @param to Offset of the end of the last record
+ * @return Number of bytes
+ */
+static size_t pmta_body_size_records(const char* buf, size_t from, size_t to)
+{
+	size_t size = 0;
+
+	while (from < to) {
+		const char* p = buf + from;
+		zend_uint n;
+
+		memcpy(&n, p + 1, sizeof(zend_uint));
+		size += pmta_body_record_size(*p, p + PMTA_BODY_HEADER, n);
+		from += PMTA_BODY_HEADER + n;
+	}
+
+	return size;
+}
+
+size_t pmta_body_record_size(enum pmta_body_op op, const char* data, size_t n)
+{
+	pmta_body_ref ref;
+	pmta_body_spilled spilled;
+
+	switch (op) {
+		case PMTA_BODY_DATA:
+		case PMTA_BODY_MERGE:
+			return n;
+
+		case PMTA_BODY_REF:
+			memcpy(&ref, data, sizeof(pmta_body_ref));
+			return pmta_body_size_records(ref.buf, 0, ref.len);
+
+		case PMTA_BODY_SPILL:
+			memcpy(&spilled, data, sizeof(pmta_body_spilled));
+			return spilled.len;
+
+		default:
+			return 0;
+	}
+}
+
+size_t pmta_body_size(const pmta_body* body, size_t from, size_t to)
+{
+	return pmta_body_size_records(body->buf, from, to);
+}
+
+/**
+ * @brief Detaches the journal from its spill file; the file is closed (and removed) when no journal uses it
+ * @param body Journal
+ */
+static void pmta_body_drop_spill(pmta_body* body)
+{
+	if (body->spill && 0 == --body->spill->refcount) {
+		fclose(body->spill->f);
+		efree(body->spill);
+	}
+
+	body->spill = NULL;
+}
+
+pmta_body* pmta_body_reset(pmta_body* body)
+{
+	if (1 != body->refcount) {
+		pmta_body_release(body);
+		return NULL;
+	}
+
+	pmta_body_drop_spill(body);
+	body->len        = 0;
+	body->last       = (size_t)-1;
+	body->last_spill = (size_t)-1;
+
+	/* Do not keep a buffer grown by a large body */
+	if (body->size > PMTA_BODY_BLOCK) {
+		body->size = PMTA_BODY_BLOCK;
+		body->buf  = erealloc(body->buf, body->size);
+	}
+
+	return body;
+}
+
+void pmta_body_release(pmta_body* body)
+{
+	if (0 == --body->refcount) {
+		pmta_body_drop_spill(body);
+		efree(body->buf);
+		efree(body);
+	}
+}
@@ -0,0 +1,204 @@
+/**
+ * @file pmta_body.h
+ * @brief Message body journal shared between @c PmtaMessage clones
+ * @details Body operations (@c addData(), @c addMergeData(), @c beginPart(), @c addDateHeader(), @c addTemplate()) of a cloneable
+ * message are recorded in a journal, so that a clone can apply them to its own @c PmtaMsg when it is submitted
+ * (other messages use the journal only for the data waiting in the spill file). The journal is append-only: every owner
+ * remembers how many bytes of it belong to its message, so a clone shares the body with the original
+ * and the journal is copied only when an owner appends to a journal which has grown past its own length.
+ * Data records may be moved to a temporary file (@c pmta_body_spill()) which is shared by all copies of the journal.
+ */
+
+#ifdef DOXYGEN
+#	undef PMTA_BODY_H
+#endif
+
+#ifndef PMTA_BODY_H
+#define PMTA_BODY_H
+
+#include "php_pmta.h"
+#include <submitter/PmtaMsg.h>
+
+/**
+ * @brief Body operations
+ */
+enum pmta_body_op {
+	PMTA_BODY_DATA  = 1, /**< @c PmtaMsgAddData() */
+	PMTA_BODY_MERGE = 2, /**< @c PmtaMsgAddMergeData() */
+	PMTA_BODY_PART  = 3, /**< @c PmtaMsgBeginPart() */
+	PMTA_BODY_DATE  = 4, /**< @c PmtaMsgAddDateHeader() */
+	PMTA_BODY_REF   = 5, /**< Records stored outside of the journal (compiled template) */
+	PMTA_BODY_SPILL = 6  /**< Data moved to the spill file; the payload is @c pmta_body_spilled */
+};
+
+/**
+ * @brief Payload of @c PMTA_BODY_REF record
+ */
+typedef struct _pmta_body_ref {
+	const char* buf; /**< Records; must stay valid while the journal exists */
+	size_t len;      /**< Length of @c buf */
+} pmta_body_ref;
+
+/**
+ * @brief Payload of @c PMTA_BODY_SPILL record
+ */
+typedef struct _pmta_body_spilled {
+	size_t offset; /**< Offset of the data in the spill file */
+	size_t len;    /**< Length of the data */
+} pmta_body_spilled;
+
+/**
+ * @brief Temporary file holding the data moved out of a journal
+ */
+typedef struct _pmta_body_spill_file {
+	FILE* f;      /**< Anonymous temporary file, removed when closed */
+	size_t len;   /**< Number of bytes written */
+	int refcount; /**< Number of journals using the file */
+} pmta_body_spill_file;
+
+/**
+ * @brief Number of raw bytes read from a file at once (a multiple of 57, the size of a full base64 line)
+ */
+#define PMTA_BODY_FILE_CHUNK (57 * 1024)
+
+/**
+ * @brief Number of bytes read from a stream at once
+ */
+#define PMTA_BODY_STREAM_CHUNK 8192
+
+/**
+ * @brief Body journal
+ * @details Every record is the operation byte, the 32-bit payload length (native byte order) and the payload
+ */
+typedef struct _pmta_body {
+	char* buf;                   /**< Records */
+	size_t len;                  /**< Number of bytes used in @c buf */
+	size_t size;                 /**< Size of @c buf */
+	int refcount;                /**< Number of owners */
+	size_t last;                 /**< Offset of the last record, <tt>(size_t)-1</tt> if unknown */
+	size_t last_spill;           /**< Offset of the last @c PMTA_BODY_SPILL record, <tt>(size_t)-1</tt> if unknown */
+	pmta_body_spill_file* spill; /**< Spill file, @c NULL until data is moved out of the journal */
+} pmta_body;
+
+/**
+ * @brief Appends a record to the journal
+ * @param body Journal (may be @c NULL)
+ * @param len Length of the journal as seen by the caller (input/output)
+ * @param op Operation
+ * @param data Payload
+ * @param n Length of @a data
+ * @return Journal to use from now on (a new one if @a body is @c NULL or has to be copied)
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern pmta_body* pmta_body_append(pmta_body* body, size_t* len, enum pmta_body_op op, const char* data, size_t n);
+
+/**
+ * @brief Appends a record whose payload is written by the caller
+ * @param body Journal (may be @c NULL)
+ * @param len Length of the journal as seen by the caller (input/output)
+ * @param op Operation
+ * @param max Maximum length of the payload
+ * @param data Where to write the payload (output)
+ * @return Journal to use from now on
+ * @note The record must be completed with @c pmta_body_finish() before the journal is used again
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern pmta_body* pmta_body_reserve(pmta_body* body, size_t* len, enum pmta_body_op op, size_t max, char** data);
+
+/**
+ * @brief Completes the record started with @c pmta_body_reserve()
+ * @param body Journal returned by @c pmta_body_reserve()
+ * @param len Length of the journal as seen by the caller (input/output)
+ * @param max Maximum length of the payload passed to @c pmta_body_reserve()
+ * @param n Actual length of the payload, <tt>n <= max</tt>; the record is removed if @a n is 0
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_body_finish(pmta_body* body, size_t* len, size_t max, size_t n);
+
+/**
+ * @brief Moves the payload of the last record to the spill file if it is a @c PMTA_BODY_DATA record
+ * @param body Journal
+ * @param len Length of the journal as seen by the caller (input/output)
+ * @param applied Offset up to which the records have been applied to @c PmtaMsg; they are never modified
+ * @return Whether the payload has been moved
+ * @retval SUCCESS Yes
+ * @retval FAILURE No (the last record is not data, or the spill file could not be written), the journal is unchanged
+ * @pre The caller has just appended the last record (<tt>body->len == *len</tt>)
+ * @note Consecutive data is merged into one @c PMTA_BODY_SPILL record while the journal has one owner
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern int pmta_body_spill(pmta_body* body, size_t* len, size_t applied);
+
+/**
+ * @brief Computes the number of body bytes one record adds
+ * @param op Operation
+ * @param data Payload
+ * @param n Length of @a data
+ * @return Number of bytes
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern size_t pmta_body_record_size(enum pmta_body_op op, const char* data, size_t n);
+
+/**
+ * @brief Computes the number of body bytes recorded in the journal
+ * @param body Journal
+ * @param from Offset of the first record
+ * @param to Offset of the end of the last record
+ * @return Number of bytes the records add to the body
+ * @note The @c Date header added by @c PMTA_BODY_DATE records is formatted by the library and is not counted
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern size_t pmta_body_size(const pmta_body* body, size_t from, size_t to);
+
+/**
+ * @brief Applies the records to @c PmtaMsg
+ * @param body Journal
+ * @param from Offset of the first record to apply (input); offset of the first record that has not been applied (output)
+ * @param to Offset of the end of the last record to apply
+ * @param msg Message
+ * @param error Error message if the spill file could not be read, @c NULL otherwise (output)
+ * @return Whether all records have been applied
+ * @retval SUCCESS Yes
+ * @retval FAILURE No, the error is in @a error or, if it is @c NULL, available from @c PmtaMsgGetLastError()
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern int pmta_body_replay(const pmta_body* body, size_t* from, size_t to, PmtaMsg msg, const char** error);
+
+/**
+ * @brief Applies one operation to @c PmtaMsg without recording it
+ * @param op Operation (not @c PMTA_BODY_SPILL)
+ * @param data Payload
+ * @param n Length of @a data
+ * @param msg Message
+ * @param error Error message if the operation could not be applied because of an I/O error, @c NULL otherwise (output)
+ * @return @c SUCCESS or @c FAILURE (the error is in @a error or, if it is @c NULL, available from @c PmtaMsgGetLastError())
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern int pmta_body_apply(enum pmta_body_op op, const char* data, size_t n, PmtaMsg msg, const char** error);
+
+/**
+ * @brief Drops the records past @a to
+ * @param body Journal
+ * @param len Length of the journal as seen by the caller (input/output)
+ * @param to New length, the end of a record, <tt>to <= *len</tt>
+ * @note The records are dropped from the shared buffer only if no other owner has appended past @a len
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_body_truncate(pmta_body* body, size_t* len, size_t to);
+
+/**
+ * @brief Adds an owner to the journal
+ * @param body Journal
+ * @return @a body
+ */
+static inline pmta_body* pmta_body_addref(pmta_body* body)
+{
+	++body->refcount;
+	return body;
+}
+
+/**
+ * @brief Empties the journal for the next body
+ * @param body Journal
+ * @return @a body with no records and no spill file, or @c NULL if @a body is shared (the caller's reference is released)
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern pmta_body* pmta_body_reset(pmta_body* body);
+
+/**
+ * @brief Removes an owner of the journal; the journal is freed when it has no owners left
+ * @param body Journal
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_body_release(pmta_body* body);
+
+#endif /* PMTA_BODY_H */
@@ -7,6 +7,128 @@
 
 #include "pmta_common.h"
 
+#ifdef PHP_WIN32
+#	include "win32/time.h"
+#	include <process.h>
+#else
+#	include <sys/time.h>
+#	include <unistd.h>
+#endif
+
+#if defined(HAVE_PMTA_THREADS) && !defined(PHP_WIN32)
+#	include <pthread.h>
+
+/**
+ * @brief Refreshes the process ID used in Message-IDs in the child of @c fork() (@c pcntl_fork() included)
+ * @note The child has only one thread, the one which called @c fork()
+ */
+static void pmta_atfork_child(void)
+{
+	TSRMLS_FETCH();
+	PMTA_G(msgid_pid) = (zend_uint)getpid();
+}
+
+#	define PMTA_MSGID_PID() PMTA_G(msgid_pid)
+#elif defined(PHP_WIN32)
+/* No fork() on Windows */
+#	define PMTA_MSGID_PID() PMTA_G(msgid_pid)
+#else
+/* No way to learn about fork(): ask every time */
+#	define PMTA_MSGID_PID() ((zend_uint)getpid())
+#endif
+
 PHP_FUNCTION(empty_destructor)
 {
 }
+
+zend_uint pmta_hash(const char* s, size_t len)
+{
+	zend_uint h = 2166136261U;
+	size_t i;
+
+	for (i=0; i<len; ++i) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619U;
+	}
+
+	h ^= h >> 16;
+	h *= 0x85EBCA6BU;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35U;
+	h ^= h >> 16;
+	return h;
+}
+
+pmta_uint64 pmta_digest_update(pmta_uint64 h, const char* s, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; ++i) {
+		h ^= (unsigned char)s[i];
+		h *= (pmta_uint64)0x100000001B3ULL;
+	}
+
+	return h * (pmta_uint64)0x100000001B3ULL;
+}
+
+size_t pmta_date_header(time_t now, const char** hdr TSRMLS_DC)
+{
+	static const char days[7][4]    = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const char months[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+	if ((long int)now != PMTA_G(date_time) || !PMTA_G(date_len)) {
+		struct tm tmbuf;
+		struct tm* tm = php_gmtime_r(&now, &tmbuf);
+
+		if (!tm) {
+			PMTA_G(date_len) = 0;
+			*hdr = "";
+			return 0;
+		}
+
+		PMTA_G(date_len) = (size_t)snprintf(
+			PMTA_G(date_hdr), sizeof(PMTA_G(date_hdr)), "Date: %s, %02d %s %04d %02d:%02d:%02d +0000\r\n",
+			days[tm->tm_wday], tm->tm_mday, months[tm->tm_mon], tm->tm_year + 1900, tm->tm_hour, tm->tm_min, tm->tm_sec
+		);
+
+		PMTA_G(date_time) = (long int)now;
+	}
+
+	*hdr = PMTA_G(date_hdr);
+	return PMTA_G(date_len);
+}
+
+size_t pmta_message_id(time_t now, char* buf, size_t size, const char* domain TSRMLS_DC)
+{
+	/* pcntl_fork() children inherit the counter; the PID is refreshed by pmta_atfork_child() */
+	zend_uint pid = PMTA_MSGID_PID();
+#ifdef ZTS
+	/* Every thread has its own counter */
+	int n = snprintf(
+		buf, size, "<%lx.%x.%lx.%x.%x@%s>",
+		(unsigned long int)now, pid, (unsigned long int)tsrm_thread_id(), ++PMTA_G(msgid_counter), PMTA_G(msgid_seed), domain
+	);
+#else
+	int n = snprintf(
+		buf, size, "<%lx.%x.%x.%x@%s>",
+		(unsigned long int)now, pid, ++PMTA_G(msgid_counter), PMTA_G(msgid_seed), domain
+	);
+#endif
+
+	return (n < 0 || (size_t)n >= size) ? 0 : (size_t)n;
+}
+
+void pmta_common_startup(void)
+{
+#if defined(HAVE_PMTA_THREADS) && !defined(PHP_WIN32)
+	pthread_atfork(NULL, NULL, pmta_atfork_child);
+#endif
+}
+
+double pmta_time_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
@@ -15,6 +15,68 @@
 
 #include "php_pmta.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+/**
+ * @brief Defined if SSE2 intrinsics can be used
+ */
+#	define PMTA_HAVE_SSE2 1
+#	include <emmintrin.h>
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__)
+/**
+ * @brief Defined if SSSE3 intrinsics can be used
+ */
+#	define PMTA_HAVE_SSSE3 1
+#	include <tmmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+/**
+ * @brief Defined if AVX2 intrinsics can be used
+ */
+#	define PMTA_HAVE_AVX2 1
+#	include <immintrin.h>
+#endif
+
+#if !defined(PMTA_HAVE_AVX2) && (defined(__x86_64__) || defined(__i386__))
+#	if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+/**
+ * @brief Defined if SSSE3 and AVX2 code can be built with @c target attributes and selected at run time
+ * @details Distribution builds do not target these instruction sets, so the kernels are compiled anyway
+ * and picked by @c __builtin_cpu_supports()
+ */
+#		define PMTA_HAVE_SIMD_DISPATCH 1
+#	elif defined(__clang__) && defined(__has_builtin)
+#		if __has_builtin(__builtin_cpu_supports)
+#			define PMTA_HAVE_SIMD_DISPATCH 1
+#		endif
+#	endif
+#	ifdef PMTA_HAVE_SIMD_DISPATCH
+#		include <immintrin.h>
+#	endif
+#endif
+
+#ifdef _MSC_VER
+#	include <intrin.h>
+#endif
+
+#if defined(_MSC_VER) && _MSC_VER < 1600
+typedef unsigned __int64 pmta_uint64;
+#else
+#	include <stdint.h>
+/**
+ * @brief Unsigned 64-bit integer
+ */
+typedef uint64_t pmta_uint64;
+#endif
+
+/**
+ * @brief Initial value of the recipient digest
+ * @see pmta_digest_update
+ */
+#define PMTA_DIGEST_INIT ((pmta_uint64)0xCBF29CE484222325ULL)
+
 /**
  * @brief Empty arginfo — for @c __clone(), @c __destruct()
  */
@@ -47,4 +109,83 @@ ZEND_END_ARG_INFO()
  */
 PHPPMTA_VISIBILITY_HIDDEN PHP_FUNCTION(empty_destructor);
 
+/**
+ * @brief Calculates a well-mixed 32-bit hash of the string (FNV-1a with MurmurHash3 finalizer)
+ * @param s String
+ * @param len Length of @a s
+ * @return Hash value
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern zend_uint pmta_hash(const char* s, size_t len);
+
+/**
+ * @brief Updates the rolling digest (64-bit FNV-1a) with the string
+ * @param h Current digest (@c PMTA_DIGEST_INIT initially)
+ * @param s String
+ * @param len Length of @a s
+ * @return New digest
+ * @note The string is followed by a @c NUL byte so that <tt>("ab", "c")</tt> and <tt>("a", "bc")</tt> give different digests
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern pmta_uint64 pmta_digest_update(pmta_uint64 h, const char* s, size_t len);
+
+/**
+ * @brief Registers the @c pthread_atfork() handler which keeps the process ID used in Message-IDs up to date
+ * @details Called from @c MINIT
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_common_startup(void);
+
+/**
+ * @brief Returns the current time
+ * @return Milliseconds since the Epoch
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern double pmta_time_ms(void);
+
+/**
+ * @brief Returns the @c Date header for the current second
+ * @param now Current time
+ * @param hdr Header with the trailing CRLF (output); valid until the next call
+ * @param tsrm_ls Internally used by Zend
+ * @return Length of @a hdr; 0 if @a now cannot be represented as a calendar date
+ * @details The header is formatted once per second and cached in the module globals
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern size_t pmta_date_header(time_t now, const char** hdr TSRMLS_DC);
+
+/**
+ * @brief Generates a Message-ID
+ * @param now Current time
+ * @param buf Output buffer
+ * @param size Size of @a buf
+ * @param domain Domain part
+ * @param tsrm_ls Internally used by Zend
+ * @return Length of the Message-ID (with angle brackets) written to @a buf
+ * @details The ID is made of the time, the process ID (the thread ID too in ZTS builds), a counter and the host seed.
+ * The process ID is cached in the module globals and refreshed in forked children by a @c pthread_atfork() handler,
+ * so IDs stay unique in processes forked in the middle of a request without a system call per ID
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern size_t pmta_message_id(time_t now, char* buf, size_t size, const char* domain TSRMLS_DC);
+
+/**
+ * @brief Returns the number of trailing zero bits
+ * @param x Value
+ * @return Index of the least significant set bit of @a x
+ * @pre <tt>x != 0</tt>
+ */
+static zend_always_inline int pmta_ctz(unsigned int x)
+{
+#if defined(__GNUC__)
+	return __builtin_ctz(x);
+#elif defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward(&idx, x);
+	return (int)idx;
+#else
+	int n = 0;
+	while (!(x & 1)) {
+		x >>= 1;
+		++n;
+	}
+
+	return n;
+#endif
+}
+
 #endif /* PMTA_COMMON_H */
@@ -11,6 +11,8 @@ class PmtaConnection
 {
 	const LOCAL_SERVER = "127.0.0.1";
 	const DEFAULT_PORT = 25;
+	const PERSISTENT   = 1;
+	const LAZY         = 2;
 
 	private $connection;
 
@@ -18,9 +20,33 @@ class PmtaConnection
 	private $port;
 	private $username;
 	private $password;
+	private $persistent;
+	private $worker;
 
-	public function __construct($server = '127.0.0.1', $port = 25, $username = null, $password = null)
+	public function __construct($server = '127.0.0.1', $port = 25, $username = null, $password = null, $flags = null)
 	{
+		if (null === $flags) {
+			$flags = (ini_get('pmta.persistent') ? self::PERSISTENT : 0) | (ini_get('pmta.lazy_connect') ? self::LAZY : 0);
+		}
+
+		$this->persistent = (bool)($flags & self::PERSISTENT);
+		if ($flags & self::LAZY) {
+			// Connection is established by submitMessage()
+			$this->server   = $server;
+			$this->port     = $port;
+			$this->username = $username;
+			$this->password = $password;
+			return;
+		}
+
+		if ($this->persistent && ($this->connection = pmta_pconn_acquire($server, $port, $username, $password))) {
+			$this->server   = $server;
+			$this->port     = $port;
+			$this->username = $username;
+			$this->password = $password;
+			return;
+		}
+
 		$this->connection = PmtaConnAlloc();
 
 		if ($username && $password) {
@@ -42,7 +68,16 @@ class PmtaConnection
 
 	public function __destruct()
 	{
-		PmtaConnFree($this->connection);
+		if ($this->worker) {
+			pmta_worker_stop($this->worker); // waits for the queued messages
+		}
+
+		if ($this->persistent) {
+			pmta_pconn_release($this->connection);
+		}
+		else {
+			PmtaConnFree($this->connection);
+		}
 	}
 
 	public function getLastError()
@@ -52,12 +87,42 @@ class PmtaConnection
 
 	public function submitMessage(PmtaMessage $message)
 	{
+		if (!$this->connection) {
+			$this->connect(); // throws PmtaErrorConnection
+		}
+
 		return PmtaConnSubmit($this->connection, $message);
 	}
 
+	public function submitMessages($messages) // array or Traversable
+	{
+		$result = array();
+		foreach ($messages as $key => $message) {
+			try {
+				$result[$key] = $this->submitMessage($message) ?: array('code' => ..., 'message' => ...);
+			}
+			catch (PmtaError $e) {
+				$result[$key] = array('code' => $e->getCode(), 'message' => $e->getMessage());
+			}
+		}
+
+		return $result;
+	}
+
+	public function submitAsync(PmtaMessage $message)
+	{
+		if (!$this->worker) {
+			// Background thread with its own connection to $this->server
+			$this->worker = pmta_worker_start($this->server, $this->port, $this->username, $this->password);
+		}
+
+		// $message cannot be modified until the future completes
+		return pmta_worker_submit($this->worker, $message); // PmtaSubmitFuture
+	}
+
 	public function __get($property)
 	{
-		static $properties = array('server', 'port', 'username', 'password');
+		static $properties = array('server', 'port', 'username', 'password', 'persistent');
 		if (isset($properties[$property])) {
 			return $properties[$property];
 		}
@@ -67,7 +132,7 @@ class PmtaConnection
 
 	public function __isset($property)
 	{
-		static $properties = array('server', 'port', 'username', 'password');
+		static $properties = array('server', 'port', 'username', 'password', 'persistent');
 		return array_key_exists($properties, $property);
 	}
 
@@ -80,23 +145,50 @@ class PmtaConnection
 #include "pmta_error.h"
 #include "pmta_message.h"
 #include "pmta_common.h"
+#include "pmta_async.h"
 #include <submitter/PmtaConn.h>
+#include <PmtaApi.h>
+#include <time.h>
+#include <zend_interfaces.h>
 
 /**
  * @brief @c PmtaConnection object handlers
  */
 static zend_object_handlers pmtaconn_object_handlers;
 
+/**
+ * @brief Resource type of persistent connections
+ */
+static int le_pmta_pconn;
+
+/**
+ * @brief Persistent connection, lives in @c EG(persistent_list) between requests
+ */
+struct _pmta_pconn {
+	PmtaConn conn;     /**< PMTA Connection handle */
+	char* password;    /**< Password the connection was authenticated with */
+	time_t created;    /**< When the connection was established */
+	time_t last_used;  /**< When the connection was released last time */
+	zend_bool in_use;  /**< Whether the connection is borrowed by a @c PmtaConnection instance */
+	zend_bool broken;  /**< Whether an I/O error was seen on the connection */
+};
+
 /**
  * @brief Internal properties of @c PmtaConnection
  */
 typedef struct _pmtaconn_object {
-	zend_object obj; /**< Zend object data */
-	PmtaConn conn;   /**< PMTA Connection handle */
-	char* server;    /**< PowerMTA server */
-	char* username;  /**< Username to authenticate with */
-	char* password;  /**< Password to authenticate with */
-	int port;        /**< Server port */
+	zend_object obj;      /**< Zend object data */
+	PmtaConn conn;        /**< PMTA Connection handle */
+	pmta_pconn* pconn;    /**< Persistent connection @c conn is borrowed from; @c NULL if @c conn is owned by the object */
+	char* server;         /**< PowerMTA server */
+	char* username;       /**< Username to authenticate with */
+	char* password;       /**< Password to authenticate with */
+	int port;             /**< Server port */
+	int flags;            /**< Connection flags (@c PMTACONN_PERSISTENT, @c PMTACONN_LAZY) */
+	zend_bool reused;     /**< Whether @c conn is an idle persistent connection which has not been used in this request yet */
+	pmta_worker* worker;  /**< Background submission worker, started by the first @c submitAsync() */
+	char* error;          /**< Message of the last connection or submission error, @c NULL if none */
+	int error_code;       /**< Code of the last connection or submission error */
 } pmtaconn_object;
 
 /**
@@ -111,6 +203,249 @@ static inline pmtaconn_object* fetchPmtaConnObject(zval* zobj TSRMLS_DC)
 	return (pmtaconn_object*)zend_objects_get_address(zobj TSRMLS_CC);
 }
 
+/**
+ * @brief Remembers the last error so that @c getLastError() can report it after the handle is gone
+ * @param obj @c pmtaconn_object
+ * @param code Error code
+ * @param message Error message
+ */
+static void pmtaconn_set_error(pmtaconn_object* obj, int code, const char* message)
+{
+	if (obj->error) {
+		efree(obj->error);
+	}
+
+	obj->error      = estrdup(message ? message : "");
+	obj->error_code = code;
+}
+
+/**
+ * @brief Persistent connection destructor
+ * @param rsrc Resource list entry
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtaconn_pconn_dtor(zend_rsrc_list_entry* rsrc TSRMLS_DC)
+{
+	pmta_pconn* pconn = (pmta_pconn*)rsrc->ptr;
+
+	if (pconn->conn)     { PmtaConnFree(pconn->conn);  }
+	if (pconn->password) { pefree(pconn->password, 1); }
+	pefree(pconn, 1);
+}
+
+/**
+ * @brief Checks whether an idle persistent connection may be reused
+ * @param pconn Persistent connection
+ * @param password Password the caller wants to authenticate with
+ * @param now Current time
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether @a pconn may be reused
+ * @retval 1 Yes
+ * @retval 0 No
+ */
+static int pmtaconn_pconn_usable(const pmta_pconn* pconn, const char* password, time_t now TSRMLS_DC)
+{
+	long int max_idle = PMTA_G(pconn_max_idle);
+	long int max_life = PMTA_G(pconn_max_life);
+
+	if (pconn->broken || !pconn->conn) {
+		return 0;
+	}
+
+	if (max_idle > 0 && now - pconn->last_used > max_idle) {
+		return 0;
+	}
+
+	if (max_life > 0 && now - pconn->created > max_life) {
+		return 0;
+	}
+
+	if (!password || !pconn->password) {
+		return (!password && !pconn->password);
+	}
+
+	return !strcmp(password, pconn->password);
+}
+
+int pmtaconn_open(PmtaConn* conn, pmta_pconn** pconn, zend_bool* reused, const char* server, long int port, const char* username, const char* password, zend_bool persistent TSRMLS_DC)
+{
+	char* key   = NULL;
+	int key_len = 0;
+	time_t now  = time(NULL);
+	BOOL result;
+
+	*conn   = NULL;
+	*pconn  = NULL;
+	*reused = 0;
+
+	if (persistent) {
+		zend_rsrc_list_entry* le;
+
+		key_len = spprintf(&key, 0, "pmta_conn:%s:%ld:%s", server, port, username ? username : "");
+		if (SUCCESS == zend_hash_find(&EG(persistent_list), key, key_len + 1, (void**)&le) && le->type == le_pmta_pconn) {
+			pmta_pconn* p = (pmta_pconn*)le->ptr;
+
+			if (p->in_use) {
+				persistent = 0;
+			}
+			else if (pmtaconn_pconn_usable(p, password, now TSRMLS_CC)) {
+				p->in_use = 1;
+				*conn     = p->conn;
+				*pconn    = p;
+				*reused   = 1;
+				efree(key);
+				return SUCCESS;
+			}
+			else {
+				zend_hash_del(&EG(persistent_list), key, key_len + 1);
+			}
+		}
+	}
+
+	*conn = PmtaConnAlloc();
+	if (!*conn) {
+		if (key) { efree(key); }
+		return FAILURE;
+	}
+
+	if (username && password) {
+		result = PmtaConnConnectRemoteAuth(*conn, (char*)server, port, (char*)username, (char*)password);
+	}
+	else {
+		result = PmtaConnConnectRemote(*conn, (char*)server, port);
+	}
+
+	if (FALSE == result) {
+		if (key) { efree(key); }
+		return FAILURE;
+	}
+
+	if (persistent) {
+		zend_rsrc_list_entry le;
+		pmta_pconn* p = pemalloc(sizeof(pmta_pconn), 1);
+
+		p->conn      = *conn;
+		p->password  = password ? pestrdup(password, 1) : NULL;
+		p->created   = now;
+		p->last_used = now;
+		p->in_use    = 1;
+		p->broken    = 0;
+
+		le.ptr      = p;
+		le.type     = le_pmta_pconn;
+		le.refcount = 1;
+
+		if (SUCCESS == zend_hash_update(&EG(persistent_list), key, key_len + 1, (void*)&le, sizeof(zend_rsrc_list_entry), NULL)) {
+			*pconn = p;
+		}
+		else {
+			if (p->password) { pefree(p->password, 1); }
+			pefree(p, 1);
+		}
+	}
+
+	if (key) { efree(key); }
+	return SUCCESS;
+}
+
+void pmtaconn_close(PmtaConn conn, pmta_pconn* pconn, zend_bool broken TSRMLS_DC)
+{
+	if (!pconn) {
+		if (conn) {
+			PmtaConnFree(conn);
+		}
+
+		return;
+	}
+
+	pconn->in_use    = 0;
+	pconn->last_used = time(NULL);
+	if (broken) {
+		pconn->broken = 1;
+	}
+}
+
+/**
+ * @brief Establishes the connection deferred by @c PmtaConnection::LAZY
+ * @param obj @c pmtaconn_object
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the object is connected
+ * @retval SUCCESS Yes
+ * @retval FAILURE No, @c PmtaErrorConnection has been thrown
+ */
+static int pmtaconn_ensure_connected(pmtaconn_object* obj TSRMLS_DC)
+{
+	if (obj->conn) {
+		return SUCCESS;
+	}
+
+	if (SUCCESS == pmtaconn_open(&obj->conn, &obj->pconn, &obj->reused, obj->server, obj->port, obj->username, obj->password, (obj->flags & PMTACONN_PERSISTENT) ? 1 : 0 TSRMLS_CC)) {
+		return SUCCESS;
+	}
+
+	if (!obj->conn) {
+		pmtaconn_set_error(obj, PmtaApiERROR_PHP_API, "PmtaConnAlloc() failed");
+	}
+	else {
+		pmtaconn_set_error(obj, PmtaConnGetLastErrorType(obj->conn), PmtaConnGetLastError(obj->conn));
+		PmtaConnFree(obj->conn);
+		obj->conn = NULL;
+	}
+
+	throw_pmta_error(pmta_error_connection_class, obj->error_code, obj->error, NULL TSRMLS_CC);
+	return FAILURE;
+}
+
+BOOL pmtaconn_submit(PmtaConn* conn, pmta_pconn** pconn, zend_bool* reused, const char* server, long int port, const char* username, const char* password, PmtaMsg msg, int* code, char** error TSRMLS_DC)
+{
+	zend_bool retry = *reused;
+	BOOL res;
+
+	*reused = 0;
+	*error  = NULL;
+	res     = PmtaConnSubmit(*conn, msg);
+	if (TRUE == res) {
+		return res;
+	}
+
+	*code = PmtaConnGetLastErrorType(*conn);
+	if (!*pconn || PmtaApiERROR_IO != *code) {
+		*error = estrdup(PmtaConnGetLastError(*conn));
+		return res;
+	}
+
+	if (!retry) {
+		(*pconn)->broken = 1;
+		*error = estrdup(PmtaConnGetLastError(*conn));
+		return res;
+	}
+
+	pmtaconn_close(*conn, *pconn, 1 TSRMLS_CC);
+	if (FAILURE == pmtaconn_open(conn, pconn, reused, server, port, username, password, 1 TSRMLS_CC)) {
+		if (!*conn) {
+			*code  = PmtaApiERROR_PHP_API;
+			*error = estrdup("PmtaConnAlloc() failed");
+		}
+		else {
+			*code  = PmtaConnGetLastErrorType(*conn);
+			*error = estrdup(PmtaConnGetLastError(*conn));
+			PmtaConnFree(*conn);
+			*conn = NULL;
+		}
+
+		return FALSE;
+	}
+
+	*reused = 0;
+	res     = PmtaConnSubmit(*conn, msg);
+	if (FALSE == res) {
+		*code  = PmtaConnGetLastErrorType(*conn);
+		*error = estrdup(PmtaConnGetLastError(*conn));
+	}
+
+	return res;
+}
+
 /**
  * @brief Internal implementation of @c __get() method
  * @see pmtaconn_object
@@ -139,6 +474,9 @@ static zval* pmtaconn_read_property_internal(pmtaconn_object* obj, zval* member,
 	else if (ISSTR(member, "port")) {
 		ZVAL_LONG(ret, obj->port);
 	}
+	else if (ISSTR(member, "persistent")) {
+		ZVAL_BOOL(ret, (obj->flags & PMTACONN_PERSISTENT) ? 1 : 0);
+	}
 	else {
 		if (type != BP_VAR_IS) {
 			zend_error(E_WARNING, "Undefined property PmtaConnection::%s", Z_STRVAL_P(member));
@@ -231,6 +569,11 @@ static int pmtaconn_has_property_internal(pmtaconn_object* obj, zval* member, in
 			retval = (obj->port > 0);
 		}
 	}
+	else if (ISSTR(member, "persistent")) {
+		if (1 == has_set_exists) {
+			retval = ((obj->flags & PMTACONN_PERSISTENT) != 0);
+		}
+	}
 	else {
 		retval = 0;
 	}
@@ -314,6 +657,10 @@ static HashTable* pmtaconn_get_properties(zval* object TSRMLS_DC)
 	ZVAL_LONG(zv, obj->port);
 	zend_hash_update(props, "port", sizeof("port"), &zv, sizeof(zval*), NULL);
 
+	MAKE_STD_ZVAL(zv);
+	ZVAL_BOOL(zv, (obj->flags & PMTACONN_PERSISTENT) ? 1 : 0);
+	zend_hash_update(props, "persistent", sizeof("persistent"), &zv, sizeof(zval*), NULL);
+
 	return props;
 }
 
@@ -327,10 +674,12 @@ static void pmtaconn_dtor(void* v TSRMLS_DC)
 {
 	pmtaconn_object* obj = v;
 
-	if (obj->server)   { efree(obj->server);      }
-	if (obj->username) { efree(obj->username);    }
-	if (obj->password) { efree(obj->password);    }
-	if (obj->conn)     { PmtaConnFree(obj->conn); }
+	if (obj->worker)   { pmta_worker_stop(obj->worker); }
+	if (obj->server)   { efree(obj->server);   }
+	if (obj->username) { efree(obj->username); }
+	if (obj->password) { efree(obj->password); }
+	if (obj->error)    { efree(obj->error);    }
+	if (obj->conn)     { pmtaconn_close(obj->conn, obj->pconn, 0 TSRMLS_CC); }
 
 	zend_object_std_dtor(&(obj->obj) TSRMLS_CC);
 	efree(obj);
@@ -366,7 +715,7 @@ static zend_object_value pmtaconn_ctor(zend_class_entry* ce TSRMLS_DC)
 }
 
 /**
- * @brief public function __construct($server = '127.0.0.1', $port = 25, $username = null, $password = null);
+ * @brief public function __construct($server = '127.0.0.1', $port = 25, $username = null, $password = null, $flags = null);
  * @param ht Internally used by Zend (number of arguments)
  * @param return_value Internally used by Zend (return value)
  * @param return_value_ptr Internally used by Zend
@@ -375,7 +724,13 @@ static zend_object_value pmtaconn_ctor(zend_class_entry* ce TSRMLS_DC)
  * @param tsrm_ls Internally used by Zend
  * @throw pmta_error_connection_class
  *
- * Class constructor. Allocates a PmtaConn object and connects to the server. Throws PmtaErrorConnection on failure
+ * Class constructor. Allocates a PmtaConn object and connects to the server. Throws PmtaErrorConnection on failure.
+ * If @c $flags contains @c PmtaConnection::PERSISTENT (or @c $flags is @c null and @c pmta.persistent is on),
+ * an idle persistent connection to the same server, port and username is reused when possible. If the first submission
+ * over a reused connection fails with an I/O error, it is retried once over a new connection; should the server have
+ * accepted the message before the connection broke, the message is delivered twice.
+ * If @c $flags contains @c PmtaConnection::LAZY (or @c $flags is @c null and @c pmta.lazy_connect is on),
+ * the constructor only records the connection parameters; the connection is established by the first @c submitMessage().
  */
 static PHP_METHOD(PmtaConnection, __construct)
 {
@@ -386,21 +741,30 @@ static PHP_METHOD(PmtaConnection, __construct)
 	int username_len;
 	char* password   = NULL;
 	int password_len;
-	BOOL result;
+	zval* zflags     = NULL;
+	long int flags;
 	pmtaconn_object* obj;
 
-	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|slss", &server, &server_len, &port, &username, &username_len, &password, &password_len)) {
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|slssz", &server, &server_len, &port, &username, &username_len, &password, &password_len, &zflags)) {
 		RETURN_NULL();
 	}
 
-	obj = fetchPmtaConnObject(getThis() TSRMLS_CC);
-
-	obj->conn = PmtaConnAlloc();
-	if (!obj->conn) {
-		throw_pmta_error(pmta_error_connection_class, PmtaApiERROR_PHP_API, "PmtaConnAlloc() failed", NULL TSRMLS_CC);
-		RETURN_NULL();
+	if (!zflags || Z_TYPE_P(zflags) == IS_NULL) {
+		flags = (PMTA_G(persistent) ? PMTACONN_PERSISTENT : 0) | (PMTA_G(lazy_connect) ? PMTACONN_LAZY : 0);
+	}
+	else if (Z_TYPE_P(zflags) == IS_LONG) {
+		flags = Z_LVAL_P(zflags);
+	}
+	else {
+		zval lval;
+		ZVAL_ZVAL(&lval, zflags, 1, 0);
+		convert_to_long(&lval);
+		flags = Z_LVAL(lval);
+		zval_dtor(&lval);
 	}
 
+	obj = fetchPmtaConnObject(getThis() TSRMLS_CC);
+
 	if (!server) {
 		server = PMTA_G(server);
 		if (!server || !*server) {
@@ -429,23 +793,40 @@ static PHP_METHOD(PmtaConnection, __construct)
 		}
 	}
 
-	if (username && password) {
-		result = PmtaConnConnectRemoteAuth(obj->conn, server, port, username, password);
-	}
-	else {
-		result = PmtaConnConnectRemote(obj->conn, server, port);
+	if (!username || !password) {
+		username = NULL;
+		password = NULL;
 	}
 
-	if (FALSE == result) {
-		throw_pmta_error(pmta_error_connection_class, PmtaConnGetLastErrorType(obj->conn), PmtaConnGetLastError(obj->conn), NULL TSRMLS_CC);
-	}
-	else {
+	obj->flags = flags;
+
+	if (flags & PMTACONN_LAZY) {
 		obj->server = estrdup(server);
 		obj->port   = port;
 		if (username && password) {
 			obj->username = estrdup(username);
 			obj->password = estrdup(password);
 		}
+
+		return;
+	}
+
+	if (FAILURE == pmtaconn_open(&obj->conn, &obj->pconn, &obj->reused, server, port, username, password, (flags & PMTACONN_PERSISTENT) ? 1 : 0 TSRMLS_CC)) {
+		if (!obj->conn) {
+			throw_pmta_error(pmta_error_connection_class, PmtaApiERROR_PHP_API, "PmtaConnAlloc() failed", NULL TSRMLS_CC);
+		}
+		else {
+			throw_pmta_error(pmta_error_connection_class, PmtaConnGetLastErrorType(obj->conn), PmtaConnGetLastError(obj->conn), NULL TSRMLS_CC);
+		}
+
+		RETURN_NULL();
+	}
+
+	obj->server = estrdup(server);
+	obj->port   = port;
+	if (username && password) {
+		obj->username = estrdup(username);
+		obj->password = estrdup(password);
 	}
 }
 
@@ -513,7 +894,8 @@ static PHP_METHOD(PmtaConnection, __isset)
  * @param return_value_used Internally used by Zend (whether the return value is used)
  * @param tsrm_ls Internally used by Zend
  *
- * Submits the message to PowerMTA
+ * Submits the message to PowerMTA. Connects first if the connection was deferred with @c PmtaConnection::LAZY;
+ * connection failures are always reported with @c PmtaErrorConnection
  */
 static PHP_METHOD(PmtaConnection, submitMessage)
 {
@@ -521,27 +903,357 @@ static PHP_METHOD(PmtaConnection, submitMessage)
 	PmtaMsg msg;
 	zval* message;
 	BOOL res;
+	int code;
+	const char* error;
+	char* conn_error;
 	zend_bool exceptions = PMTA_G(use_exceptions);
 
 	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &message, pmta_msg_class)) {
 		RETURN_NULL();
 	}
 
-	obj = fetchPmtaConnObject(getThis() TSRMLS_CC);
+	if (is_message_locked(message TSRMLS_CC)) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_PHP_API, "The message is being submitted in the background", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
 	msg = getMessage(message TSRMLS_CC);
-	res = PmtaConnSubmit(obj->conn, msg);
+	if (FAILURE == flush_message(message, &code, &error TSRMLS_CC)) {
+		throw_pmta_error(pmta_error_message_class, code, error, NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaConnObject(getThis() TSRMLS_CC);
+	if (FAILURE == pmtaconn_ensure_connected(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	res = pmtaconn_submit(&obj->conn, &obj->pconn, &obj->reused, obj->server, obj->port, obj->username, obj->password, msg, &code, &conn_error TSRMLS_CC);
 	if (TRUE == res) {
 		RETURN_TRUE;
 	}
 
+	pmtaconn_set_error(obj, code, conn_error);
+	efree(conn_error);
 	if (exceptions) {
-		throw_pmta_error(pmta_error_connection_class, PmtaConnGetLastErrorType(obj->conn), PmtaConnGetLastError(obj->conn), NULL TSRMLS_CC);
+		throw_pmta_error(pmta_error_connection_class, obj->error_code, obj->error, NULL TSRMLS_CC);
 		RETURN_NULL();
 	}
 
 	RETURN_FALSE;
 }
 
+/**
+ * @brief Stores one entry of @c submitMessages() result
+ * @param result Result array
+ * @param key Key of the message in @c $messages; keys other than integers and strings are replaced with the next index
+ * @param code Error code (ignored if @a error is @c NULL)
+ * @param error Error message, @c NULL if the message has been submitted
+ */
+static void pmtaconn_batch_result(zval* result, zval* key, int code, const char* error)
+{
+	zval* value;
+
+	MAKE_STD_ZVAL(value);
+	if (!error) {
+		ZVAL_TRUE(value);
+	}
+	else {
+		array_init_size(value, 2);
+		add_assoc_long_ex(value,   ZEND_STRS("code"),    code);
+		add_assoc_string_ex(value, ZEND_STRS("message"), (char*)error, 1);
+	}
+
+	if (Z_TYPE_P(key) == IS_STRING) {
+		add_assoc_zval_ex(result, Z_STRVAL_P(key), Z_STRLEN_P(key) + 1, value);
+	}
+	else if (Z_TYPE_P(key) == IS_LONG) {
+		add_index_zval(result, Z_LVAL_P(key), value);
+	}
+	else {
+		add_next_index_zval(result, value);
+	}
+}
+
+/**
+ * @brief Submits one message of the @c submitMessages() batch
+ * @param obj @c pmtaconn_object
+ * @param message Element of @c $messages
+ * @param key Key of @a message
+ * @param result Result array
+ * @param conn_error Connection error which fails the rest of the batch (input/output, @c emalloc'ed)
+ * @param conn_code Code of @a conn_error (input/output)
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtaconn_batch_submit(pmtaconn_object* obj, zval* message, zval* key, zval* result, char** conn_error, int* conn_code TSRMLS_DC)
+{
+	BOOL res;
+	int code;
+	const char* error;
+	char* submit_error;
+
+	if (Z_TYPE_P(message) != IS_OBJECT || !instanceof_function(Z_OBJCE_P(message), pmta_msg_class TSRMLS_CC)) {
+		pmtaconn_batch_result(result, key, PmtaApiERROR_IllegalArgument, "Not a PmtaMessage");
+		return;
+	}
+
+	if (is_message_locked(message TSRMLS_CC)) {
+		pmtaconn_batch_result(result, key, PmtaApiERROR_PHP_API, "The message is being submitted in the background");
+		return;
+	}
+
+	if (FAILURE == flush_message(message, &code, &error TSRMLS_CC)) {
+		pmtaconn_batch_result(result, key, code, error);
+		return;
+	}
+
+	if (*conn_error) {
+		pmtaconn_batch_result(result, key, *conn_code, *conn_error);
+		return;
+	}
+
+	if (!obj->conn && FAILURE == pmtaconn_open(&obj->conn, &obj->pconn, &obj->reused, obj->server, obj->port, obj->username, obj->password, (obj->flags & PMTACONN_PERSISTENT) ? 1 : 0 TSRMLS_CC)) {
+		if (!obj->conn) {
+			*conn_code  = PmtaApiERROR_PHP_API;
+			*conn_error = estrdup("PmtaConnAlloc() failed");
+		}
+		else {
+			*conn_code  = PmtaConnGetLastErrorType(obj->conn);
+			*conn_error = estrdup(PmtaConnGetLastError(obj->conn));
+			PmtaConnFree(obj->conn);
+			obj->conn = NULL;
+		}
+
+		pmtaconn_set_error(obj, *conn_code, *conn_error);
+		pmtaconn_batch_result(result, key, *conn_code, *conn_error);
+		return;
+	}
+
+	res = pmtaconn_submit(&obj->conn, &obj->pconn, &obj->reused, obj->server, obj->port, obj->username, obj->password, getMessage(message TSRMLS_CC), &code, &submit_error TSRMLS_CC);
+	if (TRUE == res) {
+		pmtaconn_batch_result(result, key, 0, NULL);
+		return;
+	}
+
+	pmtaconn_set_error(obj, code, submit_error);
+	pmtaconn_batch_result(result, key, code, submit_error);
+	efree(submit_error);
+	if (PmtaApiERROR_IO == code && obj->conn) {
+		/* The connection is unusable; reconnect before the next message */
+		pmtaconn_close(obj->conn, obj->pconn, 1 TSRMLS_CC);
+		obj->conn  = NULL;
+		obj->pconn = NULL;
+	}
+}
+
+/**
+ * @brief Fetches the key of the current element of the iterator
+ * @param it Iterator
+ * @param index Number of the current element (used if the iterator has no keys)
+ * @param key Key (output, must be destroyed with @c zval_dtor())
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtaconn_iterator_key(zend_object_iterator* it, long int index, zval* key TSRMLS_DC)
+{
+	if (!it->funcs->get_current_key) {
+		ZVAL_LONG(key, index);
+		return;
+	}
+
+#if PHP_VERSION_ID >= 50500
+	it->funcs->get_current_key(it, key TSRMLS_CC);
+#else
+	{
+		char* str_key;
+		uint str_key_len;
+		ulong int_key;
+
+		switch (it->funcs->get_current_key(it, &str_key, &str_key_len, &int_key TSRMLS_CC)) {
+			case HASH_KEY_IS_STRING:
+				ZVAL_STRINGL(key, str_key, str_key_len - 1, 0);
+				break;
+
+			case HASH_KEY_IS_LONG:
+				ZVAL_LONG(key, (long int)int_key);
+				break;
+
+			default:
+				ZVAL_NULL(key);
+				break;
+		}
+	}
+#endif
+}
+
+/**
+ * @brief public function submitMessages($messages);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * @c $messages is an array or a @c Traversable. Submits all messages and returns an array with the same keys as
+ * @c $messages. Every value is either @c true or <tt>array('code' => ..., 'message' => ...)</tt>.
+ * Never throws: a failed message does not abort the batch (exceptions thrown by a user iterator stop it).
+ * The connection is re-established once after an I/O error; if that fails, the rest of the batch gets the connection error.
+ */
+static PHP_METHOD(PmtaConnection, submitMessages)
+{
+	pmtaconn_object* obj;
+	zval* messages;
+	zval key;
+	char* conn_error = NULL;
+	int conn_code    = 0;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &messages)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaConnObject(getThis() TSRMLS_CC);
+
+	if (Z_TYPE_P(messages) == IS_ARRAY) {
+		HashTable* ht = Z_ARRVAL_P(messages);
+		HashPosition pos;
+		zval** entry;
+
+		array_init_size(return_value, zend_hash_num_elements(ht));
+		for (
+			zend_hash_internal_pointer_reset_ex(ht, &pos);
+			zend_hash_get_current_data_ex(ht, (void**)&entry, &pos) == SUCCESS;
+			zend_hash_move_forward_ex(ht, &pos)
+		) {
+			char* str_key;
+			uint str_key_len;
+			ulong int_key;
+
+			if (HASH_KEY_IS_STRING == zend_hash_get_current_key_ex(ht, &str_key, &str_key_len, &int_key, 0, &pos)) {
+				ZVAL_STRINGL(&key, str_key, str_key_len - 1, 0);
+			}
+			else {
+				ZVAL_LONG(&key, (long int)int_key);
+			}
+
+			pmtaconn_batch_submit(obj, *entry, &key, return_value, &conn_error, &conn_code TSRMLS_CC);
+		}
+	}
+	else if (Z_TYPE_P(messages) == IS_OBJECT && instanceof_function(Z_OBJCE_P(messages), zend_ce_traversable TSRMLS_CC)) {
+		zend_class_entry* ce = Z_OBJCE_P(messages);
+		zend_object_iterator* it;
+		long int index = 0;
+
+		array_init(return_value);
+		it = ce->get_iterator(ce, messages, 0 TSRMLS_CC);
+		if (!it || EG(exception)) {
+			if (it) {
+				it->funcs->dtor(it TSRMLS_CC);
+			}
+
+			return;
+		}
+
+		if (it->funcs->rewind) {
+			it->funcs->rewind(it TSRMLS_CC);
+		}
+
+		while (!EG(exception) && SUCCESS == it->funcs->valid(it TSRMLS_CC)) {
+			zval** entry = NULL;
+
+			it->funcs->get_current_data(it, &entry TSRMLS_CC);
+			if (EG(exception) || !entry) {
+				break;
+			}
+
+			pmtaconn_iterator_key(it, index++, &key TSRMLS_CC);
+			if (EG(exception)) {
+				zval_dtor(&key);
+				break;
+			}
+
+			pmtaconn_batch_submit(obj, *entry, &key, return_value, &conn_error, &conn_code TSRMLS_CC);
+			zval_dtor(&key);
+
+			it->funcs->move_forward(it TSRMLS_CC);
+		}
+
+		it->funcs->dtor(it TSRMLS_CC);
+	}
+	else {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "expects parameter 1 to be array or Traversable, %s given", zend_zval_type_name(messages));
+		RETURN_NULL();
+	}
+
+	if (conn_error) {
+		efree(conn_error);
+	}
+}
+
+/**
+ * @brief public function submitAsync(PmtaMessage $message);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_connection_class
+ * @throw pmta_error_message_class
+ *
+ * Queues the message for submission by the background worker and returns @c PmtaSubmitFuture.
+ * The message cannot be modified until the future completes.
+ * If threads are not available, the message is submitted synchronously and the returned future is already complete.
+ */
+static PHP_METHOD(PmtaConnection, submitAsync)
+{
+	pmtaconn_object* obj;
+	PmtaMsg msg;
+	zval* message;
+	BOOL res;
+	int code;
+	const char* error;
+	char* conn_error;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &message, pmta_msg_class)) {
+		RETURN_NULL();
+	}
+
+	if (is_message_locked(message TSRMLS_CC)) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_PHP_API, "The message is being submitted in the background", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	msg = getMessage(message TSRMLS_CC);
+	if (FAILURE == flush_message(message, &code, &error TSRMLS_CC)) {
+		throw_pmta_error(pmta_error_message_class, code, error, NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaConnObject(getThis() TSRMLS_CC);
+	if (!obj->worker) {
+		obj->worker = pmta_worker_start(obj->server, obj->port, obj->username, obj->password);
+	}
+
+	if (obj->worker) {
+		pmta_worker_submit(obj->worker, message, msg, return_value TSRMLS_CC);
+		return;
+	}
+
+	if (FAILURE == pmtaconn_ensure_connected(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	res = pmtaconn_submit(&obj->conn, &obj->pconn, &obj->reused, obj->server, obj->port, obj->username, obj->password, msg, &code, &conn_error TSRMLS_CC);
+	if (TRUE == res) {
+		pmta_future_completed(return_value, TRUE, 0, NULL TSRMLS_CC);
+	}
+	else {
+		pmtaconn_set_error(obj, code, conn_error);
+		pmta_future_completed(return_value, FALSE, code, conn_error TSRMLS_CC);
+		efree(conn_error);
+	}
+}
+
 /**
  * @brief public function getLastError();
  * @param ht Internally used by Zend (number of arguments)
@@ -551,7 +1263,8 @@ static PHP_METHOD(PmtaConnection, submitMessage)
  * @param return_value_used Internally used by Zend (whether the return value is used)
  * @param tsrm_ls Internally used by Zend
  *
- * Returns the last connection error
+ * Returns the last connection error. Errors of failed (lazy) connection attempts and submissions are remembered
+ * even if the connection handle has been dropped since.
  */
 static PHP_METHOD(PmtaConnection, getLastError)
 {
@@ -561,6 +1274,16 @@ static PHP_METHOD(PmtaConnection, getLastError)
 
 	if (return_value_used) {
 		pmtaconn_object* obj = fetchPmtaConnObject(getThis() TSRMLS_CC);
+		if (obj->error) {
+			throw_pmta_error(pmta_error_connection_class, obj->error_code, obj->error, &return_value TSRMLS_CC);
+			return;
+		}
+
+		if (!obj->conn) {
+			throw_pmta_error(pmta_error_connection_class, PmtaApiERROR_PHP_API, "Not connected", &return_value TSRMLS_CC);
+			return;
+		}
+
 		throw_pmta_error(pmta_error_connection_class, PmtaConnGetLastErrorType(obj->conn), PmtaConnGetLastError(obj->conn), &return_value TSRMLS_CC);
 	}
 }
@@ -573,6 +1296,7 @@ PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_construct, 0, 0, 0)
 	ZEND_ARG_INFO(0, port)
 	ZEND_ARG_INFO(0, username)
 	ZEND_ARG_INFO(0, password)
+	ZEND_ARG_INFO(0, flags)
 ZEND_END_ARG_INFO()
 
 /**
@@ -582,6 +1306,13 @@ PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_submit, 0, 0, 1)
 	ZEND_ARG_OBJ_INFO(0, message, PmtaMessage, 0)
 ZEND_END_ARG_INFO()
 
+/**
+ * @brief arginfo for @c submitMessages()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_submitmany, 0, 0, 1)
+	ZEND_ARG_INFO(0, messages)
+ZEND_END_ARG_INFO()
+
 /**
  * @brief @c PmtaConnection class methods
  */
@@ -590,11 +1321,13 @@ static
 const
 #endif
 zend_function_entry pmta_conn_class_methods[] = {
-	PHP_ME(PmtaConnection, __construct,      arginfo_construct, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
-	PHP_ME(PmtaConnection, __get,            arginfo_get,       ZEND_ACC_PUBLIC)
-	PHP_ME(PmtaConnection, __isset,          arginfo_get,       ZEND_ACC_PUBLIC)
-	PHP_ME(PmtaConnection, submitMessage,    arginfo_submit,    ZEND_ACC_PUBLIC)
-	PHP_ME(PmtaConnection, getLastError,     arginfo_empty,     ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaConnection, __construct,      arginfo_construct,  ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(PmtaConnection, __get,            arginfo_get,        ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaConnection, __isset,          arginfo_get,        ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaConnection, submitMessage,    arginfo_submit,     ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaConnection, submitMessages,   arginfo_submitmany, ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaConnection, submitAsync,      arginfo_submit,     ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaConnection, getLastError,     arginfo_empty,      ZEND_ACC_PUBLIC)
 	PHP_ME_MAPPING(__destruct, empty_destructor, arginfo_empty, ZEND_ACC_PUBLIC | ZEND_ACC_DTOR)
 	PHP_FE_END
 };
@@ -602,10 +1335,12 @@ zend_function_entry pmta_conn_class_methods[] = {
 /**
  * Registers @c PmtaConnection class with Zend
  */
-void pmtaconn_register_class(TSRMLS_D)
+void pmtaconn_register_class(int module_number TSRMLS_DC)
 {
 	zend_class_entry e;
 
+	le_pmta_pconn = zend_register_list_destructors_ex(NULL, pmtaconn_pconn_dtor, "PowerMTA persistent connection", module_number);
+
 	INIT_CLASS_ENTRY(e, "PmtaConnection", pmta_conn_class_methods);
 
 	pmta_conn_class = zend_register_internal_class(&e TSRMLS_CC);
@@ -623,4 +1358,6 @@ void pmtaconn_register_class(TSRMLS_D)
 
 	zend_declare_class_constant_stringl(pmta_conn_class, ZEND_STRL("LOCAL_SERVER"), ZEND_STRL("127.0.0.1") TSRMLS_CC);
 	zend_declare_class_constant_long(pmta_conn_class, ZEND_STRL("DEFAULT_PORT"), 25 TSRMLS_CC);
+	zend_declare_class_constant_long(pmta_conn_class, ZEND_STRL("PERSISTENT"), PMTACONN_PERSISTENT TSRMLS_CC);
+	zend_declare_class_constant_long(pmta_conn_class, ZEND_STRL("LAZY"),       PMTACONN_LAZY       TSRMLS_CC);
 }
@@ -11,6 +11,8 @@ class PmtaConnection
 {
 	const LOCAL_SERVER = "127.0.0.1";
 	const DEFAULT_PORT = 25;
+	const PERSISTENT   = 1;
+	const LAZY         = 2;
 
 	private $connection;
 
@@ -18,11 +20,14 @@ class PmtaConnection
 	private $port;
 	private $username;
 	private $password;
+	private $persistent;
 
-	public function __construct($server = '127.0.0.1', $port = 25, $username = null, $password = null);
+	public function __construct($server = '127.0.0.1', $port = 25, $username = null, $password = null, $flags = null);
 	public function __destruct();
 	public function getLastError();
 	public function submitMessage(PmtaMessage $message);
+	public function submitMessages($messages); // array or Traversable
+	public function submitAsync(PmtaMessage $message);
 	public function __get($property);
 	public function __isset($property);
 	private function __clone();
@@ -38,11 +43,87 @@ class PmtaConnection
 #define PMTA_CONNECTION_H
 
 #include "php_pmta.h"
+#include <submitter/PmtaConn.h>
+#include <submitter/PmtaMsg.h>
 
 /**
- * @brief Registers @c PmtaConnection class
+ * @brief Flag for @c PmtaConnection::__construct(): reuse a persistent connection
+ */
+#define PMTACONN_PERSISTENT 1
+
+/**
+ * @brief Flag for @c PmtaConnection::__construct(): do not connect until the first submission
+ */
+#define PMTACONN_LAZY 2
+
+/**
+ * @brief Persistent connection (opaque)
+ */
+typedef struct _pmta_pconn pmta_pconn;
+
+/**
+ * @brief Connects to PowerMTA, reusing a persistent connection if possible
+ * @param conn Connection handle (output)
+ * @param pconn Persistent connection @a conn was borrowed from or @c NULL (output)
+ * @param reused Whether an already established persistent connection was reused (output)
+ * @param server PowerMTA server
+ * @param port Server port
+ * @param username Username (@c NULL if authentication is not required)
+ * @param password Password (@c NULL if authentication is not required)
+ * @param persistent Whether to use persistent connections
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the connection was established
+ * @retval SUCCESS Yes
+ * @retval FAILURE No; if @a *conn is not @c NULL, it holds the error and must be freed by the caller
+ *
+ * Persistent connections are keyed by server, port and username. An idle connection is reused only if it is not
+ * broken, has not been idle for longer than @c pmta.persistent_max_idle seconds, is not older than
+ * @c pmta.persistent_max_lifetime seconds and was authenticated with the same password. If the connection
+ * is already borrowed by another object, a private (non-persistent) connection is established.
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern int pmtaconn_open(PmtaConn* conn, pmta_pconn** pconn, zend_bool* reused, const char* server, long int port, const char* username, const char* password, zend_bool persistent TSRMLS_DC);
+
+/**
+ * @brief Releases the connection established by @c pmtaconn_open()
+ * @param conn Connection handle
+ * @param pconn Persistent connection @a conn was borrowed from or @c NULL
+ * @param broken Whether the connection must not be reused
+ * @param tsrm_ls Internally used by Zend
+ * @details Persistent connections are returned to the persistent list, all others are freed
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmtaconn_close(PmtaConn conn, pmta_pconn* pconn, zend_bool broken TSRMLS_DC);
+
+/**
+ * @brief Submits the message over the connection established by @c pmtaconn_open()
+ * @param conn Connection handle (may be replaced)
+ * @param pconn Persistent connection @a conn was borrowed from or @c NULL (may be replaced)
+ * @param reused Value returned by @c pmtaconn_open() (reset to 0)
+ * @param server PowerMTA server
+ * @param port Server port
+ * @param username Username (@c NULL if authentication is not required)
+ * @param password Password (@c NULL if authentication is not required)
+ * @param msg Message to submit
+ * @param code Error code if the message was not submitted (output)
+ * @param error Error message if the message was not submitted, must be freed with @c efree() by the caller (output)
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the message was submitted
+ *
+ * An idle persistent connection could have been closed by the server while it was sitting in the pool.
+ * If the first submission over a reused connection fails with an I/O error, the connection is dropped,
+ * a new one is established and the submission is retried once. If reconnecting fails, @a *conn is freed
+ * and set to @c NULL.
+ *
+ * @warning The I/O error may also happen after the server has accepted the message data (e.g. the connection
+ * breaks while waiting for the final reply); the retry then delivers the message twice. Do not enable
+ * persistent connections if duplicates are not acceptable.
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern BOOL pmtaconn_submit(PmtaConn* conn, pmta_pconn** pconn, zend_bool* reused, const char* server, long int port, const char* username, const char* password, PmtaMsg msg, int* code, char** error TSRMLS_DC);
+
+/**
+ * @brief Registers @c PmtaConnection class and the persistent connection resource type
+ * @param module_number Module number
  * @param tsrm_ls Internally used by Zend
  */
-PHPPMTA_VISIBILITY_HIDDEN extern void pmtaconn_register_class(TSRMLS_D);
+PHPPMTA_VISIBILITY_HIDDEN extern void pmtaconn_register_class(int module_number TSRMLS_DC);
 
 #endif /* PMTA_CONNECTION_H */
@@ -0,0 +1,275 @@
+/**
+ * @file pmta_csv.c
+ * @brief Streaming CSV reader (implementation)
+ * @details The reader keeps a block of the file in memory and parses one record at a time.
+ * If a record crosses the end of the block, the unparsed tail is moved to the beginning of the buffer,
+ * more data is read and the record is parsed again. Field values are copied (unescaped) into a separate
+ * buffer and terminated with @c NUL so that they can be passed to the PMTA API directly.
+ */
+
+#include "pmta_csv.h"
+#include "pmta_common.h"
+
+/**
+ * @brief Initial size of the read buffer
+ */
+#define PMTA_CSV_BLOCK 65536
+
+/**
+ * @brief Finds the first delimiter or line break
+ * @param p Start of the data
+ * @param end End of the data
+ * @param delim Field delimiter
+ * @return Pointer to the first delimiter, @c CR or @c LF, or @a end
+ */
+static const char* pmta_csv_scan(const char* p, const char* end, char delim)
+{
+#ifdef PMTA_HAVE_SSE2
+	const __m128i d  = _mm_set1_epi8(delim);
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		int mask  = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, d), _mm_cmpeq_epi8(v, cr)), _mm_cmpeq_epi8(v, lf)));
+
+		if (mask) {
+			return p + pmta_ctz((unsigned int)mask);
+		}
+
+		p += 16;
+	}
+#endif
+
+	while (p < end && *p != delim && *p != '\r' && *p != '\n') {
+		++p;
+	}
+
+	return p;
+}
+
+/**
+ * @brief Appends data to the current field
+ * @param r Reader
+ * @param s Data
+ * @param n Length of @a s
+ * @note Always leaves room for the terminating @c NUL
+ */
+static void pmta_csv_append(pmta_csv_reader* r, const char* s, size_t n)
+{
+	if (r->data_len + n + 1 > r->data_size) {
+		while (r->data_len + n + 1 > r->data_size) {
+			r->data_size *= 2;
+		}
+
+		r->data = erealloc(r->data, r->data_size);
+	}
+
+	memcpy(r->data + r->data_len, s, n);
+	r->data_len += n;
+}
+
+/**
+ * @brief Terminates the current field
+ * @param r Reader
+ * @param start Offset of the field in @c r->data
+ */
+static void pmta_csv_end_field(pmta_csv_reader* r, size_t start)
+{
+	pmta_csv_append(r, "", 0);
+	r->data[r->data_len++] = '\0';
+
+	if (r->num_fields == r->max_fields) {
+		r->max_fields *= 2;
+		r->fields      = erealloc(r->fields, r->max_fields * sizeof(size_t));
+	}
+
+	r->fields[r->num_fields++] = start;
+}
+
+/**
+ * @brief Parses one record
+ * @param r Reader
+ * @param p Start of the record
+ * @param end End of the buffered data
+ * @param next Start of the next record (output)
+ * @return Whether the record is complete; @c 0 means that more data is needed (or there is no data left)
+ */
+static int pmta_csv_parse(pmta_csv_reader* r, const char* p, const char* end, const char** next)
+{
+	r->data_len   = 0;
+	r->num_fields = 0;
+
+	if (p == end) {
+		return 0;
+	}
+
+	for (;;) {
+		size_t start = r->data_len;
+		const char* q;
+
+		if (p < end && *p == '"') {
+			++p;
+			for (;;) {
+				q = memchr(p, '"', end - p);
+				if (!q) {
+					if (!r->eof) {
+						return 0;
+					}
+
+					/* Unterminated quoted field takes the rest of the file */
+					pmta_csv_append(r, p, end - p);
+					p = end;
+					break;
+				}
+
+				pmta_csv_append(r, p, q - p);
+				if (q + 1 == end && !r->eof) {
+					return 0;
+				}
+
+				if (q + 1 < end && q[1] == '"') {
+					pmta_csv_append(r, "\"", 1);
+					p = q + 2;
+					continue;
+				}
+
+				p = q + 1;
+				break;
+			}
+
+			/* Anything between the closing quote and the delimiter is kept as is */
+			q = pmta_csv_scan(p, end, r->delim);
+			pmta_csv_append(r, p, q - p);
+		}
+		else {
+			q = pmta_csv_scan(p, end, r->delim);
+			pmta_csv_append(r, p, q - p);
+		}
+
+		pmta_csv_end_field(r, start);
+
+		if (q == end) {
+			if (!r->eof) {
+				return 0;
+			}
+
+			*next = end;
+			return 1;
+		}
+
+		if (*q == r->delim) {
+			p = q + 1;
+			continue;
+		}
+
+		if (*q == '\r') {
+			if (q + 1 == end && !r->eof) {
+				return 0;
+			}
+
+			if (q + 1 < end && q[1] == '\n') {
+				++q;
+			}
+		}
+
+		*next = q + 1;
+		return 1;
+	}
+}
+
+int pmta_csv_open(pmta_csv_reader* r, const char* path, off_t offset, char delim TSRMLS_DC)
+{
+	memset(r, 0, sizeof(pmta_csv_reader));
+
+	r->stream = php_stream_open_wrapper((char*)path, "rb", REPORT_ERRORS, NULL);
+	if (!r->stream) {
+		return FAILURE;
+	}
+
+	r->delim      = delim;
+	r->size       = PMTA_CSV_BLOCK;
+	r->buf        = emalloc(r->size);
+	r->data_size  = 256;
+	r->data       = emalloc(r->data_size);
+	r->max_fields = 16;
+	r->fields     = safe_emalloc(r->max_fields, sizeof(size_t), 0);
+
+	if (offset > 0 && FAILURE == pmta_csv_seek(r, offset TSRMLS_CC)) {
+		pmta_csv_close(r TSRMLS_CC);
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+
+int pmta_csv_seek(pmta_csv_reader* r, off_t offset TSRMLS_DC)
+{
+	if (0 != php_stream_seek(r->stream, offset, SEEK_SET)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Cannot seek to offset %ld", (long int)offset);
+		return FAILURE;
+	}
+
+	r->len  = 0;
+	r->pos  = 0;
+	r->base = offset;
+	r->eof  = 0;
+	return SUCCESS;
+}
+
+int pmta_csv_next(pmta_csv_reader* r TSRMLS_DC)
+{
+	const char* next;
+
+	for (;;) {
+		size_t n;
+
+		if (pmta_csv_parse(r, r->buf + r->pos, r->buf + r->len, &next)) {
+			r->offset = r->base + (off_t)r->pos;
+			r->pos    = next - r->buf;
+
+			if (1 == r->num_fields && !r->data[0]) {
+				/* Blank line */
+				continue;
+			}
+
+			return 1;
+		}
+
+		if (r->eof) {
+			return 0;
+		}
+
+		/* Drop the consumed records; grow the buffer if the current record does not fit */
+		if (r->pos) {
+			memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+			r->len  -= r->pos;
+			r->base += (off_t)r->pos;
+			r->pos   = 0;
+		}
+
+		if (r->len == r->size) {
+			r->size *= 2;
+			r->buf   = erealloc(r->buf, r->size);
+		}
+
+		n = php_stream_read(r->stream, r->buf + r->len, r->size - r->len);
+		if (!n) {
+			r->eof = 1;
+		}
+
+		r->len += n;
+	}
+}
+
+void pmta_csv_close(pmta_csv_reader* r TSRMLS_DC)
+{
+	if (r->stream) {
+		php_stream_close(r->stream);
+		r->stream = NULL;
+	}
+
+	if (r->buf)    { efree(r->buf);    r->buf    = NULL; }
+	if (r->data)   { efree(r->data);   r->data   = NULL; }
+	if (r->fields) { efree(r->fields); r->fields = NULL; }
+}
@@ -0,0 +1,97 @@
+/**
+ * @file pmta_csv.h
+ * @brief Streaming CSV reader used by the native recipient loaders
+ * @details RFC 4180 records (quoted fields, doubled quotes, CRLF/LF/CR line endings) are read from a PHP stream
+ * in large blocks; delimiters and line breaks are located with SSE2 where available.
+ */
+
+#ifdef DOXYGEN
+#	undef PMTA_CSV_H
+#endif
+
+#ifndef PMTA_CSV_H
+#define PMTA_CSV_H
+
+#include "php_pmta.h"
+#include <main/php_streams.h>
+
+/**
+ * @brief CSV reader state
+ */
+typedef struct _pmta_csv_reader {
+	php_stream* stream;  /**< Input stream */
+	char* buf;           /**< Read buffer */
+	size_t size;         /**< Size of @c buf */
+	size_t len;          /**< Number of bytes in @c buf */
+	size_t pos;          /**< Start of the next record in @c buf */
+	off_t base;          /**< Stream offset of @c buf[0] */
+	off_t offset;        /**< Stream offset of the current record */
+	int eof;             /**< Whether the stream is exhausted */
+	char delim;          /**< Field delimiter */
+	char* data;          /**< Unescaped fields of the current record, each terminated with @c NUL */
+	size_t data_len;     /**< Number of bytes used in @c data */
+	size_t data_size;    /**< Size of @c data */
+	size_t* fields;      /**< Offsets of the fields in @c data */
+	int num_fields;      /**< Number of fields in the current record */
+	int max_fields;      /**< Size of @c fields */
+} pmta_csv_reader;
+
+/**
+ * @brief Opens CSV file
+ * @param r Reader
+ * @param path File name (any stream wrapper)
+ * @param offset Byte offset of the first record to read
+ * @param delim Field delimiter
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the file has been opened
+ * @retval SUCCESS Yes
+ * @retval FAILURE No, a warning has been emitted by the stream layer
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern int pmta_csv_open(pmta_csv_reader* r, const char* path, off_t offset, char delim TSRMLS_DC);
+
+/**
+ * @brief Repositions the reader
+ * @param r Reader
+ * @param offset Byte offset of the next record to read
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE if the stream is not seekable
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern int pmta_csv_seek(pmta_csv_reader* r, off_t offset TSRMLS_DC);
+
+/**
+ * @brief Reads the next non-empty record
+ * @param r Reader
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether a record has been read (@c 0 on end of file)
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern int pmta_csv_next(pmta_csv_reader* r TSRMLS_DC);
+
+/**
+ * @brief Returns a field of the current record
+ * @param r Reader
+ * @param idx Field index
+ * @return @c NUL-terminated field value (empty string if the record has fewer fields)
+ */
+static zend_always_inline const char* pmta_csv_field(const pmta_csv_reader* r, int idx)
+{
+	return (idx < r->num_fields) ? r->data + r->fields[idx] : "";
+}
+
+/**
+ * @brief Returns the byte offset of the record following the current one
+ * @param r Reader
+ * @return Offset to resume reading from
+ */
+static zend_always_inline off_t pmta_csv_tell(const pmta_csv_reader* r)
+{
+	return r->base + (off_t)r->pos;
+}
+
+/**
+ * @brief Closes the stream and frees the memory used by the reader
+ * @param r Reader
+ * @param tsrm_ls Internally used by Zend
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_csv_close(pmta_csv_reader* r TSRMLS_DC);
+
+#endif /* PMTA_CSV_H */
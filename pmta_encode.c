@@ -0,0 +1,410 @@
+/**
+ * @file pmta_encode.c
+ * @brief Content transfer encodings (implementation)
+ * @details Base64 lines are encoded with AVX2 or SSSE3 (12 input bytes per 128-bit lane), either because the compiler
+ * targets them or, on x86 with GCC and Clang, by picking the kernel the CPU supports at @c MINIT; quoted-printable and canonicalization copy runs of 16 characters that need no changes with SSE2. The scalar code
+ * handles the rest.
+ */
+
+#include "pmta_encode.h"
+#include "pmta_common.h"
+
+/**
+ * @brief Base64 alphabet
+ */
+static const char pmta_base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * @brief Number of raw bytes in a full base64 line
+ */
+#define PMTA_BASE64_LINE (PMTA_ENCODE_LINE / 4 * 3)
+
+#if defined(PMTA_HAVE_AVX2) || defined(PMTA_HAVE_SIMD_DISPATCH)
+/**
+ * @brief Defined if the AVX2 line encoder is compiled
+ */
+#	define PMTA_BASE64_AVX2 1
+#endif
+
+#if (defined(PMTA_HAVE_SSSE3) && !defined(PMTA_HAVE_AVX2)) || defined(PMTA_HAVE_SIMD_DISPATCH)
+/**
+ * @brief Defined if the SSSE3 line encoder is compiled
+ */
+#	define PMTA_BASE64_SSSE3 1
+#endif
+
+#ifdef PMTA_HAVE_SIMD_DISPATCH
+/**
+ * @brief Compiles the function for @a isa whatever the compiler targets
+ * @param isa Instruction set
+ */
+#	define PMTA_TARGET(isa) __attribute__((target(isa)))
+#else
+#	define PMTA_TARGET(isa)
+#endif
+
+/**
+ * @brief Encodes full 3-byte groups
+ * @param src Raw data
+ * @param groups Number of groups
+ * @param dst Output buffer
+ * @return Pointer past the last written character
+ */
+static char* pmta_base64_groups(const unsigned char* src, size_t groups, char* dst)
+{
+	while (groups--) {
+		zend_uint v = ((zend_uint)src[0] << 16) | ((zend_uint)src[1] << 8) | src[2];
+
+		dst[0] = pmta_base64_alphabet[(v >> 18) & 0x3F];
+		dst[1] = pmta_base64_alphabet[(v >> 12) & 0x3F];
+		dst[2] = pmta_base64_alphabet[(v >>  6) & 0x3F];
+		dst[3] = pmta_base64_alphabet[v & 0x3F];
+		src += 3;
+		dst += 4;
+	}
+
+	return dst;
+}
+
+#ifdef PMTA_BASE64_SSSE3
+/**
+ * @brief Splits 12 bytes (in the low 12 bytes of every 128-bit lane) into 16 sextets
+ * @param in Raw data
+ * @return Sextets, one per byte
+ */
+static zend_always_inline PMTA_TARGET("ssse3") __m128i pmta_base64_split(__m128i in)
+{
+	__m128i t0, t1, t2, t3;
+
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+	t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+	t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(t1, t3);
+}
+
+/**
+ * @brief Maps sextets to the base64 alphabet
+ * @param in Sextets
+ * @return Characters
+ */
+static zend_always_inline PMTA_TARGET("ssse3") __m128i pmta_base64_translate(__m128i in)
+{
+	const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	__m128i idx       = _mm_subs_epu8(in, _mm_set1_epi8(51));
+
+	idx = _mm_sub_epi8(idx, _mm_cmpgt_epi8(in, _mm_set1_epi8(25)));
+	return _mm_add_epi8(in, _mm_shuffle_epi8(lut, idx));
+}
+
+/**
+ * @brief Encodes a full line (@c PMTA_BASE64_LINE bytes) with SSSE3, without the line break
+ * @param src Raw data
+ * @param dst Output buffer
+ * @return Pointer past the last written character
+ * @note Vector loads read at most 16 bytes from every 12-byte offset, which stays within the line
+ */
+static PMTA_TARGET("ssse3") char* pmta_base64_line_ssse3(const unsigned char* src, char* dst)
+{
+	int i;
+
+	for (i=0; i<4; ++i) {
+		__m128i in = _mm_loadu_si128((const __m128i*)src);
+
+		_mm_storeu_si128((__m128i*)dst, pmta_base64_translate(pmta_base64_split(in)));
+		src += 12;
+		dst += 16;
+	}
+
+	return pmta_base64_groups(src, (PMTA_BASE64_LINE - 48) / 3, dst);
+}
+#endif
+
+#ifdef PMTA_BASE64_AVX2
+/**
+ * @brief AVX2 counterpart of @c pmta_base64_split() (both lanes at once)
+ * @param in Raw data
+ * @return Sextets
+ */
+static zend_always_inline PMTA_TARGET("avx2") __m256i pmta_base64_split256(__m256i in)
+{
+	__m256i t0, t1, t2, t3;
+
+	in = _mm256_shuffle_epi8(in, _mm256_set_epi8(
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1
+	));
+
+	t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00));
+	t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+	t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0));
+	t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+	return _mm256_or_si256(t1, t3);
+}
+
+/**
+ * @brief AVX2 counterpart of @c pmta_base64_translate()
+ * @param in Sextets
+ * @return Characters
+ */
+static zend_always_inline PMTA_TARGET("avx2") __m256i pmta_base64_translate256(__m256i in)
+{
+	const __m256i lut = _mm256_setr_epi8(
+		65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+		65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0
+	);
+
+	__m256i idx = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+
+	idx = _mm256_sub_epi8(idx, _mm256_cmpgt_epi8(in, _mm256_set1_epi8(25)));
+	return _mm256_add_epi8(in, _mm256_shuffle_epi8(lut, idx));
+}
+
+/**
+ * @brief Encodes a full line (@c PMTA_BASE64_LINE bytes) with AVX2, without the line break
+ * @param src Raw data
+ * @param dst Output buffer
+ * @return Pointer past the last written character
+ * @note Vector loads read at most 16 bytes from every 12-byte offset, which stays within the line
+ */
+static PMTA_TARGET("avx2") char* pmta_base64_line_avx2(const unsigned char* src, char* dst)
+{
+	int i;
+
+	for (i=0; i<2; ++i) {
+		__m256i in = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)src)),
+			_mm_loadu_si128((const __m128i*)(src + 12)),
+			1
+		);
+
+		_mm256_storeu_si256((__m256i*)dst, pmta_base64_translate256(pmta_base64_split256(in)));
+		src += 24;
+		dst += 32;
+	}
+
+	return pmta_base64_groups(src, (PMTA_BASE64_LINE - 48) / 3, dst);
+}
+#endif
+
+#ifndef PMTA_HAVE_SSSE3
+/**
+ * @brief Encodes a full line (@c PMTA_BASE64_LINE bytes) without the line break
+ * @param src Raw data
+ * @param dst Output buffer
+ * @return Pointer past the last written character
+ */
+static char* pmta_base64_line_scalar(const unsigned char* src, char* dst)
+{
+	return pmta_base64_groups(src, PMTA_BASE64_LINE / 3, dst);
+}
+#endif
+
+#if defined(PMTA_HAVE_AVX2)
+#	define pmta_base64_line pmta_base64_line_avx2
+#elif defined(PMTA_HAVE_SIMD_DISPATCH)
+/**
+ * @brief Line encoder selected by @c pmta_encode_startup()
+ */
+#	ifdef PMTA_HAVE_SSSE3
+static char* (*pmta_base64_line)(const unsigned char*, char*) = pmta_base64_line_ssse3;
+#	else
+static char* (*pmta_base64_line)(const unsigned char*, char*) = pmta_base64_line_scalar;
+#	endif
+#elif defined(PMTA_HAVE_SSSE3)
+#	define pmta_base64_line pmta_base64_line_ssse3
+#else
+#	define pmta_base64_line pmta_base64_line_scalar
+#endif
+
+void pmta_encode_startup(void)
+{
+#ifdef PMTA_HAVE_SIMD_DISPATCH
+#	ifndef __clang__
+	__builtin_cpu_init();
+#	endif
+	if (__builtin_cpu_supports("avx2")) {
+		pmta_base64_line = pmta_base64_line_avx2;
+	}
+	else if (__builtin_cpu_supports("ssse3")) {
+		pmta_base64_line = pmta_base64_line_ssse3;
+	}
+#endif
+}
+
+size_t pmta_base64_encode(const unsigned char* src, size_t len, char* dst)
+{
+	char* p = dst;
+
+	while (len >= PMTA_BASE64_LINE) {
+		p    = pmta_base64_line(src, p);
+		*p++ = '\r';
+		*p++ = '\n';
+		src += PMTA_BASE64_LINE;
+		len -= PMTA_BASE64_LINE;
+	}
+
+	if (len) {
+		size_t groups = len / 3;
+
+		p    = pmta_base64_groups(src, groups, p);
+		src += groups * 3;
+		len -= groups * 3;
+
+		if (len) {
+			zend_uint v = ((zend_uint)src[0] << 16) | (len > 1 ? ((zend_uint)src[1] << 8) : 0);
+
+			p[0] = pmta_base64_alphabet[(v >> 18) & 0x3F];
+			p[1] = pmta_base64_alphabet[(v >> 12) & 0x3F];
+			p[2] = len > 1 ? pmta_base64_alphabet[(v >> 6) & 0x3F] : '=';
+			p[3] = '=';
+			p   += 4;
+		}
+
+		*p++ = '\r';
+		*p++ = '\n';
+	}
+
+	return (size_t)(p - dst);
+}
+
+size_t pmta_qp_encode(const unsigned char* src, size_t len, char* dst)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	const unsigned char* end = src + len;
+	char* p                  = dst;
+	size_t line              = 0;
+
+	while (src < end) {
+		unsigned char c;
+		int literal;
+
+#ifdef PMTA_HAVE_SSE2
+		/* A run of 16 characters from '!'..'~' except '=' is copied as is */
+		if (end - src >= 16 && line + 16 < PMTA_ENCODE_LINE) {
+			__m128i v  = _mm_loadu_si128((const __m128i*)src);
+			__m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(' ')), _mm_cmplt_epi8(v, _mm_set1_epi8(127)));
+
+			ok = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('=')), ok);
+			if (0xFFFF == _mm_movemask_epi8(ok)) {
+				_mm_storeu_si128((__m128i*)p, v);
+				p    += 16;
+				src  += 16;
+				line += 16;
+				continue;
+			}
+		}
+#endif
+
+		c = *src;
+		if ('\n' == c || ('\r' == c && src + 1 < end && '\n' == src[1])) {
+			src += ('\r' == c) ? 2 : 1;
+			*p++ = '\r';
+			*p++ = '\n';
+			line = 0;
+			continue;
+		}
+
+		if (' ' == c || '\t' == c) {
+			/* Whitespace at the end of a line must be encoded */
+			literal = (src + 1 < end && src[1] != '\r' && src[1] != '\n');
+		}
+		else {
+			literal = (c > ' ' && c < 127 && c != '=');
+		}
+
+		/* Leave room for the '=' of a soft line break */
+		if (line + (literal ? 1 : 3) >= PMTA_ENCODE_LINE) {
+			*p++ = '=';
+			*p++ = '\r';
+			*p++ = '\n';
+			line = 0;
+		}
+
+		if (literal) {
+			*p++ = (char)c;
+			++line;
+		}
+		else {
+			*p++ = '=';
+			*p++ = hex[c >> 4];
+			*p++ = hex[c & 0x0F];
+			line += 3;
+		}
+
+		++src;
+	}
+
+	return (size_t)(p - dst);
+}
+
+size_t pmta_canonicalize(pmta_canon_state* state, int flags, const char* src, size_t len, char* dst)
+{
+	const char* end = src + len;
+	char* p         = dst;
+	size_t col      = state->col;
+	int cr          = state->cr;
+	size_t limit    = (flags & PMTA_CANON_LINE_LENGTH) ? PMTA_CANON_MAX_LINE : (size_t)-1;
+
+	while (src < end) {
+		char c;
+
+#ifdef PMTA_HAVE_SSE2
+		/* 16 characters without CR and LF in the middle of a line are copied as is */
+		if (end - src >= 16 && col && col + 16 <= limit) {
+			__m128i v   = _mm_loadu_si128((const __m128i*)src);
+			__m128i eol = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+
+			if (!_mm_movemask_epi8(eol)) {
+				_mm_storeu_si128((__m128i*)p, v);
+				p   += 16;
+				src += 16;
+				col += 16;
+				cr   = 0;
+				continue;
+			}
+		}
+#endif
+
+		c = *src++;
+		if ('\n' == c) {
+			if ((flags & PMTA_CANON_CRLF) && !cr) {
+				*p++ = '\r';
+			}
+
+			if (!cr || !(flags & PMTA_CANON_CRLF)) {
+				*p++ = '\n';
+			}
+
+			col = 0;
+			cr  = 0;
+			continue;
+		}
+
+		if ('\r' == c && (flags & PMTA_CANON_CRLF)) {
+			/* The LF is added now; the one which may follow is skipped */
+			*p++ = '\r';
+			*p++ = '\n';
+			col  = 0;
+			cr   = 1;
+			continue;
+		}
+
+		cr = 0;
+		if ('.' == c && !col && (flags & PMTA_CANON_DOTS)) {
+			*p++ = '.';
+			++col;
+		}
+
+		/* CR of CRLF (without PMTA_CANON_CRLF) does not count towards the line length */
+		*p++ = c;
+		if (++col > limit && !('\r' == c && col == limit + 1)) {
+			return (size_t)-1;
+		}
+	}
+
+	state->col = col;
+	state->cr  = cr;
+	return (size_t)(p - dst);
+}
@@ -0,0 +1,102 @@
+/**
+ * @file pmta_encode.h
+ * @brief Content transfer encodings
+ */
+
+#ifdef DOXYGEN
+#	undef PMTA_ENCODE_H
+#endif
+
+#ifndef PMTA_ENCODE_H
+#define PMTA_ENCODE_H
+
+#include "php_pmta.h"
+
+/**
+ * @brief Maximum length of an encoded line (without CRLF), RFC 2045
+ */
+#define PMTA_ENCODE_LINE 76
+
+/**
+ * @brief Returns the length of the base64-encoded data
+ * @param len Length of the raw data
+ * @return Length of the encoded data including CRLF after every line
+ */
+static inline size_t pmta_base64_size(size_t len)
+{
+	size_t chars = (len + 2) / 3 * 4;
+	return chars + (chars + PMTA_ENCODE_LINE - 1) / PMTA_ENCODE_LINE * 2;
+}
+
+/**
+ * @brief Encodes the data with base64
+ * @param src Raw data
+ * @param len Length of @a src
+ * @param dst Output buffer, at least <tt>pmta_base64_size(len)</tt> bytes
+ * @return Number of bytes written
+ * @details Every line (including the last one) is @c PMTA_ENCODE_LINE characters at most and ends with CRLF
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern size_t pmta_base64_encode(const unsigned char* src, size_t len, char* dst);
+
+/**
+ * @brief Selects the base64 line encoder supported by the CPU
+ * @details Called from @c MINIT; does nothing unless @c PMTA_HAVE_SIMD_DISPATCH is defined
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_encode_startup(void);
+
+/**
+ * @brief Returns the maximum length of the quoted-printable-encoded data
+ * @param len Length of the raw data
+ * @return Upper bound of the encoded length including soft line breaks
+ */
+static inline size_t pmta_qp_size(size_t len)
+{
+	return 3 * len + (3 * len / (PMTA_ENCODE_LINE - 3) + 1) * 3;
+}
+
+/**
+ * @brief Encodes the data as quoted-printable
+ * @param src Raw data
+ * @param len Length of @a src
+ * @param dst Output buffer, at least <tt>pmta_qp_size(len)</tt> bytes
+ * @return Number of bytes written
+ * @details Line breaks (LF or CRLF) in the data become CRLF; longer lines are split with soft line breaks
+ * so that no line exceeds @c PMTA_ENCODE_LINE characters
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern size_t pmta_qp_encode(const unsigned char* src, size_t len, char* dst);
+
+/**
+ * @brief Canonicalization flags (@c PmtaMessage::CANON_*)
+ */
+enum pmta_canon_flags {
+	PMTA_CANON_CRLF        = 1, /**< Convert bare LF and bare CR to CRLF */
+	PMTA_CANON_DOTS        = 2, /**< Escape a dot at the start of a line with another dot (SMTP transparency) */
+	PMTA_CANON_LINE_LENGTH = 4, /**< Reject lines longer than @c PMTA_CANON_MAX_LINE characters */
+	PMTA_CANON_ALL         = 7  /**< All of the above */
+};
+
+/**
+ * @brief Maximum length of a line without CRLF, RFC 5322
+ */
+#define PMTA_CANON_MAX_LINE 998
+
+/**
+ * @brief Canonicalization state carried over between chunks of data
+ */
+typedef struct _pmta_canon_state {
+	size_t col; /**< Length of the current line */
+	int cr;     /**< Whether the last character was CR, so that LF at the start of the next chunk belongs to it */
+} pmta_canon_state;
+
+/**
+ * @brief Copies the data, canonicalizing it
+ * @param state State (input/output); zero-initialized before the first chunk
+ * @param flags Combination of @c pmta_canon_flags
+ * @param src Data
+ * @param len Length of @a src
+ * @param dst Output buffer, at least <tt>2 * len</tt> bytes
+ * @return Number of bytes written; <tt>(size_t)-1</tt> if a line is too long (@a state is then undefined)
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern size_t pmta_canonicalize(pmta_canon_state* state, int flags, const char* src, size_t len, char* dst);
+
+#endif /* PMTA_ENCODE_H */
@@ -0,0 +1,562 @@
+/**
+ * @file pmta_merge.c
+ * @brief @c PmtaMergeTemplate class implementation
+ * @details The body is split once into literal segments and @c [placeholder] segments; the opening brackets
+ * are located with SSE2 where available. Placeholder names are hashed at compile time, so rendering is
+ * a sequence of @c memcpy() calls and hash lookups into a buffer which is reused between calls.
+ * A placeholder name consists of letters, digits, @c _, @c - and @c . (at most 64 characters);
+ * anything else in brackets is copied as is.
+@code{.php}
+final class PmtaMergeTemplate
+{
+	private $segments = array(); // literal strings and array(name)
+
+	public function __construct($body)
+	{
+		foreach (preg_split('/(\[[A-Za-z0-9_.-]{1,64}\])/', $body, -1, PREG_SPLIT_DELIM_CAPTURE) as $i => $s) {
+			$this->segments[] = ($i & 1) ? array(substr($s, 1, -1)) : $s;
+		}
+	}
+
+	public function getPlaceholders()
+	{
+		$result = array();
+		foreach ($this->segments as $s) {
+			if (is_array($s) && !in_array($s[0], $result)) {
+				$result[] = $s[0];
+			}
+		}
+
+		return $result;
+	}
+
+	public function render(array $vars)
+	{
+		$result = '';
+		foreach ($this->segments as $s) {
+			// Missing variables are rendered as empty strings
+			$result .= is_array($s) ? (isset($vars[$s[0]]) ? (string)$vars[$s[0]] : '') : $s;
+		}
+
+		return $result;
+	}
+
+	public function renderTo(PmtaMessage $message, array $vars)
+	{
+		return $message->addData($this->render($vars));
+	}
+
+	private function __clone() {}
+}
+@endcode
+ */
+
+#include "pmta_merge.h"
+#include "pmta_message.h"
+#include "pmta_common.h"
+
+/**
+ * @brief Maximum length of a placeholder name
+ */
+#define PMTAMERGE_MAX_NAME 64
+
+/**
+ * @brief Segment types
+ */
+enum pmtamerge_segment_type {
+	PMTAMERGE_LITERAL = 0, /**< Literal text */
+	PMTAMERGE_STRKEY  = 1, /**< Placeholder with a string name */
+	PMTAMERGE_NUMKEY  = 2  /**< Placeholder with a numeric name (integer array key) */
+};
+
+/**
+ * @brief Compiled segment of the body
+ */
+typedef struct _pmtamerge_segment {
+	int type;      /**< @c pmtamerge_segment_type */
+	size_t offset; /**< Offset of the literal in the body or of the (@c NUL-terminated) name in the names buffer */
+	size_t len;    /**< Length of the literal or of the name */
+	ulong hash;    /**< Hash of the name (@c PMTAMERGE_STRKEY) or the integer key (@c PMTAMERGE_NUMKEY) */
+} pmtamerge_segment;
+
+/**
+ * @brief @c PmtaMergeTemplate object handlers
+ */
+static zend_object_handlers pmtamerge_object_handlers;
+
+/**
+ * @brief Internal properties of @c PmtaMergeTemplate
+ */
+typedef struct _pmtamerge_object {
+	zend_object obj;          /**< Zend object data */
+	char* src;                /**< Body */
+	char* names;              /**< Placeholder names, each terminated with @c NUL */
+	size_t names_len;         /**< Number of bytes used in @c names */
+	pmtamerge_segment* segs;  /**< Segments */
+	size_t num_segs;          /**< Number of segments */
+	size_t literal_len;       /**< Total length of the literal segments */
+	char* buf;                /**< Render buffer, reused between calls */
+	size_t buf_size;          /**< Size of @c buf */
+	size_t buf_len;           /**< Length of the last rendered body */
+} pmtamerge_object;
+
+/**
+ * @brief Fetches @c pmtamerge_object
+ * @see pmtamerge_object
+ * @param zobj @c PmtaMergeTemplate instance
+ * @return pmtamerge_object associated with @a zobj
+ * @pre <tt>Z_TYPE_P(zobj) == IS_OBJECT && instanceof_function(Z_OBJCE_P(zobj), pmta_merge_class TSRMLS_CC)</tt>
+ */
+static inline pmtamerge_object* fetchPmtaMergeObject(zval* zobj TSRMLS_DC)
+{
+	return (pmtamerge_object*)zend_objects_get_address(zobj TSRMLS_CC);
+}
+
+/**
+ * @brief Finds the next opening bracket
+ * @param p Start of the data
+ * @param end End of the data
+ * @return Pointer to the first @c [ or @a end
+ */
+static const char* pmtamerge_scan(const char* p, const char* end)
+{
+	const char* q;
+
+#ifdef PMTA_HAVE_SSE2
+	const __m128i open = _mm_set1_epi8('[');
+
+	while (end - p >= 16) {
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), open));
+
+		if (mask) {
+			return p + pmta_ctz((unsigned int)mask);
+		}
+
+		p += 16;
+	}
+#endif
+
+	q = memchr(p, '[', end - p);
+	return q ? q : end;
+}
+
+/**
+ * @brief Checks whether the character may appear in a placeholder name
+ * @param c Character
+ * @return Whether @a c is a letter, a digit, @c _, @c - or @c .
+ */
+static inline int pmtamerge_is_name_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.';
+}
+
+/**
+ * @brief Appends a segment
+ * @param obj @c pmtamerge_object
+ * @param type Segment type
+ * @param offset Offset
+ * @param len Length
+ * @param hash Hash or integer key
+ */
+static void pmtamerge_add_segment(pmtamerge_object* obj, int type, size_t offset, size_t len, ulong hash)
+{
+	pmtamerge_segment* seg;
+
+	obj->segs = erealloc(obj->segs, (obj->num_segs + 1) * sizeof(pmtamerge_segment));
+	seg       = &obj->segs[obj->num_segs++];
+
+	seg->type   = type;
+	seg->offset = offset;
+	seg->len    = len;
+	seg->hash   = hash;
+
+	if (PMTAMERGE_LITERAL == type) {
+		obj->literal_len += len;
+	}
+}
+
+/**
+ * @brief Adds a placeholder segment
+ * @param obj @c pmtamerge_object
+ * @param name Placeholder name
+ * @param len Length of @a name
+ */
+static void pmtamerge_add_placeholder(pmtamerge_object* obj, const char* name, size_t len)
+{
+	size_t offset = obj->names_len;
+	size_t i;
+
+	obj->names = erealloc(obj->names, obj->names_len + len + 1);
+	memcpy(obj->names + offset, name, len);
+	obj->names[offset + len] = '\0';
+	obj->names_len += len + 1;
+
+	/* Numeric names are integer keys in PHP arrays */
+	if (len < MAX_LENGTH_OF_LONG - 1 && (name[0] != '0' || 1 == len)) {
+		for (i=0; i<len && name[i] >= '0' && name[i] <= '9'; ++i) {
+			/* Do nothing */
+		}
+
+		if (i == len) {
+			pmtamerge_add_segment(obj, PMTAMERGE_NUMKEY, offset, len, (ulong)strtoul(obj->names + offset, NULL, 10));
+			return;
+		}
+	}
+
+	pmtamerge_add_segment(obj, PMTAMERGE_STRKEY, offset, len, zend_inline_hash_func(obj->names + offset, len + 1));
+}
+
+/**
+ * @brief Frees the compiled body
+ * @param obj @c pmtamerge_object
+ */
+static void pmtamerge_free(pmtamerge_object* obj)
+{
+	if (obj->src)   { efree(obj->src);   obj->src   = NULL; }
+	if (obj->names) { efree(obj->names); obj->names = NULL; }
+	if (obj->segs)  { efree(obj->segs);  obj->segs  = NULL; }
+
+	obj->names_len   = 0;
+	obj->num_segs    = 0;
+	obj->literal_len = 0;
+}
+
+/**
+ * @brief Splits the body into segments
+ * @param obj @c pmtamerge_object
+ * @param body Body
+ * @param len Length of @a body
+ */
+static void pmtamerge_compile(pmtamerge_object* obj, const char* body, size_t len)
+{
+	const char* end;
+	const char* p;
+	const char* literal;
+	const char* q;
+
+	pmtamerge_free(obj);
+
+	obj->src = estrndup(body, len);
+	end      = obj->src + len;
+	p        = obj->src;
+	literal  = obj->src;
+
+	while ((q = pmtamerge_scan(p, end)) < end) {
+		const char* name = q + 1;
+		const char* r    = name;
+
+		while (r < end && r - name <= PMTAMERGE_MAX_NAME && pmtamerge_is_name_char(*r)) {
+			++r;
+		}
+
+		if (r < end && ']' == *r && r > name && r - name <= PMTAMERGE_MAX_NAME) {
+			if (q > literal) {
+				pmtamerge_add_segment(obj, PMTAMERGE_LITERAL, literal - obj->src, q - literal, 0);
+			}
+
+			pmtamerge_add_placeholder(obj, name, r - name);
+			p = literal = r + 1;
+		}
+		else {
+			p = q + 1;
+		}
+	}
+
+	if (end > literal) {
+		pmtamerge_add_segment(obj, PMTAMERGE_LITERAL, literal - obj->src, end - literal, 0);
+	}
+}
+
+/**
+ * @brief Appends data to the render buffer
+ * @param obj @c pmtamerge_object
+ * @param s Data
+ * @param n Length of @a s
+ */
+static inline void pmtamerge_append(pmtamerge_object* obj, const char* s, size_t n)
+{
+	if (obj->buf_len + n > obj->buf_size) {
+		size_t size = obj->buf_size ? obj->buf_size : 256;
+
+		while (obj->buf_len + n > size) {
+			size *= 2;
+		}
+
+		obj->buf      = erealloc(obj->buf, size);
+		obj->buf_size = size;
+	}
+
+	memcpy(obj->buf + obj->buf_len, s, n);
+	obj->buf_len += n;
+}
+
+/**
+ * @brief Renders the body into @c obj->buf
+ * @param obj @c pmtamerge_object
+ * @param vars Variables (name => value); missing variables are rendered as empty strings
+ */
+static void pmtamerge_render(pmtamerge_object* obj, HashTable* vars)
+{
+	size_t i;
+
+	obj->buf_len = 0;
+	if (obj->buf_size < obj->literal_len) {
+		obj->buf      = erealloc(obj->buf, obj->literal_len);
+		obj->buf_size = obj->literal_len;
+	}
+
+	for (i=0; i<obj->num_segs; ++i) {
+		const pmtamerge_segment* seg = &obj->segs[i];
+		zval** value;
+		int res;
+
+		if (PMTAMERGE_LITERAL == seg->type) {
+			pmtamerge_append(obj, obj->src + seg->offset, seg->len);
+			continue;
+		}
+
+		if (PMTAMERGE_NUMKEY == seg->type) {
+			res = zend_hash_index_find(vars, seg->hash, (void**)&value);
+		}
+		else {
+			res = zend_hash_quick_find(vars, obj->names + seg->offset, seg->len + 1, seg->hash, (void**)&value);
+		}
+
+		if (FAILURE == res) {
+			continue;
+		}
+
+		if (Z_TYPE_PP(value) == IS_STRING) {
+			pmtamerge_append(obj, Z_STRVAL_PP(value), Z_STRLEN_PP(value));
+		}
+		else if (Z_TYPE_PP(value) != IS_NULL) {
+			zval str;
+			ZVAL_ZVAL(&str, *value, 1, 0);
+			convert_to_string(&str);
+			pmtamerge_append(obj, Z_STRVAL(str), Z_STRLEN(str));
+			zval_dtor(&str);
+		}
+	}
+}
+
+/**
+ * @brief @c PmtaMergeTemplate destructor
+ * @param v @c pmtamerge_object
+ * @param tsrm_ls Internally used by Zend
+ * @details Frees all memory allocated for @c pmtamerge_object and its members
+ */
+static void pmtamerge_dtor(void* v TSRMLS_DC)
+{
+	pmtamerge_object* obj = v;
+
+	pmtamerge_free(obj);
+	if (obj->buf) {
+		efree(obj->buf);
+	}
+
+	zend_object_std_dtor(&(obj->obj) TSRMLS_CC);
+	efree(obj);
+}
+
+/**
+ * @brief @c PmtaMergeTemplate constructor
+ * @param ce Class Entry for @c PmtaMergeTemplate
+ * @param tsrm_ls Internally used by Zend
+ * @return Zend Object Value
+ * @details Allocates memory for @c pmtamerge_object and registers the destructor
+ */
+static zend_object_value pmtamerge_ctor(zend_class_entry* ce TSRMLS_DC)
+{
+	pmtamerge_object* obj = ecalloc(1, sizeof(pmtamerge_object));
+	zend_object_value retval;
+
+	zend_object_std_init(&obj->obj, ce TSRMLS_CC);
+#if PHP_VERSION_ID >= 50400
+	object_properties_init(&obj->obj, ce);
+#endif
+
+	retval.handle = zend_objects_store_put(
+		obj,
+		(zend_objects_store_dtor_t)zend_objects_destroy_object,
+		pmtamerge_dtor,
+		NULL TSRMLS_CC
+	);
+
+	retval.handlers = &pmtamerge_object_handlers;
+
+	return retval;
+}
+
+/**
+ * @brief public function __construct($body);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaMergeTemplate, __construct)
+{
+	char* body;
+	int body_len;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &body, &body_len)) {
+		RETURN_NULL();
+	}
+
+	pmtamerge_compile(fetchPmtaMergeObject(getThis() TSRMLS_CC), body, body_len);
+}
+
+/**
+ * @brief public function getPlaceholders();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns the names of the placeholders in the order of their first appearance
+ */
+static PHP_METHOD(PmtaMergeTemplate, getPlaceholders)
+{
+	pmtamerge_object* obj;
+	HashTable seen;
+	size_t i;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMergeObject(getThis() TSRMLS_CC);
+
+	array_init(return_value);
+	zend_hash_init(&seen, 8, NULL, NULL, 0);
+	for (i=0; i<obj->num_segs; ++i) {
+		const pmtamerge_segment* seg = &obj->segs[i];
+		const char* name             = obj->names + seg->offset;
+		char dummy                   = 0;
+
+		if (PMTAMERGE_LITERAL != seg->type && SUCCESS == zend_hash_add(&seen, name, seg->len + 1, &dummy, sizeof(char), NULL)) {
+			add_next_index_stringl(return_value, (char*)name, seg->len, 1);
+		}
+	}
+
+	zend_hash_destroy(&seen);
+}
+
+/**
+ * @brief public function render(array $vars);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns the body with the placeholders replaced with the values from @c $vars
+ */
+static PHP_METHOD(PmtaMergeTemplate, render)
+{
+	pmtamerge_object* obj;
+	zval* vars;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &vars)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMergeObject(getThis() TSRMLS_CC);
+	pmtamerge_render(obj, Z_ARRVAL_P(vars));
+	RETURN_STRINGL(obj->buf ? obj->buf : "", obj->buf_len, 1);
+}
+
+/**
+ * @brief public function renderTo(PmtaMessage $message, array $vars);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ *
+ * Renders the body and adds it to the message as @c PmtaMessage::addData() does, without creating a PHP string
+ */
+static PHP_METHOD(PmtaMergeTemplate, renderTo)
+{
+	pmtamerge_object* obj;
+	zval* message;
+	zval* vars;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "Oa", &message, pmta_msg_class, &vars)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMergeObject(getThis() TSRMLS_CC);
+	pmtamerge_render(obj, Z_ARRVAL_P(vars));
+
+	if (FAILURE == append_message_data(message, obj->buf ? obj->buf : "", obj->buf_len TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	RETURN_TRUE;
+}
+
+/**
+ * @brief arginfo for @c __construct()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_construct, 0, 0, 1)
+	ZEND_ARG_INFO(0, body)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c render()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_render, 0, 0, 1)
+	ZEND_ARG_ARRAY_INFO(0, vars, 0)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c renderTo()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_renderto, 0, 0, 2)
+	ZEND_ARG_OBJ_INFO(0, message, PmtaMessage, 0)
+	ZEND_ARG_ARRAY_INFO(0, vars, 0)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief @c PmtaMergeTemplate class methods
+ */
+static
+#if ZEND_MODULE_API_NO > 20060613
+const
+#endif
+zend_function_entry pmta_merge_class_methods[] = {
+	PHP_ME(PmtaMergeTemplate, __construct,     arginfo_construct, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(PmtaMergeTemplate, getPlaceholders, arginfo_empty,     ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMergeTemplate, render,          arginfo_render,    ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMergeTemplate, renderTo,        arginfo_renderto,  ZEND_ACC_PUBLIC)
+	PHP_ME_MAPPING(__destruct, empty_destructor, arginfo_empty, ZEND_ACC_PUBLIC | ZEND_ACC_DTOR)
+	PHP_FE_END
+};
+
+/**
+ * Registers @c PmtaMergeTemplate class with Zend
+ */
+void pmtamerge_register_class(TSRMLS_D)
+{
+	zend_class_entry e;
+
+	INIT_CLASS_ENTRY(e, "PmtaMergeTemplate", pmta_merge_class_methods);
+
+	pmta_merge_class = zend_register_internal_class(&e TSRMLS_CC);
+
+	pmta_merge_class->ce_flags     |= ZEND_ACC_FINAL_CLASS;
+	pmta_merge_class->create_object = pmtamerge_ctor;
+	pmta_merge_class->serialize     = zend_class_serialize_deny;
+	pmta_merge_class->unserialize   = zend_class_unserialize_deny;
+
+	pmtamerge_object_handlers = *zend_get_std_object_handlers();
+	pmtamerge_object_handlers.clone_obj = NULL;
+}
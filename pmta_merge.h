@@ -0,0 +1,33 @@
+/**
+ * @file pmta_merge.h
+ * @brief Exposes @c PmtaMergeTemplate class (client-side mail merge)
+ * @details
+@code{.php}
+final class PmtaMergeTemplate
+{
+	public function __construct($body);
+	public function __destruct();
+	public function getPlaceholders();
+	public function render(array $vars);
+	public function renderTo(PmtaMessage $message, array $vars);
+	private function __clone();
+}
+@endcode
+ */
+
+#ifdef DOXYGEN
+#	undef PMTA_MERGE_H
+#endif
+
+#ifndef PMTA_MERGE_H
+#define PMTA_MERGE_H
+
+#include "php_pmta.h"
+
+/**
+ * @brief Registers @c PmtaMergeTemplate class
+ * @param tsrm_ls Internally used by Zend
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmtamerge_register_class(TSRMLS_D);
+
+#endif /* PMTA_MERGE_H */
@@ -16,7 +16,13 @@ class PmtaMessage
 	const ENCODING_8BIT   = PmtaMsgENCODING_8BIT;
 	const ENCODING_BASE64 = PmtaMsgENCODING_BASE64;
 
+	const CANON_CRLF        = 1;
+	const CANON_DOTS        = 2;
+	const CANON_LINE_LENGTH = 4;
+	const CANON_ALL         = 7;
+
 	private $message;
+	private $body = array();
 
 	private $originator;
 	private $verp;
@@ -26,13 +32,19 @@ class PmtaMessage
 	private $jobid;
 	private $encoding;
 	private $recipients;
+	private $retain_recipients;
+	private $recipients_digest;
+	private $canonicalize = 0;
+	private $cloneable = false;
 
 	public function __construct($originator)
 	{
 		$this->message = PmtaMsgAlloc();
 
 		if (PmtaMsgInit($this->message, $originator)) {
-			$this->originator = $originator;
+			$this->originator        = $originator;
+			$this->retain_recipients = (bool)ini_get('pmta.retain_recipients');
+			$this->recipients_digest = FNV1a_64_INIT;
 		}
 		else {
 			throw new PmtaErrorMessage(PmtaMsgGetLastError($this->message), PmtaMsgGetLastErrorType($this->message));
@@ -46,10 +58,11 @@ class PmtaMessage
 
 	public function __get($property)
 	{
-		$properties = array('originator', 'verp', 'return_type', 'envelope_id', 'vmta', 'jobid', 'encoding', 'recipients');
+		$properties = array('originator', 'verp', 'return_type', 'envelope_id', 'vmta', 'jobid', 'encoding', 'recipients', 'retain_recipients', 'recipients_digest', 'canonicalize', 'cloneable');
 		for ($i=0; $i<count($properties); ++$i) {
 			if ($property == $properties[$i]) {
-				return $this->$property;
+				// recipients are not copied: PmtaRecipientsView shares the array with the message
+				return ('recipients' == $property) ? new PmtaRecipientsView($this->recipients) : $this->$property;
 			}
 		}
 
@@ -58,7 +71,7 @@ class PmtaMessage
 
 	public function __isset($property)
 	{
-		$properties = array('originator', 'verp', 'return_type', 'envelope_id', 'vmta', 'jobid', 'encoding', 'recipients');
+		$properties = array('originator', 'verp', 'return_type', 'envelope_id', 'vmta', 'jobid', 'encoding', 'recipients', 'retain_recipients', 'recipients_digest', 'canonicalize', 'cloneable');
 		for ($i=0; $i<count($properties); ++$i) {
 			if ($property == $properties[$i]) {
 				return true;
@@ -77,6 +90,17 @@ class PmtaMessage
 			case 'vmta':        $res = PmtaMsgSetVirtualMta($this->message, $value); break;
 			case 'jobid':       $res = PmtaMsgSetJobId($this->message, $value); break;
 			case 'encoding':    $res = PmtaMsgSetEncoding($this->message, $value); break;
+			case 'retain_recipients': $this->retain_recipients = (bool)$value; return;
+			case 'canonicalize':      $this->canonicalize      = $value & self::CANON_ALL; return;
+			case 'cloneable':
+				// PmtaMsg cannot be copied: a cloneable message keeps its body in the journal
+				if ($value && $this->body_added_directly) {
+					throw new PmtaErrorMessage('The body has already been added to the message', PmtaApiERROR_IllegalState);
+				}
+
+				$this->cloneable = (bool)$value;
+				return;
+
 			default:
 				trigger_error("Cannot set property PmtaMessage::{$property}", E_USER_WARNING);
 				return;
@@ -89,24 +113,120 @@ class PmtaMessage
 		$this->$property = $value;
 	}
 
+	// Body operations go directly to PmtaMsg. They are also recorded in $this->body if the message is cloneable;
+	// while $this->body has operations not applied yet (a clone before submission, spilled data),
+	// they are only recorded and applied when the message is submitted
 	public function beginPart($number)
 	{
-		return PmtaMsgBeginPart($this->message, $number);
+		return $this->bodyOp('PmtaMsgBeginPart', $number);
 	}
 
 	public function addData($data)
 	{
-		return PmtaMsgAddData($this->message, $data, strlen($data));
+		if ($this->canonicalize & self::CANON_CRLF) {
+			$data = preg_replace('/\r\n|\r|\n/', "\r\n", $data);
+		}
+
+		if ($this->canonicalize & self::CANON_DOTS) {
+			// The state is kept between calls: a line may start in one call and continue in the next one
+			$data = preg_replace('/^\./m', '..', $data);
+		}
+
+		if (($this->canonicalize & self::CANON_LINE_LENGTH) && preg_match('/^[^\r\n]{999}/m', $data)) {
+			throw new PmtaErrorMessage('Line is longer than 998 characters', PmtaApiERROR_IllegalArgument);
+		}
+
+		return $this->bodyOp('PmtaMsgAddData', $data);
+	}
+
+	public function addDataParts(array $parts)
+	{
+		return $this->addData(implode('', $parts));
+	}
+
+	public function addBase64Data($data)
+	{
+		return $this->addData(chunk_split(base64_encode($data)));
+	}
+
+	public function addQuotedPrintableData($data)
+	{
+		return $this->addData(quoted_printable_encode(preg_replace('/\r?\n/', "\r\n", $data)));
+	}
+
+	public function addFile($path, $encoding = self::ENCODING_BASE64)
+	{
+		// The file is read and encoded chunk by chunk, the data is added as with addData()
+		$f = fopen($path, 'rb');
+		if (!$f) {
+			throw new PmtaErrorMessage('Unable to read the file', PmtaApiERROR_IO);
+		}
+
+		while (!feof($f)) {
+			$chunk = fread($f, 57 * 1024);
+			if (!$this->bodyOp('PmtaMsgAddData', (self::ENCODING_BASE64 == $encoding) ? chunk_split(base64_encode($chunk)) : $chunk)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	public function addStream($stream, $maxlen = -1)
+	{
+		$data = stream_get_contents($stream, $maxlen);
+		return $this->addData($data) ? strlen($data) : false;
 	}
 
 	public function addMergeData($data)
 	{
-		return PmtaMsgAddMergeData($this->message, $data, strlen($data));
+		return $this->bodyOp('PmtaMsgAddMergeData', $data);
 	}
 
 	public function addDateHeader()
 	{
-		return PmtaMsgAddDateHeader($this->message);
+		return $this->bodyOp('PmtaMsgAddDateHeader');
+	}
+
+	public function addDateAndMessageId($domain)
+	{
+		// The Date header is formatted once per second; the PID is refreshed after pcntl_fork()
+		$id = sprintf('<%x.%x.%x.%x@%s>', time(), getmypid(), ++self::$counter, HOST_SEED, $domain);
+		return $this->addData('Date: ' . gmdate('D, d M Y H:i:s') . " +0000\r\nMessage-ID: {$id}\r\n") ? $id : false;
+	}
+
+	public function addCachedPart($key, $data = null)
+	{
+		// The part is stored once per process; a part made of different data is replaced
+		$key = $this->canonicalize . $key;
+		if (!isset(self::$part_cache[$key]) || (null !== $data && self::$part_cache[$key]['digest'] !== fnv1a_64($data))) {
+			if (null === $data) {
+				return false;
+			}
+
+			self::$part_cache[$key] = array('data' => canonicalize($data, $this->canonicalize), 'digest' => fnv1a_64($data));
+		}
+
+		// The canonicalization state continues from the end of the part
+		return $this->bodyOp('PmtaMsgAddData', self::$part_cache[$key]['data']);
+	}
+
+	public static function clearPartCache()
+	{
+		$entries = count(self::$part_cache);
+		self::$part_cache = array();
+		return $entries;
+	}
+
+	public static function getPartCacheStats()
+	{
+		return array('hits' => HITS, 'misses' => MISSES, 'entries' => count(self::$part_cache), 'size' => SIZE, 'limit' => ini_get('pmta.part_cache_size'));
+	}
+
+	public function addTemplate(PmtaTemplate $template)
+	{
+		// Only a reference to the compiled parts in the template storage is recorded
+		return $this->bodyOp('template', $template);
 	}
 
 	public function addRecipient(PmtaRecipient $recipient)
@@ -114,27 +234,129 @@ class PmtaMessage
 		$res = PmtaMsgAddRecipient($this->message, $recipient);
 		if ($res) {
 			unset($recipient->recipient);
-			$this->recipients[] = $recipient;
+			$this->recipients_digest = fnv1a_64($this->recipients_digest, $recipient->address . "\0");
+			if ($this->retain_recipients) {
+				$this->recipients[] = $recipient;
+			}
+			else {
+				++$this->bulk_rcpts;
+			}
+
 			return true;
 		}
 
 		return false;
 	}
 
+	public function addRecipients(array $recipients)
+	{
+		$added = 0;
+		foreach ($recipients as $row) {
+			$r = new PmtaRecipient(is_array($row) ? $row['address'] : $row);
+			// notify and vars are applied to the PmtaRcpt, no PmtaRecipient object is kept
+			PmtaMsgAddRecipient($this->message, $r);
+			++$added;
+		}
+
+		return $added;
+	}
+
+	public function addRecipientsFromCsv($path, array $columns, $offset = 0, $limit = 0, $delimiter = ',')
+	{
+		$f = fopen($path, 'rb');
+		if (!$f) {
+			return false;
+		}
+
+		$header = array_filter(array_keys($columns), 'is_string') ? fgetcsv($f, 0, $delimiter) : null;
+		fseek($f, $offset);
+
+		$rows = 0;
+		while ((!$limit || $rows < $limit) && ($row = fgetcsv($f, 0, $delimiter))) {
+			// map columns to address, notify and variables; PmtaMsgAddRecipient() as in addRecipients()
+			++$rows;
+		}
+
+		return array('rows' => $rows, 'offset' => ftell($f), 'eof' => feof($f));
+	}
+
+	public function addRecipientList(PmtaRecipientList $list)
+	{
+		for ($i=0; $i<count($list); ++$i) {
+			$r = $list->get($i);
+			// PmtaRcpt is created from $r, added with PmtaMsgAddRecipient() and freed
+		}
+
+		return count($list);
+	}
+
+	public function recipientCount()
+	{
+		// Recipients which are not kept in $this->recipients are counted too
+		return count($this->recipients) + $this->bulk_rcpts;
+	}
+
+	public function memoryUsage()
+	{
+		// Body data kept in memory by the extension and already passed to $this->message; spilled data is not counted
+		return JOURNAL_SIZE + APPLIED_BODY_SIZE;
+	}
+
+	public function bodySize()
+	{
+		// Counted as the data is added, whether it went to $this->message or to $this->body
+		return BODY_SIZE;
+	}
+
+	public function reset($originator)
+	{
+		// A used PmtaMsg cannot be cleared, so the handle is not recycled
+		$message = PmtaMsgAlloc();
+		if (!PmtaMsgInit($message, $originator)) {
+			throw new PmtaErrorMessage(PmtaMsgGetLastError($message), PmtaMsgGetLastErrorType($message));
+		}
+
+		PmtaMsgFree($this->message);
+		$this->message     = $message;
+		$this->originator  = $originator;
+		$this->envelope_id = $this->vmta = $this->jobid = null;
+		$this->return_type = $this->encoding = $this->verp = 0;
+		$this->recipients  = array();
+		$this->recipients_digest = FNV1a_64_INIT;
+		return true;
+	}
+
 	public function getLastError()
 	{
 		return new PmtaErrorMessage(PmtaMsgGetLastError($this->message), PmtaMsgGetLastErrorType($this->message));
 	}
 
-	private function __clone() {}
+	public function __clone()
+	{
+		if ($this->body_added_directly) {
+			throw new PmtaErrorMessage('The message cannot be cloned: its body has been added before $cloneable was set', PmtaApiERROR_IllegalState);
+		}
+
+		// The body journal is shared with the original and applied when the clone is submitted, recipients are not
+		$this->message = PmtaMsgAlloc();
+		PmtaMsgInit($this->message, $this->originator);
+		// envelope_id, vmta, jobid, return_type, encoding and verp are applied to the new PmtaMsg
+		$this->recipients = array();
+	}
 }
 @endcode
  */
 
 #include "pmta_message.h"
 #include "pmta_recipient.h"
+#include "pmta_recipient_list.h"
+#include "pmta_recipients_view.h"
+#include "pmta_body.h"
+#include "pmta_template.h"
 #include "pmta_error.h"
 #include "pmta_common.h"
+#include "pmta_csv.h"
+#include "pmta_encode.h"
 
 /**
  * @brief @c PmtaMessage object handlers
@@ -145,18 +367,44 @@ static zend_object_handlers pmtamsg_object_handlers;
  * @brief Internal properties of @c PmtaMessage
  */
 typedef struct _pmtamsg_object {
-	zend_object obj;        /**< Zend object data */
-	PmtaMsg msg;            /**< PMTA Message handle */
-	char* originator;       /**< Sender */
-	char* envid;            /**< EnvID */
-	char* vmta;             /**< Virtual MTA */
-	char* jobid;            /**< JobID */
-	HashTable* recipients;  /**< Recipients */
-	int rettype;            /**< Return type */
-	int encoding;           /**< Message encoding */
-	int verp;               /**< Whether VERP should be used */
+	zend_object obj;              /**< Zend object data */
+	PmtaMsg msg;                  /**< PMTA Message handle */
+	char* originator;             /**< Sender */
+	char* envid;                  /**< EnvID */
+	char* vmta;                   /**< Virtual MTA */
+	char* jobid;                  /**< JobID */
+	char* first_rcpt;             /**< Address of the first recipient */
+	HashTable* recipients;        /**< Recipients (<tt>Z_ARRVAL_P(rcpt_array)</tt>) */
+	zval* rcpt_array;             /**< Array holding @c recipients; shared with @c PmtaRecipientsView */
+	int rettype;                  /**< Return type */
+	int encoding;                 /**< Message encoding */
+	int verp;                     /**< Whether VERP should be used */
+	int flags;                    /**< Which of @c rettype, @c encoding and @c verp have been set (@c PMTAMSG_HAS_*) */
+	pmta_body* body;              /**< Body journal, may be shared with clones; @c NULL while the body goes directly to @c msg */
+	size_t body_len;              /**< Length of this message's part of @c body */
+	size_t body_applied;          /**< Length of the part of @c body already applied to @c msg */
+	size_t body_size;             /**< Number of body bytes added so far */
+	size_t applied_size;          /**< Number of body bytes already passed to @c msg */
+	int cloneable;                /**< Whether the body is journaled so that the message can be cloned */
+	int body_direct;              /**< Whether @c msg has body data which is not in @c body */
+	int locked;                   /**< Number of pending background submissions */
+	pmta_job* job;                /**< Pending background submission, @c NULL if none */
+	int retain;                   /**< Whether @c addRecipient() keeps @c PmtaRecipient objects in @c recipients */
+	long int bulk_rcpts;          /**< Number of recipients not kept in @c recipients */
+	pmta_uint64 digest;           /**< Rolling digest of the addresses of all recipients */
+	int canon;                    /**< Canonicalization of the data added with @c addData() (@c pmta_canon_flags) */
+	pmta_canon_state canon_state; /**< Canonicalization state at the end of the data added so far */
 } pmtamsg_object;
 
+/**
+ * @brief @c pmtamsg_object::flags
+ */
+enum {
+	PMTAMSG_HAS_RETTYPE  = 1, /**< @c return_type has been set */
+	PMTAMSG_HAS_ENCODING = 2, /**< @c encoding has been set */
+	PMTAMSG_HAS_VERP     = 4  /**< @c verp has been set */
+};
+
 /**
  * @brief Fetches @c pmtamsg_object
  * @see pmtamsg_object
@@ -174,18 +422,354 @@ PmtaMsg getMessage(zval* object TSRMLS_DC)
 	return fetchPmtaMsgObject(object TSRMLS_CC)->msg;
 }
 
+/**
+ * @brief Applies the records of the journal which have not been applied to @c msg yet
+ * @param obj @c pmtamsg_object
+ * @param error Error message if a file could not be read, @c NULL otherwise (output)
+ * @return @c SUCCESS or @c FAILURE (see @c pmta_body_replay())
+ */
+static int pmtamsg_replay(pmtamsg_object* obj, const char** error)
+{
+	size_t from = obj->body_applied;
+	int result  = pmta_body_replay(obj->body, &obj->body_applied, obj->body_len, obj->msg, error);
+
+	obj->applied_size += pmta_body_size(obj->body, from, obj->body_applied);
+	return result;
+}
+
+/**
+ * @brief Drops the journal once all of its records have been applied, unless the message is cloneable
+ * @param obj @c pmtamsg_object
+ */
+static void pmtamsg_trim(pmtamsg_object* obj)
+{
+	if (obj->body && !obj->cloneable && obj->body_applied == obj->body_len) {
+		if (obj->body_len) {
+			obj->body_direct = 1;
+		}
+
+		pmta_body_release(obj->body);
+		obj->body         = NULL;
+		obj->body_len     = 0;
+		obj->body_applied = 0;
+	}
+}
+
+/**
+ * @brief Moves the data record just appended to the spill file once the body exceeds @c pmta.body_spill_threshold
+ * @param obj @c pmtamsg_object
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the record has been moved (@c SUCCESS); if the spill file cannot be written, the data stays in memory
+ */
+static int pmtamsg_spill(pmtamsg_object* obj TSRMLS_DC)
+{
+	if (PMTA_G(spill_threshold) > 0 && obj->applied_size + obj->body_len > (size_t)PMTA_G(spill_threshold)) {
+		return pmta_body_spill(obj->body, &obj->body_len, obj->body_applied);
+	}
+
+	return FAILURE;
+}
+
+/**
+ * @brief Applies the record just appended to the journal, unless it has to wait for the submission
+ * @param obj @c pmtamsg_object
+ * @param start Offset of the record
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE (the record is removed; the error is available from @c PmtaMsgGetLastError()
+ * unless @c PmtaErrorMessage has been thrown)
+ * @details The record waits if it has been moved to the spill file or if earlier records have not been applied yet.
+ * Otherwise it is applied at once, and the journal is dropped unless the message is cloneable.
+ */
+static int pmtamsg_recorded(pmtamsg_object* obj, size_t start TSRMLS_DC)
+{
+	const char* error;
+	size_t size;
+
+	if (start == obj->body_len) {
+		/* Empty record, dropped by pmta_body_finish() */
+		pmtamsg_trim(obj);
+		return SUCCESS;
+	}
+
+	size            = pmta_body_size(obj->body, start, obj->body_len);
+	obj->body_size += size;
+	if (SUCCESS == pmtamsg_spill(obj TSRMLS_CC) || obj->body_applied < start) {
+		return SUCCESS;
+	}
+
+	if (FAILURE == pmtamsg_replay(obj, &error)) {
+		pmta_body_truncate(obj->body, &obj->body_len, start);
+		obj->body_applied = start;
+		obj->body_size   -= size;
+		pmtamsg_trim(obj);
+		if (error) {
+			throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IO, error, NULL TSRMLS_CC);
+		}
+
+		return FAILURE;
+	}
+
+	pmtamsg_trim(obj);
+	return SUCCESS;
+}
+
+/**
+ * @brief Adds a body operation: applies it to @c msg directly or records it in the journal
+ * @param obj @c pmtamsg_object
+ * @param op Operation
+ * @param data Payload
+ * @param n Length of @a data
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE (see @c pmtamsg_recorded())
+ * @details The operation is recorded if the message is cloneable, if the journal has records which have not been
+ * applied yet (the order must be kept), or if it is data that would take the body past @c pmta.body_spill_threshold
+ */
+static int pmtamsg_body_op(pmtamsg_object* obj, enum pmta_body_op op, const char* data, size_t n TSRMLS_DC)
+{
+	const char* error;
+	size_t start;
+	size_t size;
+
+	if (
+		   !obj->cloneable
+		&& obj->body_applied == obj->body_len
+		&& (PMTA_BODY_DATA != op || PMTA_G(spill_threshold) <= 0 || obj->applied_size + n <= (size_t)PMTA_G(spill_threshold))
+	) {
+		if (FAILURE == pmta_body_apply(op, data, n, obj->msg, &error)) {
+			if (error) {
+				throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IO, error, NULL TSRMLS_CC);
+			}
+
+			return FAILURE;
+		}
+
+		size               = pmta_body_record_size(op, data, n);
+		obj->body_direct   = 1;
+		obj->body_size    += size;
+		obj->applied_size += size;
+		return SUCCESS;
+	}
+
+	start     = obj->body_len;
+	obj->body = pmta_body_append(obj->body, &obj->body_len, op, data, n);
+	return pmtamsg_recorded(obj, start TSRMLS_CC);
+}
+
+/**
+ * @brief Starts a data record whose payload is written by the caller
+ * @param obj @c pmtamsg_object
+ * @param max Maximum length of the payload
+ * @param data Where to write the payload (output)
+ * @return Offset of the record, to be passed to @c pmtamsg_finish()
+ * @note The journal serves as the scratch buffer even if the data then goes directly to @c msg
+ */
+static size_t pmtamsg_reserve(pmtamsg_object* obj, size_t max, char** data)
+{
+	size_t start = obj->body_len;
+
+	obj->body = pmta_body_reserve(obj->body, &obj->body_len, PMTA_BODY_DATA, max, data);
+	return start;
+}
+
+/**
+ * @brief Completes the record started with @c pmtamsg_reserve() and applies it (see @c pmtamsg_recorded())
+ * @param obj @c pmtamsg_object
+ * @param start Offset returned by @c pmtamsg_reserve()
+ * @param max Maximum length of the payload
+ * @param n Actual length of the payload; the record is removed if @a n is 0
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE
+ */
+static int pmtamsg_finish(pmtamsg_object* obj, size_t start, size_t max, size_t n TSRMLS_DC)
+{
+	pmta_body_finish(obj->body, &obj->body_len, max, n);
+	return pmtamsg_recorded(obj, start TSRMLS_CC);
+}
+
+int flush_message(zval* object, int* code, const char** error TSRMLS_DC)
+{
+	pmtamsg_object* obj = fetchPmtaMsgObject(object TSRMLS_CC);
+
+	if (obj->body_applied == obj->body_len) {
+		return SUCCESS;
+	}
+
+	if (FAILURE == pmtamsg_replay(obj, error)) {
+		if (*error) {
+			*code = PmtaApiERROR_IO;
+		}
+		else {
+			*code  = PmtaMsgGetLastErrorType(obj->msg);
+			*error = PmtaMsgGetLastError(obj->msg);
+		}
+
+		return FAILURE;
+	}
+
+	pmtamsg_trim(obj);
+	return SUCCESS;
+}
+
+const char* getMessageOriginator(zval* object TSRMLS_DC)
+{
+	return fetchPmtaMsgObject(object TSRMLS_CC)->originator;
+}
+
+const char* getMessageJobId(zval* object TSRMLS_DC)
+{
+	return fetchPmtaMsgObject(object TSRMLS_CC)->jobid;
+}
+
+const char* getMessageVirtualMta(zval* object TSRMLS_DC)
+{
+	return fetchPmtaMsgObject(object TSRMLS_CC)->vmta;
+}
+
+const char* getMessageFirstRecipient(zval* object TSRMLS_DC)
+{
+	return fetchPmtaMsgObject(object TSRMLS_CC)->first_rcpt;
+}
+
+void lock_message(zval* object, pmta_job* job TSRMLS_DC)
+{
+	pmtamsg_object* obj = fetchPmtaMsgObject(object TSRMLS_CC);
+
+	++obj->locked;
+	obj->job = job;
+	pmta_job_addref(job);
+}
+
+void unlock_message(zval* object TSRMLS_DC)
+{
+	pmtamsg_object* obj = fetchPmtaMsgObject(object TSRMLS_CC);
+
+	--obj->locked;
+	if (obj->job) {
+		pmta_job_release(obj->job);
+		obj->job = NULL;
+	}
+}
+
+int is_message_locked(zval* object TSRMLS_DC)
+{
+	return fetchPmtaMsgObject(object TSRMLS_CC)->locked;
+}
+
+/**
+ * @brief Throws @c PmtaErrorMessage if the message is being submitted in the background
+ * @param obj @c pmtamsg_object
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the message can be modified
+ */
+static int pmtamsg_check_unlocked(pmtamsg_object* obj TSRMLS_DC)
+{
+	if (UNEXPECTED(obj->locked)) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_PHP_API, "Cannot modify the message while it is being submitted", NULL TSRMLS_CC);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Appends data to the body, canonicalizing it according to @c obj->canon
+ * @param obj @c pmtamsg_object
+ * @param data Data
+ * @param len Length of @a data
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE if a line is too long (nothing is appended, the exception has been thrown)
+ * or the data has not been accepted (see @c pmtamsg_recorded())
+ * @throw pmta_error_message_class
+ */
+static int pmtamsg_append_data(pmtamsg_object* obj, const char* data, size_t len TSRMLS_DC)
+{
+	pmta_canon_state state;
+	size_t start;
+	char* p;
+	size_t n;
+
+	if (!obj->canon) {
+		return pmtamsg_body_op(obj, PMTA_BODY_DATA, data, len TSRMLS_CC);
+	}
+
+	state = obj->canon_state;
+	start = pmtamsg_reserve(obj, 2 * len, &p);
+	n     = pmta_canonicalize(&state, obj->canon, data, len, p);
+
+	if ((size_t)-1 == n) {
+		pmtamsg_finish(obj, start, 2 * len, 0 TSRMLS_CC);
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalArgument, "Line is longer than 998 characters", NULL TSRMLS_CC);
+		return FAILURE;
+	}
+
+	if (FAILURE == pmtamsg_finish(obj, start, 2 * len, n TSRMLS_CC)) {
+		return FAILURE;
+	}
+
+	obj->canon_state = state;
+	return SUCCESS;
+}
+
+int append_message_data(zval* object, const char* data, size_t len TSRMLS_DC)
+{
+	pmtamsg_object* obj = fetchPmtaMsgObject(object TSRMLS_CC);
+
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		return FAILURE;
+	}
+
+	if (FAILURE == pmtamsg_append_data(obj, data, len TSRMLS_CC)) {
+		if (!EG(exception)) {
+			throw_pmta_error(pmta_error_message_class, PmtaMsgGetLastErrorType(obj->msg), PmtaMsgGetLastError(obj->msg), NULL TSRMLS_CC);
+		}
+
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief Remembers the first recipient and updates the digest
+ * @param obj @c pmtamsg_object
+ * @param address Address of the recipient that has been added to the message
+ */
+static void pmtamsg_track_recipient(pmtamsg_object* obj, const char* address)
+{
+	if (!obj->first_rcpt) {
+		obj->first_rcpt = estrdup(address);
+	}
+
+	obj->digest = pmta_digest_update(obj->digest, address, strlen(address));
+}
+
+/**
+ * @brief Formats the recipient digest
+ * @param zv Result (16 hex digits)
+ * @param digest Digest
+ */
+static void pmtamsg_format_digest(zval* zv, pmta_uint64 digest)
+{
+	char buf[17];
+
+	snprintf(buf, sizeof(buf), "%08lx%08lx", (unsigned long int)(digest >> 32), (unsigned long int)(digest & 0xFFFFFFFFU));
+	ZVAL_STRINGL(zv, buf, 16, 1);
+}
+
 /**
  * @brief Internal implementation of @c __get() method
  * @see pmtamsg_object
  * @param obj @c pmtamsg_object
  * @param member Property to read
  * @param type If @c BP_VAR_IS, error messages will be suppressed
+ * @param tsrm_ls Internally used by Zend
  * @return Property value
  * @exception @c E_WARNING if @c member is not a valid property and @a type != @c BP_VAR_IS
  * @pre <tt>Z_TYPE_P(member) == IS_STRING</tt>
  * @note Reference count of the result value will be 0
+ * @note @c recipients is returned as @c PmtaRecipientsView, the recipients are not copied
  */
-static zval* pmtamsg_read_property_internal(pmtamsg_object* obj, zval* member, int type)
+static zval* pmtamsg_read_property_internal(pmtamsg_object* obj, zval* member, int type TSRMLS_DC)
 {
 	zval* ret;
 	MAKE_STD_ZVAL(ret);
@@ -212,13 +796,28 @@ static zval* pmtamsg_read_property_internal(pmtamsg_object* obj, zval* member, i
 		ZVAL_LONG(ret, obj->verp);
 	}
 	else if (ISSTR(member, "recipients")) {
-		zval* tmp;
-		array_init_size(ret, zend_hash_num_elements(obj->recipients));
-		zend_hash_copy(Z_ARRVAL_P(ret), obj->recipients, (copy_ctor_func_t)zval_add_ref, (void*)&tmp, sizeof(zval*));
-	}
-	else {
-		if (type != BP_VAR_IS) {
-			zend_error(E_WARNING, "Undefined property PmtaMessage::%s", Z_STRVAL_P(member));
+		if (obj->rcpt_array) {
+			pmtaview_create(ret, obj->rcpt_array TSRMLS_CC);
+		}
+		else {
+			ZVAL_NULL(ret);
+		}
+	}
+	else if (ISSTR(member, "retain_recipients")) {
+		ZVAL_BOOL(ret, obj->retain);
+	}
+	else if (ISSTR(member, "recipients_digest")) {
+		pmtamsg_format_digest(ret, obj->digest);
+	}
+	else if (ISSTR(member, "canonicalize")) {
+		ZVAL_LONG(ret, obj->canon);
+	}
+	else if (ISSTR(member, "cloneable")) {
+		ZVAL_BOOL(ret, obj->cloneable);
+	}
+	else {
+		if (type != BP_VAR_IS) {
+			zend_error(E_WARNING, "Undefined property PmtaMessage::%s", Z_STRVAL_P(member));
 		}
 
 		ZVAL_NULL(ret);
@@ -254,7 +853,7 @@ static zval* pmtamsg_read_property(zval* object, zval* member, int type ZLK_DC T
 		member = &tmp;
 	}
 
-	ret = pmtamsg_read_property_internal(obj, member, type);
+	ret = pmtamsg_read_property_internal(obj, member, type TSRMLS_CC);
 
 	if (UNEXPECTED(member == &tmp)) {
 		zval_dtor(&tmp);
@@ -334,6 +933,24 @@ static int pmtamsg_has_property_internal(pmtamsg_object* obj, zval* member, int
 			retval = (obj->recipients && zend_hash_num_elements(obj->recipients));
 		}
 	}
+	else if (ISSTR(member, "retain_recipients")) {
+		if (1 == has_set_exists) {
+			retval = (obj->retain != 0);
+		}
+	}
+	else if (ISSTR(member, "recipients_digest")) {
+		/* Always set */
+	}
+	else if (ISSTR(member, "canonicalize")) {
+		if (1 == has_set_exists) {
+			retval = (obj->canon != 0);
+		}
+	}
+	else if (ISSTR(member, "cloneable")) {
+		if (1 == has_set_exists) {
+			retval = (obj->cloneable != 0);
+		}
+	}
 	else {
 		retval = 0;
 	}
@@ -395,9 +1012,14 @@ static void pmtamsg_write_property_internal(pmtamsg_object* obj, zval* member, z
 {
 	BOOL res;
 
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		return;
+	}
+
 	if (ISSTR(member, "encoding") || ISSTR(member, "return_type") || ISSTR(member, "verp")) {
 		long int v;
 		int* property;
+		int flag;
 
 		if (Z_TYPE_P(value) == IS_LONG) {
 			v = Z_LVAL_P(value);
@@ -411,17 +1033,18 @@ static void pmtamsg_write_property_internal(pmtamsg_object* obj, zval* member, z
 		}
 
 		switch (Z_STRVAL_P(member)[0]) {
-			case 'e': res = PmtaMsgSetEncoding(obj->msg, (PmtaMsgENCODING)v); property = &obj->encoding; break;
-			case 'r': res = PmtaMsgSetReturnType(obj->msg, (PmtaMsgRETURN)v); property = &obj->rettype;  break;
-			case 'v': res = PmtaMsgSetVerp(obj->msg, v ? TRUE : FALSE);       property = &obj->verp;     break;
-			default:  res = FALSE; property = NULL; break;
+			case 'e': res = PmtaMsgSetEncoding(obj->msg, (PmtaMsgENCODING)v); property = &obj->encoding; flag = PMTAMSG_HAS_ENCODING; break;
+			case 'r': res = PmtaMsgSetReturnType(obj->msg, (PmtaMsgRETURN)v); property = &obj->rettype;  flag = PMTAMSG_HAS_RETTYPE;  break;
+			case 'v': res = PmtaMsgSetVerp(obj->msg, v ? TRUE : FALSE);       property = &obj->verp;     flag = PMTAMSG_HAS_VERP;     break;
+			default:  res = FALSE; property = NULL; flag = 0; break;
 		}
 
 		if (FALSE == res) {
 			throw_pmta_error(pmta_error_message_class, PmtaMsgGetLastErrorType(obj->msg), PmtaMsgGetLastError(obj->msg), NULL TSRMLS_CC);
 		}
 		else {
-			*property = v;
+			*property   = v;
+			obj->flags |= flag;
 		}
 	}
 	else if (ISSTR(member, "envelope_id") || ISSTR(member, "vmta") || ISSTR(member, "jobid")) {
@@ -457,6 +1080,25 @@ static void pmtamsg_write_property_internal(pmtamsg_object* obj, zval* member, z
 			*property = v;
 		}
 	}
+	else if (ISSTR(member, "retain_recipients")) {
+		obj->retain = zend_is_true(value);
+	}
+	else if (ISSTR(member, "canonicalize")) {
+		zval tmp;
+
+		ZVAL_ZVAL(&tmp, value, 1, 0);
+		convert_to_long(&tmp);
+		obj->canon = (int)(Z_LVAL(tmp) & PMTA_CANON_ALL);
+	}
+	else if (ISSTR(member, "cloneable")) {
+		if (zend_is_true(value) && obj->body_direct) {
+			throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalState, "The body has already been added to the message", NULL TSRMLS_CC);
+		}
+		else {
+			obj->cloneable = zend_is_true(value);
+			pmtamsg_trim(obj);
+		}
+	}
 	else {
 		zend_error(E_WARNING, "Cannot set property PmtaMessage::%s", Z_STRVAL_P(member));
 	}
@@ -505,7 +1147,6 @@ static HashTable* pmtamsg_get_properties(zval* object TSRMLS_DC)
 	pmtamsg_object* obj = fetchPmtaMsgObject(object TSRMLS_CC);
 	HashTable* props    = zend_std_get_properties(object TSRMLS_CC);
 	zval* zv;
-	zval* tmp;
 
 	if (obj->originator) {
 		MAKE_STD_ZVAL(zv);
@@ -543,10 +1184,27 @@ static HashTable* pmtamsg_get_properties(zval* object TSRMLS_DC)
 	ZVAL_LONG(zv, obj->verp);
 	zend_hash_update(props, "verp", sizeof("verp"), &zv, sizeof(zval*), NULL);
 
+	if (obj->rcpt_array) {
+		MAKE_STD_ZVAL(zv);
+		pmtaview_create(zv, obj->rcpt_array TSRMLS_CC);
+		zend_hash_update(props, "recipients", sizeof("recipients"), (void*)&zv, sizeof(zval*), NULL);
+	}
+
+	MAKE_STD_ZVAL(zv);
+	ZVAL_BOOL(zv, obj->retain);
+	zend_hash_update(props, "retain_recipients", sizeof("retain_recipients"), &zv, sizeof(zval*), NULL);
+
+	MAKE_STD_ZVAL(zv);
+	pmtamsg_format_digest(zv, obj->digest);
+	zend_hash_update(props, "recipients_digest", sizeof("recipients_digest"), &zv, sizeof(zval*), NULL);
+
+	MAKE_STD_ZVAL(zv);
+	ZVAL_LONG(zv, obj->canon);
+	zend_hash_update(props, "canonicalize", sizeof("canonicalize"), &zv, sizeof(zval*), NULL);
+
 	MAKE_STD_ZVAL(zv);
-	array_init_size(zv, zend_hash_num_elements(obj->recipients));
-	zend_hash_copy(Z_ARRVAL_P(zv), obj->recipients, (copy_ctor_func_t)zval_add_ref, (void*)&tmp, sizeof(zval*));
-	zend_hash_update(props, "recipients", sizeof("recipients"), (void*)&zv, sizeof(zval*), NULL);
+	ZVAL_BOOL(zv, obj->cloneable);
+	zend_hash_update(props, "cloneable", sizeof("cloneable"), &zv, sizeof(zval*), NULL);
 
 	return props;
 }
@@ -555,20 +1213,30 @@ static HashTable* pmtamsg_get_properties(zval* object TSRMLS_DC)
  * @brief @c PmtaMessage destructor
  * @param v @c pmtamsg_object
  * @param tsrm_ls Internally used by Zend
- * @details Frees all memory allocated for @c pmtamsg_object and its members
+ * @details Frees all memory allocated for @c pmtamsg_object and its members. At the end of the request the message
+ * may be freed while its background submission is pending; the worker is then waited for before @c msg is freed.
  */
 static void pmtamsg_dtor(void* v TSRMLS_DC)
 {
 	pmtamsg_object* obj = v;
 
+	if (obj->job) {
+		pmta_job_detach_message(obj->job);
+		pmta_job_release(obj->job);
+	}
+
 	if (obj->originator) { efree(obj->originator); }
 	if (obj->envid)      { efree(obj->envid);      }
 	if (obj->jobid)      { efree(obj->jobid);      }
 	if (obj->vmta)       { efree(obj->vmta);       }
+	if (obj->first_rcpt) { efree(obj->first_rcpt); }
 	if (obj->msg)        { PmtaMsgFree(obj->msg);  }
-	if (obj->recipients) {
-		zend_hash_destroy(obj->recipients);
-		FREE_HASHTABLE(obj->recipients);
+	if (obj->rcpt_array) {
+		zval_ptr_dtor(&obj->rcpt_array);
+	}
+
+	if (obj->body) {
+		pmta_body_release(obj->body);
 	}
 
 	zend_object_std_dtor(&(obj->obj) TSRMLS_CC);
@@ -599,259 +1267,1512 @@ static zend_object_value pmtamsg_ctor(zend_class_entry* ce TSRMLS_DC)
 		NULL TSRMLS_CC
 	);
 
-	retval.handlers = &pmtamsg_object_handlers;
+	retval.handlers = &pmtamsg_object_handlers;
+
+	return retval;
+}
+
+/**
+ * @brief @c clone_obj handler
+ * @param object @c PmtaMessage instance
+ * @param tsrm_ls Internally used by Zend
+ * @return Zend Object Value of the clone
+ * @details The clone gets a new @c PmtaMsg with the same originator and envelope settings, shares the body
+ * journal with @a object and starts with no recipients. The body is applied to the new @c PmtaMsg when the clone
+ * is submitted; until then the body operations of the clone are journaled too.
+ * @throw pmta_error_message_class if the body of @a object has been added before @c $cloneable was set
+ */
+static zend_object_value pmtamsg_clone(zval* object TSRMLS_DC)
+{
+	pmtamsg_object* old = fetchPmtaMsgObject(object TSRMLS_CC);
+	zend_object_value retval = pmtamsg_ctor(Z_OBJCE_P(object) TSRMLS_CC);
+	pmtamsg_object* obj = zend_object_store_get_object_by_handle(retval.handle TSRMLS_CC);
+	BOOL res;
+
+	zend_objects_clone_members(&obj->obj, retval, &old->obj, Z_OBJ_HANDLE_P(object) TSRMLS_CC);
+
+	MAKE_STD_ZVAL(obj->rcpt_array);
+	array_init_size(obj->rcpt_array, 32);
+	obj->recipients = Z_ARRVAL_P(obj->rcpt_array);
+	obj->retain      = old->retain;
+	obj->digest      = PMTA_DIGEST_INIT;
+	obj->canon       = old->canon;
+	obj->canon_state = old->canon_state;
+	obj->cloneable   = old->cloneable;
+
+	if (!old->msg) {
+		return retval;
+	}
+
+	if (old->body_direct) {
+		/* PMTA API cannot copy a message: the body must have been journaled from the start */
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalState, "The message cannot be cloned: its body has been added before $cloneable was set", NULL TSRMLS_CC);
+		return retval;
+	}
+
+	obj->originator = estrdup(old->originator);
+	obj->rettype    = old->rettype;
+	obj->encoding   = old->encoding;
+	obj->verp       = old->verp;
+	obj->flags      = old->flags;
+
+	if (old->body) {
+		obj->body      = pmta_body_addref(old->body);
+		obj->body_len  = old->body_len;
+		obj->body_size = old->body_size;
+	}
+
+	obj->msg = PmtaMsgAlloc();
+	if (!obj->msg) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_PHP_API, "PmtaMsgAlloc() failed", NULL TSRMLS_CC);
+		return retval;
+	}
+
+	res = PmtaMsgInit(obj->msg, obj->originator);
+	if (TRUE == res && old->envid) {
+		obj->envid = estrdup(old->envid);
+		res        = PmtaMsgSetEnvelopeId(obj->msg, obj->envid);
+	}
+
+	if (TRUE == res && old->vmta) {
+		obj->vmta = estrdup(old->vmta);
+		res       = PmtaMsgSetVirtualMta(obj->msg, obj->vmta);
+	}
+
+	if (TRUE == res && old->jobid) {
+		obj->jobid = estrdup(old->jobid);
+		res        = PmtaMsgSetJobId(obj->msg, obj->jobid);
+	}
+
+	if (TRUE == res && (obj->flags & PMTAMSG_HAS_RETTYPE)) {
+		res = PmtaMsgSetReturnType(obj->msg, (PmtaMsgRETURN)obj->rettype);
+	}
+
+	if (TRUE == res && (obj->flags & PMTAMSG_HAS_ENCODING)) {
+		res = PmtaMsgSetEncoding(obj->msg, (PmtaMsgENCODING)obj->encoding);
+	}
+
+	if (TRUE == res && (obj->flags & PMTAMSG_HAS_VERP)) {
+		res = PmtaMsgSetVerp(obj->msg, obj->verp ? TRUE : FALSE);
+	}
+
+	if (FALSE == res) {
+		throw_pmta_error(pmta_error_message_class, PmtaMsgGetLastErrorType(obj->msg), PmtaMsgGetLastError(obj->msg), NULL TSRMLS_CC);
+	}
+
+	return retval;
+}
+
+/**
+ * @brief public function __construct($originator);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ */
+static PHP_METHOD(PmtaMessage, __construct)
+{
+	pmtamsg_object* obj;
+	char* originator;
+	int originator_len;
+	BOOL result;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &originator, &originator_len)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+
+	obj->msg = PmtaMsgAlloc();
+	if (!obj->msg) {
+		throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_PHP_API, "PmtaMsgAlloc() failed", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	result = PmtaMsgInit(obj->msg, originator);
+	if (FALSE == result) {
+		throw_pmta_error(pmta_error_message_class, PmtaMsgGetLastErrorType(obj->msg), PmtaMsgGetLastError(obj->msg), NULL TSRMLS_CC);
+	}
+
+	obj->originator = estrndup(originator, originator_len);
+
+	MAKE_STD_ZVAL(obj->rcpt_array);
+	array_init_size(obj->rcpt_array, 32);
+	obj->recipients = Z_ARRVAL_P(obj->rcpt_array);
+	obj->retain     = PMTA_G(retain_rcpts);
+	obj->digest     = PMTA_DIGEST_INIT;
+}
+
+/**
+ * @brief public function __get($property);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaMessage, __get)
+{
+	zval* property;
+	zval* retval;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &property)) {
+		RETURN_NULL();
+	}
+
+	if (Z_TYPE_P(property) != IS_STRING) {
+		zend_error(E_WARNING, "Property name must be a string");
+		RETURN_NULL();
+	}
+
+	retval = pmtamsg_read_property_internal(fetchPmtaMsgObject(getThis() TSRMLS_CC), property, BP_VAR_R TSRMLS_CC);
+	RETURN_ZVAL(retval, 1, 0);
+}
+
+/**
+ * @brief public function __isset($property);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaMessage, __isset)
+{
+	zval* property;
+	int retval;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &property)) {
+		RETURN_NULL();
+	}
+
+	if (Z_TYPE_P(property) != IS_STRING) {
+		zend_error(E_WARNING, "Property name must be a string");
+		RETURN_NULL();
+	}
+
+	retval = pmtamsg_has_property_internal(fetchPmtaMsgObject(getThis() TSRMLS_CC), property, 1 TSRMLS_CC);
+	RETURN_BOOL(retval);
+}
+
+/**
+ * @brief public function __set($property, $value);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaMessage, __set)
+{
+	zval* property;
+	zval* value;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "zz", &property, &value)) {
+		RETURN_NULL();
+	}
+
+	if (Z_TYPE_P(property) != IS_STRING) {
+		zend_error(E_WARNING, "Property name must be a string");
+		RETURN_NULL();
+	}
+
+	pmtamsg_write_property_internal(fetchPmtaMsgObject(getThis() TSRMLS_CC), property, value TSRMLS_CC);
+}
+
+/**
+ * @brief public function beginPart($number);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaMessage, beginPart)
+{
+	pmtamsg_object* obj;
+	long int part;
+	int number;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &part)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	number = (int)part;
+	RETURN_BOOL(SUCCESS == pmtamsg_body_op(obj, PMTA_BODY_PART, (const char*)&number, sizeof(int) TSRMLS_CC));
+}
+
+/**
+ * @brief public function addData($string);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaMessage, addData)
+{
+	pmtamsg_object* obj;
+	char* data;
+	int data_len;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &data, &data_len)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	RETURN_BOOL(SUCCESS == pmtamsg_append_data(obj, data, data_len TSRMLS_CC));
+}
+
+/**
+ * @brief public function addBase64Data($data);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Appends base64-encoded @c $data split into 76-character CRLF-terminated lines. The data is encoded
+ * directly into the body.
+ */
+static PHP_METHOD(PmtaMessage, addBase64Data)
+{
+	pmtamsg_object* obj;
+	char* data;
+	int data_len;
+	char* p;
+	size_t max;
+	size_t start;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &data, &data_len)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	max   = pmta_base64_size(data_len);
+	start = pmtamsg_reserve(obj, max, &p);
+	RETURN_BOOL(SUCCESS == pmtamsg_finish(obj, start, max, pmta_base64_encode((const unsigned char*)data, data_len, p) TSRMLS_CC));
+}
+
+/**
+ * @brief public function addQuotedPrintableData($data);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Appends quoted-printable-encoded @c $data; line breaks in @c $data become CRLF, and longer lines are split
+ * with soft line breaks at 76 characters
+ */
+static PHP_METHOD(PmtaMessage, addQuotedPrintableData)
+{
+	pmtamsg_object* obj;
+	char* data;
+	int data_len;
+	char* p;
+	size_t max;
+	size_t start;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &data, &data_len)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	max   = pmta_qp_size(data_len);
+	start = pmtamsg_reserve(obj, max, &p);
+	RETURN_BOOL(SUCCESS == pmtamsg_finish(obj, start, max, pmta_qp_encode((const unsigned char*)data, data_len, p) TSRMLS_CC));
+}
+
+/**
+ * @brief public function addFile($path, $encoding = PmtaMessage::ENCODING_BASE64);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ *
+ * Appends the contents of the file, encoded with @c $encoding (@c ENCODING_BASE64, or @c ENCODING_7BIT
+ * and @c ENCODING_8BIT to add the file as is). The file is opened with PHP streams (so @c open_basedir
+ * and stream wrappers apply) and read and encoded in fixed-size chunks right away: it may be removed
+ * as soon as the method returns, and memory usage does not depend on the file size.
+ */
+static PHP_METHOD(PmtaMessage, addFile)
+{
+	pmtamsg_object* obj;
+	char* path;
+	int path_len;
+	long int encoding = PmtaMsgENCODING_BASE64;
+	php_stream* stream;
+	char* chunk;
+	int res = SUCCESS;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s|l", &path, &path_len, &encoding)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	if (encoding != PmtaMsgENCODING_7BIT && encoding != PmtaMsgENCODING_8BIT && encoding != PmtaMsgENCODING_BASE64) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalArgument, "Unknown encoding", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	if ((int)strlen(path) != path_len) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalArgument, "Invalid file name", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	stream = php_stream_open_wrapper(path, "rb", REPORT_ERRORS, NULL);
+	if (!stream) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IO, "Unable to read the file", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	chunk = emalloc(PMTA_BODY_FILE_CHUNK);
+	while (SUCCESS == res) {
+		size_t len = 0;
+
+		/* Only the last chunk may be short, so that base64 lines are not split between chunks */
+		while (len < PMTA_BODY_FILE_CHUNK) {
+			size_t n = php_stream_read(stream, chunk + len, PMTA_BODY_FILE_CHUNK - len);
+
+			if (!n) {
+				break;
+			}
+
+			len += n;
+		}
+
+		if (!len) {
+			break;
+		}
+
+		if (PmtaMsgENCODING_BASE64 == encoding) {
+			size_t max   = pmta_base64_size(len);
+			char* p;
+			size_t start = pmtamsg_reserve(obj, max, &p);
+
+			res = pmtamsg_finish(obj, start, max, pmta_base64_encode((const unsigned char*)chunk, len, p) TSRMLS_CC);
+		}
+		else {
+			res = pmtamsg_body_op(obj, PMTA_BODY_DATA, chunk, len TSRMLS_CC);
+		}
+
+		if (len < PMTA_BODY_FILE_CHUNK) {
+			break;
+		}
+	}
+
+	efree(chunk);
+	php_stream_close(stream);
+	RETURN_BOOL(SUCCESS == res);
+}
+
+/**
+ * @brief public function addStream($stream, $maxlen = -1);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ *
+ * Reads @c $stream until EOF (or until @c $maxlen bytes have been read, if @c $maxlen is not negative)
+ * and appends the data to the body. The data is read and added in fixed-size chunks, without creating
+ * a PHP string. Returns the number of bytes read, or @c false if a chunk has not been accepted. The chunks
+ * added before a failure (or before a too long line is found with @c $canonicalize) stay in the body.
+ */
+static PHP_METHOD(PmtaMessage, addStream)
+{
+	pmtamsg_object* obj;
+	zval* zstream;
+	php_stream* stream;
+	long int maxlen = -1;
+	long int total  = 0;
+	char chunk[PMTA_BODY_STREAM_CHUNK];
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r|l", &zstream, &maxlen)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	php_stream_from_zval_no_verify(stream, &zstream);
+	if (!stream) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalArgument, "Not a stream", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	while (maxlen < 0 || total < maxlen) {
+		size_t want = PMTA_BODY_STREAM_CHUNK;
+		size_t n;
+
+		if (maxlen >= 0 && (size_t)(maxlen - total) < want) {
+			want = (size_t)(maxlen - total);
+		}
+
+		n = php_stream_read(stream, chunk, want);
+		if (!n) {
+			break;
+		}
+
+		if (FAILURE == pmtamsg_append_data(obj, chunk, n TSRMLS_CC)) {
+			RETURN_FALSE;
+		}
+
+		total += (long int)n;
+	}
+
+	RETURN_LONG(total);
+}
+
+/**
+ * @brief public function addDataParts(array $parts);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Appends the parts in order, as one @c addData() call with their concatenation would (including
+ * canonicalization), but without creating the concatenated string. Non-string parts are converted to strings.
+ */
+static PHP_METHOD(PmtaMessage, addDataParts)
+{
+	pmtamsg_object* obj;
+	zval* parts;
+	zval* values;
+	zval** entry;
+	HashTable* ht;
+	HashPosition pos;
+	pmta_canon_state state;
+	size_t total = 0;
+	size_t max;
+	size_t start;
+	int num;
+	int i;
+	char* p;
+	char* q;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &parts)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	/*
+	 * Convert every part exactly once, before anything is reserved:
+	 * __toString() may run user code which calls back into this message,
+	 * and the journal must not be open (or be reallocated) while it does
+	 */
+	ht     = Z_ARRVAL_P(parts);
+	num    = 0;
+	values = safe_emalloc(zend_hash_num_elements(ht), sizeof(zval), 0);
+	for (
+		zend_hash_internal_pointer_reset_ex(ht, &pos);
+		zend_hash_get_current_data_ex(ht, (void**)&entry, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(ht, &pos)
+	) {
+		ZVAL_ZVAL(&values[num], *entry, 1, 0);
+		if (Z_TYPE(values[num]) != IS_STRING) {
+			convert_to_string(&values[num]);
+		}
+
+		total += Z_STRLEN(values[num]);
+		++num;
+
+		if (EG(exception)) {
+			break;
+		}
+	}
+
+	if (EG(exception) || !pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		for (i=0; i<num; ++i) {
+			zval_dtor(&values[i]);
+		}
+
+		efree(values);
+		RETURN_NULL();
+	}
+
+	/* All parts go into one record: one copy, one PmtaMsgAddData() call */
+	max   = obj->canon ? 2 * total : total;
+	state = obj->canon_state;
+	start = pmtamsg_reserve(obj, max, &p);
+	q     = p;
+
+	for (i=0; i<num; ++i) {
+		size_t n;
+
+		if (obj->canon) {
+			n = pmta_canonicalize(&state, obj->canon, Z_STRVAL(values[i]), Z_STRLEN(values[i]), q);
+			if ((size_t)-1 == n) {
+				break;
+			}
+		}
+		else {
+			n = Z_STRLEN(values[i]);
+			memcpy(q, Z_STRVAL(values[i]), n);
+		}
+
+		q += n;
+	}
+
+	if (i < num) {
+		pmtamsg_finish(obj, start, max, 0 TSRMLS_CC);
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalArgument, "Line is longer than 998 characters", NULL TSRMLS_CC);
+	}
+
+	for (i=0; i<num; ++i) {
+		zval_dtor(&values[i]);
+	}
+
+	efree(values);
+
+	if (EG(exception)) {
+		RETURN_NULL();
+	}
+
+	if (FAILURE == pmtamsg_finish(obj, start, max, (size_t)(q - p) TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+
+	obj->canon_state = state;
+	RETURN_TRUE;
+}
+
+/**
+ * @brief public function addMergeData($string);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaMessage, addMergeData)
+{
+	pmtamsg_object* obj;
+	char* data;
+	int data_len;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &data, &data_len)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	RETURN_BOOL(SUCCESS == pmtamsg_body_op(obj, PMTA_BODY_MERGE, data, data_len TSRMLS_CC));
+}
+
+/**
+ * @brief public function addDateHeader();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaMessage, addDateHeader)
+{
+	pmtamsg_object* obj;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	RETURN_BOOL(SUCCESS == pmtamsg_body_op(obj, PMTA_BODY_DATE, NULL, 0 TSRMLS_CC));
+}
+
+/**
+ * @brief public function addDateAndMessageId($domain);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ *
+ * Appends the @c Date header (UTC, formatted once per second) and a @c Message-ID header with @c $domain
+ * as the domain part. Returns the Message-ID, or @c false if the headers have not been accepted.
+ */
+static PHP_METHOD(PmtaMessage, addDateAndMessageId)
+{
+	pmtamsg_object* obj;
+	char* domain;
+	int domain_len;
+	char buf[512];
+	char* id;
+	const char* date;
+	size_t date_len;
+	size_t id_len;
+	time_t now;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &domain, &domain_len)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	if (!domain_len || domain_len > 255 || strcspn(domain, "<>@ \r\n") != (size_t)domain_len) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalArgument, "Invalid domain", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	now      = time(NULL);
+	date_len = pmta_date_header(now, &date TSRMLS_CC);
+	if (!date_len) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalState, "Failed to format the Date header", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	memcpy(buf, date, date_len);
+	memcpy(buf + date_len, "Message-ID: ", sizeof("Message-ID: ") - 1);
+
+	id     = buf + date_len + sizeof("Message-ID: ") - 1;
+	id_len = pmta_message_id(now, id, sizeof(buf) - (id - buf) - 2, domain TSRMLS_CC);
+	memcpy(id + id_len, "\r\n", 2);
+
+	if (FAILURE == pmtamsg_append_data(obj, buf, (size_t)(id - buf) + id_len + 2 TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+
+	RETURN_STRINGL(id, id_len, 1);
+}
+
+/**
+ * @brief Adds a cached part to the body
+ * @param obj @c pmtamsg_object
+ * @param part Cached part
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE (see @c pmtamsg_body_op())
+ * @note The part is passed to @c PmtaMsg directly or copied into the journal: journals never refer to the cache,
+ * so cached parts may be freed at any time
+ */
+static int pmtamsg_add_cached_part(pmtamsg_object* obj, const pmta_cached_part* part TSRMLS_DC)
+{
+	if (FAILURE == pmtamsg_body_op(obj, PMTA_BODY_DATA, part->data, part->len TSRMLS_CC)) {
+		return FAILURE;
+	}
+
+	if (obj->canon && part->len) {
+		/* The part has been canonicalized as if it started a line */
+		obj->canon_state = part->state;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief public function addCachedPart($key, $data = null);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ *
+ * Appends the part cached under @c $key. If there is no such part, @c $data is canonicalized (according to
+ * @c $canonicalize, as if it started a line), stored in the per-process cache and appended; when @c $data
+ * is @c null, nothing is appended and @c false is returned, so that the part is rendered only on a miss.
+ * When @c $data is given, the cached part is used only if it has been made of the same data, and is replaced
+ * otherwise; a lookup without @c $data trusts the key, so call @c clearPartCache() when the content behind
+ * the keys changes. Cached parts are kept until the process exits; once @c pmta.part_cache_size is reached,
+ * new parts are appended without being cached.
+ */
+static PHP_METHOD(PmtaMessage, addCachedPart)
+{
+	pmtamsg_object* obj;
+	char* key;
+	int key_len;
+	char* data   = NULL;
+	int data_len = 0;
+	char* ckey;
+	char* canon  = NULL;
+	pmta_uint64 digest     = 0;
+	pmta_canon_state state = { 0, 0 };
+	pmta_cached_part* cached;
+	pmta_cached_part part;
+	int res;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s|s!", &key, &key_len, &data, &data_len)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	/* The cached bytes depend on the canonicalization flags */
+	ckey    = emalloc(key_len + 2);
+	ckey[0] = (char)('0' + obj->canon);
+	memcpy(ckey + 1, key, key_len + 1);
+
+	if (data) {
+		digest = pmta_digest_update(PMTA_DIGEST_INIT, data, data_len);
+	}
+
+	if (SUCCESS == zend_hash_find(&PMTA_G(part_cache), ckey, key_len + 2, (void**)&cached)) {
+		if (!data || cached->digest == digest) {
+			efree(ckey);
+			++PMTA_G(part_cache_hits);
+			RETURN_BOOL(SUCCESS == pmtamsg_add_cached_part(obj, cached TSRMLS_CC));
+		}
+
+		/* The part under this key has changed */
+		PMTA_G(part_cache_used) -= cached->len;
+		zend_hash_del(&PMTA_G(part_cache), ckey, key_len + 2);
+	}
+
+	++PMTA_G(part_cache_miss);
+	if (!data) {
+		efree(ckey);
+		RETURN_FALSE;
+	}
+
+	part.data   = data;
+	part.len    = (size_t)data_len;
+	part.digest = digest;
+
+	if (obj->canon) {
+		canon    = emalloc(2 * part.len);
+		part.len = pmta_canonicalize(&state, obj->canon, data, data_len, canon);
+		if ((size_t)-1 == part.len) {
+			efree(canon);
+			efree(ckey);
+			throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalArgument, "Line is longer than 998 characters", NULL TSRMLS_CC);
+			RETURN_NULL();
+		}
+
+		part.data = canon;
+	}
+
+	part.state = state;
+
+	/* Parts that do not fit into the cache go directly into the body */
+	if (PMTA_G(part_cache_size) > 0 && PMTA_G(part_cache_used) + part.len <= (size_t)PMTA_G(part_cache_size)) {
+		char* copy = pemalloc(MAX(part.len, 1), 1);
+
+		memcpy(copy, part.data, part.len);
+		part.data = copy;
+		zend_hash_add(&PMTA_G(part_cache), ckey, key_len + 2, &part, sizeof(pmta_cached_part), NULL);
+		PMTA_G(part_cache_used) += part.len;
+	}
+
+	res = pmtamsg_add_cached_part(obj, &part TSRMLS_CC);
+
+	if (canon) {
+		efree(canon);
+	}
+
+	efree(ckey);
+	RETURN_BOOL(SUCCESS == res);
+}
+
+/**
+ * @brief public static function clearPartCache();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Removes all parts from the @c addCachedPart() cache of this process and returns their number.
+ * The hit and miss counters are kept.
+ */
+static PHP_METHOD(PmtaMessage, clearPartCache)
+{
+	long int entries;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	entries = (long int)zend_hash_num_elements(&PMTA_G(part_cache));
+	zend_hash_clean(&PMTA_G(part_cache));
+	PMTA_G(part_cache_used) = 0;
+	RETURN_LONG(entries);
+}
+
+/**
+ * @brief public static function getPartCacheStats();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns the statistics of the @c addCachedPart() cache of this process: @c hits, @c misses,
+ * @c entries, @c size (bytes used) and @c limit (@c pmta.part_cache_size)
+ */
+static PHP_METHOD(PmtaMessage, getPartCacheStats)
+{
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	array_init_size(return_value, 8);
+	add_assoc_long_ex(return_value, ZEND_STRS("hits"),    PMTA_G(part_cache_hits));
+	add_assoc_long_ex(return_value, ZEND_STRS("misses"),  PMTA_G(part_cache_miss));
+	add_assoc_long_ex(return_value, ZEND_STRS("entries"), (long int)zend_hash_num_elements(&PMTA_G(part_cache)));
+	add_assoc_long_ex(return_value, ZEND_STRS("size"),    (long int)PMTA_G(part_cache_used));
+	add_assoc_long_ex(return_value, ZEND_STRS("limit"),   PMTA_G(part_cache_size));
+}
+
+/**
+ * @brief public function addTemplate(PmtaTemplate $template);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Appends the compiled parts of the template to the body. The parts are not copied: the body keeps a reference
+ * to the template storage.
+ */
+static PHP_METHOD(PmtaMessage, addTemplate)
+{
+	pmtamsg_object* obj;
+	zval* tpl;
+	pmta_body_ref ref;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &tpl, pmta_template_class)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
 
-	return retval;
+	ref.buf = pmtatpl_get_body(tpl, &ref.len TSRMLS_CC);
+	RETURN_BOOL(SUCCESS == pmtamsg_body_op(obj, PMTA_BODY_REF, (const char*)&ref, sizeof(pmta_body_ref) TSRMLS_CC));
 }
 
 /**
- * @brief public function __construct($originator);
+ * @brief public function addRecipient(PmtaRecipient $rcpt);
  * @param ht Internally used by Zend (number of arguments)
  * @param return_value Internally used by Zend (return value)
  * @param return_value_ptr Internally used by Zend
  * @param this_ptr Internally used by Zend (@c $this)
  * @param return_value_used Internally used by Zend (whether the return value is used)
  * @param tsrm_ls Internally used by Zend
- * @throw pmta_error_message_class
  */
-static PHP_METHOD(PmtaMessage, __construct)
+static PHP_METHOD(PmtaMessage, addRecipient)
 {
 	pmtamsg_object* obj;
-	char* originator;
-	int originator_len;
-	BOOL result;
+	PmtaRcpt rcpt;
+	zval* recipient;
+	BOOL res;
 
-	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &originator, &originator_len)) {
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &recipient, pmta_rcpt_class)) {
 		RETURN_NULL();
 	}
 
 	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
-
-	obj->msg = PmtaMsgAlloc();
-	if (!obj->msg) {
-		throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_PHP_API, "PmtaMsgAlloc() failed", NULL TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
 		RETURN_NULL();
 	}
 
-	result = PmtaMsgInit(obj->msg, originator);
-	if (FALSE == result) {
-		throw_pmta_error(pmta_error_message_class, PmtaMsgGetLastErrorType(obj->msg), PmtaMsgGetLastError(obj->msg), NULL TSRMLS_CC);
+	rcpt = getRecipient(recipient TSRMLS_CC);
+	res  = PmtaMsgAddRecipient(obj->msg, rcpt);
+	if (TRUE == res) {
+		pmtamsg_track_recipient(obj, getRecipientAddress(recipient TSRMLS_CC));
+
+		if (obj->retain) {
+			Z_ADDREF_P(recipient);
+			zend_hash_next_index_insert(obj->recipients, (void*)&recipient, sizeof(zval*), NULL);
+		}
+		else {
+			++obj->bulk_rcpts;
+		}
+
+		lock_recipient(recipient TSRMLS_CC);
+		RETURN_TRUE;
 	}
 
-	obj->originator = estrndup(originator, originator_len);
+	RETURN_FALSE;
+}
+
+/**
+ * @brief Adds @c PmtaRcpt created without @c PmtaRecipient object to the message and frees it
+ * @param obj @c pmtamsg_object
+ * @param rcpt Recipient
+ * @param address Recipient's address
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the recipient has been added
+ * @retval SUCCESS Yes
+ * @retval FAILURE No, @c PmtaErrorMessage has been thrown
+ */
+static int pmtamsg_attach_recipient(pmtamsg_object* obj, PmtaRcpt rcpt, const char* address TSRMLS_DC)
+{
+	BOOL res = PmtaMsgAddRecipient(obj->msg, rcpt);
+
+	PmtaRcptFree(rcpt);
+	if (FALSE == res) {
+		throw_pmta_error(pmta_error_message_class, PmtaMsgGetLastErrorType(obj->msg), PmtaMsgGetLastError(obj->msg), NULL TSRMLS_CC);
+		return FAILURE;
+	}
 
-	ALLOC_HASHTABLE(obj->recipients);
-	zend_hash_init(obj->recipients, 32, NULL, ZVAL_PTR_DTOR, 0);
+	pmtamsg_track_recipient(obj, address);
+	++obj->bulk_rcpts;
+	return SUCCESS;
 }
 
 /**
- * @brief public function __get($property);
+ * @brief public function addRecipients(array $recipients);
  * @param ht Internally used by Zend (number of arguments)
  * @param return_value Internally used by Zend (return value)
  * @param return_value_ptr Internally used by Zend
  * @param this_ptr Internally used by Zend (@c $this)
  * @param return_value_used Internally used by Zend (whether the return value is used)
  * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_recipient_class
+ * @throw pmta_error_message_class
+ *
+ * Adds recipients without creating @c PmtaRecipient objects. Every element of @c $recipients is either an address
+ * or <tt>array('address' => ..., 'notify' => ..., 'vars' => array(...))</tt>. Returns the number of recipients added.
+ * If a row is invalid, the exception is thrown and the recipients before it stay attached to the message.
  */
-static PHP_METHOD(PmtaMessage, __get)
+static PHP_METHOD(PmtaMessage, addRecipients)
 {
-	zval* property;
-	zval* retval;
+	pmtamsg_object* obj;
+	zval* recipients;
+	zval** entry;
+	HashTable* ht;
+	HashPosition pos;
+	long int added = 0;
 
-	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &property)) {
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &recipients)) {
 		RETURN_NULL();
 	}
 
-	if (Z_TYPE_P(property) != IS_STRING) {
-		zend_error(E_WARNING, "Property name must be a string");
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
 		RETURN_NULL();
 	}
 
-	retval = pmtamsg_read_property_internal(fetchPmtaMsgObject(getThis() TSRMLS_CC), property, BP_VAR_R);
-	RETURN_ZVAL(retval, 1, 0);
+	ht = Z_ARRVAL_P(recipients);
+	for (
+		zend_hash_internal_pointer_reset_ex(ht, &pos);
+		zend_hash_get_current_data_ex(ht, (void**)&entry, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(ht, &pos)
+	) {
+		const char* address;
+		PmtaRcpt rcpt = pmtarcpt_from_zval(*entry, &address TSRMLS_CC);
+
+		if (!rcpt || FAILURE == pmtamsg_attach_recipient(obj, rcpt, address TSRMLS_CC)) {
+			RETURN_NULL();
+		}
+
+		++added;
+	}
+
+	RETURN_LONG(added);
 }
 
 /**
- * @brief public function __isset($property);
- * @param ht Internally used by Zend (number of arguments)
- * @param return_value Internally used by Zend (return value)
- * @param return_value_ptr Internally used by Zend
- * @param this_ptr Internally used by Zend (@c $this)
- * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @brief Column of the CSV file mapped to a recipient field
+ */
+typedef struct _pmtamsg_csv_column {
+	int column;       /**< Column index */
+	const char* name; /**< Variable name */
+} pmtamsg_csv_column;
+
+/**
+ * @brief Resolves the column map of @c addRecipientsFromCsv()
+ * @param columns Column map (column index or header name => @c 'address', @c 'notify' or variable name)
+ * @param r CSV reader positioned after the header row, or @c NULL if the file has no header
+ * @param address Column with the address (output)
+ * @param notify Column with the notification flags, -1 if none (output)
+ * @param vars Columns with the variables (output, must have room for all elements of @a columns)
+ * @param num_vars Number of variables (output)
  * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE if @c PmtaErrorRecipient has been thrown
  */
-static PHP_METHOD(PmtaMessage, __isset)
+static int pmtamsg_csv_map(HashTable* columns, pmta_csv_reader* r, int* address, int* notify, pmtamsg_csv_column* vars, int* num_vars TSRMLS_DC)
 {
-	zval* property;
-	int retval;
+	HashPosition pos;
+	zval** entry;
+
+	*address  = -1;
+	*notify   = -1;
+	*num_vars = 0;
+
+	for (
+		zend_hash_internal_pointer_reset_ex(columns, &pos);
+		zend_hash_get_current_data_ex(columns, (void**)&entry, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(columns, &pos)
+	) {
+		char* key;
+		uint key_len;
+		ulong idx;
+		int column = -1;
+
+		if (Z_TYPE_PP(entry) != IS_STRING) {
+			throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_IllegalArgument, "Column map values must be strings", NULL TSRMLS_CC);
+			return FAILURE;
+		}
 
-	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &property)) {
-		RETURN_NULL();
+		if (HASH_KEY_IS_STRING == zend_hash_get_current_key_ex(columns, &key, &key_len, &idx, 0, &pos)) {
+			int i;
+
+			for (i=0; r && i<r->num_fields; ++i) {
+				if (!strcmp(pmta_csv_field(r, i), key)) {
+					column = i;
+					break;
+				}
+			}
+		}
+		else if (idx <= INT_MAX) {
+			column = (int)idx;
+		}
+
+		if (column < 0) {
+			throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_IllegalArgument, "Column not found in the CSV header", NULL TSRMLS_CC);
+			return FAILURE;
+		}
+
+		if (!strcmp(Z_STRVAL_PP(entry), "address")) {
+			*address = column;
+		}
+		else if (!strcmp(Z_STRVAL_PP(entry), "notify")) {
+			*notify = column;
+		}
+		else {
+			vars[*num_vars].column = column;
+			vars[*num_vars].name   = Z_STRVAL_PP(entry);
+			++*num_vars;
+		}
 	}
 
-	if (Z_TYPE_P(property) != IS_STRING) {
-		zend_error(E_WARNING, "Property name must be a string");
-		RETURN_NULL();
+	if (*address < 0) {
+		throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_IllegalArgument, "Column map does not contain the address column", NULL TSRMLS_CC);
+		return FAILURE;
 	}
 
-	retval = pmtamsg_has_property_internal(fetchPmtaMsgObject(getThis() TSRMLS_CC), property, 1 TSRMLS_CC);
-	RETURN_BOOL(retval);
+	return SUCCESS;
 }
 
 /**
- * @brief public function __set($property, $value);
+ * @brief Checks whether the column map refers to the columns by their header names
+ * @param columns Column map
+ * @return Whether any key of @a columns is a string
+ */
+static int pmtamsg_csv_has_header(HashTable* columns)
+{
+	HashPosition pos;
+
+	for (
+		zend_hash_internal_pointer_reset_ex(columns, &pos);
+		zend_hash_get_current_key_type_ex(columns, &pos) != HASH_KEY_NON_EXISTANT;
+		zend_hash_move_forward_ex(columns, &pos)
+	) {
+		if (HASH_KEY_IS_STRING == zend_hash_get_current_key_type_ex(columns, &pos)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief public function addRecipientsFromCsv($path, array $columns, $offset = 0, $limit = 0, $delimiter = ',');
  * @param ht Internally used by Zend (number of arguments)
  * @param return_value Internally used by Zend (return value)
  * @param return_value_ptr Internally used by Zend
  * @param this_ptr Internally used by Zend (@c $this)
  * @param return_value_used Internally used by Zend (whether the return value is used)
  * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_recipient_class
+ * @throw pmta_error_message_class
+ *
+ * Adds recipients from CSV file without creating @c PmtaRecipient objects.
+ * @c $columns maps column indexes (or names from the header row) to @c 'address', @c 'notify' or merge variable names.
+ * Reading starts at byte @c $offset and stops after @c $limit rows (0 = no limit).
+ * Returns <tt>array('rows' => ..., 'offset' => ..., 'eof' => ...)</tt>; pass @c offset back to continue with the next chunk.
+ * Returns @c false if the file cannot be opened.
  */
-static PHP_METHOD(PmtaMessage, __set)
+static PHP_METHOD(PmtaMessage, addRecipientsFromCsv)
 {
-	zval* property;
-	zval* value;
+	pmtamsg_object* obj;
+	pmta_csv_reader r;
+	pmtamsg_csv_column* vars;
+	char* path;
+	int path_len;
+	zval* columns;
+	long int offset = 0;
+	long int limit  = 0;
+	char* delim     = ",";
+	int delim_len   = 1;
+	int address;
+	int notify;
+	int num_vars;
+	int header;
+	long int rows = 0;
+	int ok        = 0;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "sa|lls", &path, &path_len, &columns, &offset, &limit, &delim, &delim_len)) {
+		RETURN_NULL();
+	}
 
-	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "zz", &property, &value)) {
+	if (1 != delim_len || '"' == *delim || '\r' == *delim || '\n' == *delim || offset < 0 || limit < 0) {
+		throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_IllegalArgument, "Invalid delimiter, offset or limit", NULL TSRMLS_CC);
 		RETURN_NULL();
 	}
 
-	if (Z_TYPE_P(property) != IS_STRING) {
-		zend_error(E_WARNING, "Property name must be a string");
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
 		RETURN_NULL();
 	}
 
-	pmtamsg_write_property_internal(fetchPmtaMsgObject(getThis() TSRMLS_CC), property, value TSRMLS_CC);
+	header = pmtamsg_csv_has_header(Z_ARRVAL_P(columns));
+	if (FAILURE == pmta_csv_open(&r, path, header ? 0 : offset, *delim TSRMLS_CC)) {
+		RETURN_FALSE;
+	}
+
+	vars = safe_emalloc(zend_hash_num_elements(Z_ARRVAL_P(columns)) + 1, sizeof(pmtamsg_csv_column), 0);
+
+	if (header && !pmta_csv_next(&r TSRMLS_CC)) {
+		throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_IllegalArgument, "CSV file has no header row", NULL TSRMLS_CC);
+		goto cleanup;
+	}
+
+	if (FAILURE == pmtamsg_csv_map(Z_ARRVAL_P(columns), header ? &r : NULL, &address, &notify, vars, &num_vars TSRMLS_CC)) {
+		goto cleanup;
+	}
+
+	if (header && offset > 0 && FAILURE == pmta_csv_seek(&r, offset TSRMLS_CC)) {
+		RETVAL_FALSE;
+		goto cleanup;
+	}
+
+	while ((!limit || rows < limit) && pmta_csv_next(&r TSRMLS_CC)) {
+		const char* addr = pmta_csv_field(&r, address);
+		PmtaRcpt rcpt    = pmtarcpt_create(addr TSRMLS_CC);
+		int i;
+
+		if (!rcpt) {
+			goto cleanup;
+		}
+
+		if (notify >= 0 && *pmta_csv_field(&r, notify)) {
+			if (FALSE == PmtaRcptSetNotify(rcpt, strtol(pmta_csv_field(&r, notify), NULL, 10))) {
+				throw_pmta_error(pmta_error_recipient_class, PmtaRcptGetLastErrorType(rcpt), PmtaRcptGetLastError(rcpt), NULL TSRMLS_CC);
+				PmtaRcptFree(rcpt);
+				goto cleanup;
+			}
+		}
+
+		for (i=0; i<num_vars; ++i) {
+			if (FAILURE == pmtarcpt_define_variable(rcpt, vars[i].name, pmta_csv_field(&r, vars[i].column) TSRMLS_CC)) {
+				PmtaRcptFree(rcpt);
+				goto cleanup;
+			}
+		}
+
+		if (FAILURE == pmtamsg_attach_recipient(obj, rcpt, addr TSRMLS_CC)) {
+			goto cleanup;
+		}
+
+		++rows;
+	}
+
+	ok = 1;
+
+cleanup:
+	if (ok) {
+		array_init_size(return_value, 3);
+		add_assoc_long_ex(return_value, ZEND_STRS("rows"),   rows);
+		add_assoc_long_ex(return_value, ZEND_STRS("offset"), (long int)pmta_csv_tell(&r));
+		add_assoc_bool_ex(return_value, ZEND_STRS("eof"),    r.eof && r.pos == r.len);
+	}
+
+	efree(vars);
+	pmta_csv_close(&r TSRMLS_CC);
 }
 
 /**
- * @brief public function beginPart($number);
+ * @brief public function addRecipientList(PmtaRecipientList $list);
  * @param ht Internally used by Zend (number of arguments)
  * @param return_value Internally used by Zend (return value)
  * @param return_value_ptr Internally used by Zend
  * @param this_ptr Internally used by Zend (@c $this)
  * @param return_value_used Internally used by Zend (whether the return value is used)
  * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_recipient_class
+ * @throw pmta_error_message_class
+ *
+ * Adds all recipients of the list; @c PmtaRcpt handles are created one at a time and freed right after they are added.
+ * Returns the number of recipients added. If a recipient is invalid, the recipients before it stay attached to the message.
  */
-static PHP_METHOD(PmtaMessage, beginPart)
+static PHP_METHOD(PmtaMessage, addRecipientList)
 {
 	pmtamsg_object* obj;
-	long int part;
-	BOOL res;
+	zval* list;
+	long int i;
+	long int count;
 
-	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &part)) {
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &list, pmta_rcptlist_class)) {
 		RETURN_NULL();
 	}
 
 	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
-	res = PmtaMsgBeginPart(obj->msg, part);
-	RETURN_BOOL(TRUE == res ? 1 : 0);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	count = pmtalist_count(list TSRMLS_CC);
+	for (i=0; i<count; ++i) {
+		const char* address;
+		PmtaRcpt rcpt = pmtalist_materialize(list, i, &address TSRMLS_CC);
+
+		if (!rcpt || FAILURE == pmtamsg_attach_recipient(obj, rcpt, address TSRMLS_CC)) {
+			RETURN_NULL();
+		}
+	}
+
+	RETURN_LONG(count);
 }
 
 /**
- * @brief public function addData($string);
+ * @brief public function recipientCount();
  * @param ht Internally used by Zend (number of arguments)
  * @param return_value Internally used by Zend (return value)
  * @param return_value_ptr Internally used by Zend
  * @param this_ptr Internally used by Zend (@c $this)
  * @param return_value_used Internally used by Zend (whether the return value is used)
  * @param tsrm_ls Internally used by Zend
+ *
+ * Returns the total number of recipients, including those which are not visible through @c $recipients
+ * (added by @c addRecipients(), @c addRecipientsFromCsv(), @c addRecipientList() or while @c $retain_recipients is off)
  */
-static PHP_METHOD(PmtaMessage, addData)
+static PHP_METHOD(PmtaMessage, recipientCount)
 {
 	pmtamsg_object* obj;
-	char* data;
-	int data_len;
-	BOOL res;
 
-	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &data, &data_len)) {
+	if (zend_parse_parameters_none() == FAILURE) {
 		RETURN_NULL();
 	}
 
 	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
-	res = PmtaMsgAddData(obj->msg, data, data_len);
-	RETURN_BOOL(TRUE == res ? 1 : 0);
+	RETURN_LONG((obj->recipients ? zend_hash_num_elements(obj->recipients) : 0) + obj->bulk_rcpts);
 }
 
 /**
- * @brief public function addMergeData($string);
+ * @brief public function memoryUsage();
  * @param ht Internally used by Zend (number of arguments)
  * @param return_value Internally used by Zend (return value)
  * @param return_value_ptr Internally used by Zend
  * @param this_ptr Internally used by Zend (@c $this)
  * @param return_value_used Internally used by Zend (whether the return value is used)
  * @param tsrm_ls Internally used by Zend
+ *
+ * Returns the estimated number of bytes of memory the message takes: the object, the body journal (in full, even if
+ * it is shared with clones) and the body data already passed to PowerMTA API.
+ * Data moved to the spill file (see @c pmta.body_spill_threshold) and recipients are not counted.
  */
-static PHP_METHOD(PmtaMessage, addMergeData)
+static PHP_METHOD(PmtaMessage, memoryUsage)
 {
 	pmtamsg_object* obj;
-	char* data;
-	int data_len;
-	BOOL res;
+	size_t usage;
 
-	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &data, &data_len)) {
+	if (zend_parse_parameters_none() == FAILURE) {
 		RETURN_NULL();
 	}
 
-	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
-	res = PmtaMsgAddMergeData(obj->msg, data, data_len);
-	RETURN_BOOL(TRUE == res ? 1 : 0);
+	obj   = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	usage = sizeof(pmtamsg_object);
+	if (obj->originator) { usage += strlen(obj->originator) + 1; }
+	if (obj->envid)      { usage += strlen(obj->envid) + 1;      }
+	if (obj->vmta)       { usage += strlen(obj->vmta) + 1;       }
+	if (obj->jobid)      { usage += strlen(obj->jobid) + 1;      }
+	if (obj->first_rcpt) { usage += strlen(obj->first_rcpt) + 1; }
+
+	if (obj->body) {
+		usage += sizeof(pmta_body) + obj->body->size;
+	}
+
+	RETURN_LONG((long int)(usage + obj->applied_size));
 }
 
 /**
- * @brief public function addDateHeader();
+ * @brief public function bodySize();
  * @param ht Internally used by Zend (number of arguments)
  * @param return_value Internally used by Zend (return value)
  * @param return_value_ptr Internally used by Zend
  * @param this_ptr Internally used by Zend (@c $this)
  * @param return_value_used Internally used by Zend (whether the return value is used)
  * @param tsrm_ls Internally used by Zend
+ *
+ * Returns the number of body bytes added so far, wherever they are kept (memory, spill file, templates,
+ * cached parts, files added with @c addFile()). Merge data is counted before substitution,
+ * and the header added by @c addDateHeader() is not counted.
  */
-static PHP_METHOD(PmtaMessage, addDateHeader)
+static PHP_METHOD(PmtaMessage, bodySize)
 {
 	pmtamsg_object* obj;
-	BOOL res;
 
 	if (zend_parse_parameters_none() == FAILURE) {
 		RETURN_NULL();
 	}
 
 	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
-	res = PmtaMsgAddDateHeader(obj->msg);
-	RETURN_BOOL(TRUE == res ? 1 : 0);
+	RETURN_LONG((long int)obj->body_size);
 }
 
 /**
- * @brief public function addRecipient(PmtaRecipient $rcpt);
+ * @brief public function reset($originator);
  * @param ht Internally used by Zend (number of arguments)
  * @param return_value Internally used by Zend (return value)
  * @param return_value_ptr Internally used by Zend
  * @param this_ptr Internally used by Zend (@c $this)
  * @param return_value_used Internally used by Zend (whether the return value is used)
  * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ *
+ * Makes the object ready for the next message: drops the recipients and the body and starts a new @c PmtaMsg
+ * for @c $originator. The recipients table (unless it is still referenced by a @c PmtaRecipientsView)
+ * and the originator buffer are reused; @c $retain_recipients, @c $canonicalize and @c $cloneable are kept. If the new @c PmtaMsg cannot be initialized,
+ * the exception is thrown and the message is left unchanged.
+ * @note Released @c PmtaMsg handles are not pooled: PMTA API has no call which drops the recipients and the body
+ * of a handle, so a recycled handle could carry them into the next message.
  */
-static PHP_METHOD(PmtaMessage, addRecipient)
+static PHP_METHOD(PmtaMessage, reset)
 {
 	pmtamsg_object* obj;
-	PmtaRcpt rcpt;
-	zval* recipient;
-	BOOL res;
+	char* originator;
+	int originator_len;
+	PmtaMsg msg;
 
-	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &recipient, pmta_rcpt_class)) {
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &originator, &originator_len)) {
 		RETURN_NULL();
 	}
 
-	obj  = fetchPmtaMsgObject(getThis() TSRMLS_CC);
-	rcpt = getRecipient(recipient TSRMLS_CC);
-	res  = PmtaMsgAddRecipient(obj->msg, rcpt);
-	if (TRUE == res) {
-		Z_ADDREF_P(recipient);
-		zend_hash_next_index_insert(obj->recipients, (void*)&recipient, sizeof(zval*), NULL);
-		lock_recipient(recipient TSRMLS_CC);
-		RETURN_TRUE;
+	obj = fetchPmtaMsgObject(getThis() TSRMLS_CC);
+	if (!pmtamsg_check_unlocked(obj TSRMLS_CC)) {
+		RETURN_NULL();
 	}
 
-	RETURN_FALSE;
+	/* PMTA API cannot reinitialize a message in place, so a new handle is needed */
+	msg = PmtaMsgAlloc();
+	if (!msg) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_PHP_API, "PmtaMsgAlloc() failed", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	if (FALSE == PmtaMsgInit(msg, originator)) {
+		throw_pmta_error(pmta_error_message_class, PmtaMsgGetLastErrorType(msg), PmtaMsgGetLastError(msg), NULL TSRMLS_CC);
+		PmtaMsgFree(msg);
+		RETURN_NULL();
+	}
+
+	if (obj->msg) {
+		PmtaMsgFree(obj->msg);
+	}
+
+	obj->msg        = msg;
+	obj->originator = erealloc(obj->originator, originator_len + 1);
+	memcpy(obj->originator, originator, originator_len + 1);
+
+	if (obj->envid)      { efree(obj->envid);      obj->envid      = NULL; }
+	if (obj->jobid)      { efree(obj->jobid);      obj->jobid      = NULL; }
+	if (obj->vmta)       { efree(obj->vmta);       obj->vmta       = NULL; }
+	if (obj->first_rcpt) { efree(obj->first_rcpt); obj->first_rcpt = NULL; }
+
+	if (obj->rcpt_array && Z_REFCOUNT_P(obj->rcpt_array) == 1) {
+		/* zend_hash_clean() keeps the bucket array, so the table does not have to grow again */
+		zend_hash_clean(obj->recipients);
+	}
+	else {
+		if (obj->rcpt_array) {
+			/* The old recipients stay visible through the views which reference them */
+			zval_ptr_dtor(&obj->rcpt_array);
+		}
+
+		MAKE_STD_ZVAL(obj->rcpt_array);
+		array_init_size(obj->rcpt_array, 32);
+		obj->recipients = Z_ARRVAL_P(obj->rcpt_array);
+	}
+
+	if (obj->body) {
+		/* Keeps the buffer for the next body unless it is shared with clones; the spill file is closed */
+		obj->body = pmta_body_reset(obj->body);
+	}
+
+	obj->rettype      = 0;
+	obj->encoding     = 0;
+	obj->verp         = 0;
+	obj->flags        = 0;
+	obj->body_len     = 0;
+	obj->body_applied = 0;
+	obj->body_size    = 0;
+	obj->applied_size = 0;
+	obj->body_direct  = 0;
+	obj->bulk_rcpts   = 0;
+	obj->digest       = PMTA_DIGEST_INIT;
+
+	memset(&obj->canon_state, 0, sizeof(pmta_canon_state));
+	RETURN_TRUE;
 }
 
 /**
@@ -876,7 +2797,7 @@ static PHP_METHOD(PmtaMessage, getLastError)
 }
 
 /**
- * @brief arginfo for @c __construct()
+ * @brief arginfo for @c __construct() and @c reset()
  */
 PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_construct, 0, 0, 1)
 	ZEND_ARG_INFO(0, originator)
@@ -890,12 +2811,57 @@ PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_beginpart, 0, 0, 1)
 ZEND_END_ARG_INFO()
 
 /**
- * @brief arginfo for @c addData() and @c addMergeData()
+ * @brief arginfo for @c addData(), @c addMergeData(), @c addBase64Data() and @c addQuotedPrintableData()
  */
 PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_adddata, 0, 0, 1)
 	ZEND_ARG_INFO(0, data)
 ZEND_END_ARG_INFO()
 
+/**
+ * @brief arginfo for @c addFile()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_addfile, 0, 0, 1)
+	ZEND_ARG_INFO(0, path)
+	ZEND_ARG_INFO(0, encoding)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c addStream()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_addstream, 0, 0, 1)
+	ZEND_ARG_INFO(0, stream)
+	ZEND_ARG_INFO(0, maxlen)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c addDataParts()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_adddataparts, 0, 0, 1)
+	ZEND_ARG_ARRAY_INFO(0, parts, 0)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c addDateAndMessageId()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_adddateandmessageid, 0, 0, 1)
+	ZEND_ARG_INFO(0, domain)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c addCachedPart()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_addcachedpart, 0, 0, 1)
+	ZEND_ARG_INFO(0, key)
+	ZEND_ARG_INFO(0, data)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c addTemplate()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_addtemplate, 0, 0, 1)
+	ZEND_ARG_OBJ_INFO(0, template, PmtaTemplate, 0)
+ZEND_END_ARG_INFO()
+
 /**
  * @brief arginfo for @c addRecipient()
  */
@@ -903,6 +2869,31 @@ PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_addrecipient, 0, 0, 1)
 	ZEND_ARG_OBJ_INFO(0, recipient, PmtaRecipient, 0)
 ZEND_END_ARG_INFO()
 
+/**
+ * @brief arginfo for @c addRecipients()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_addrecipients, 0, 0, 1)
+	ZEND_ARG_ARRAY_INFO(0, recipients, 0)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c addRecipientsFromCsv()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_addrecipientsfromcsv, 0, 0, 2)
+	ZEND_ARG_INFO(0, path)
+	ZEND_ARG_ARRAY_INFO(0, columns, 0)
+	ZEND_ARG_INFO(0, offset)
+	ZEND_ARG_INFO(0, limit)
+	ZEND_ARG_INFO(0, delimiter)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c addRecipientList()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_addrecipientlist, 0, 0, 1)
+	ZEND_ARG_OBJ_INFO(0, list, PmtaRecipientList, 0)
+ZEND_END_ARG_INFO()
+
 /**
  * @brief @c PmtaMessage class methods
  */
@@ -911,16 +2902,33 @@ static
 const
 #endif
 zend_function_entry pmta_msg_class_methods[] = {
-	PHP_ME(PmtaMessage, __construct,      arginfo_construct,    ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
-	PHP_ME(PmtaMessage, __get,            arginfo_get,          ZEND_ACC_PUBLIC)
-	PHP_ME(PmtaMessage, __set,            arginfo_set,          ZEND_ACC_PUBLIC)
-	PHP_ME(PmtaMessage, __isset,          arginfo_get,          ZEND_ACC_PUBLIC)
-	PHP_ME(PmtaMessage, beginPart,        arginfo_beginpart,    ZEND_ACC_PUBLIC)
-	PHP_ME(PmtaMessage, addData,          arginfo_adddata,      ZEND_ACC_PUBLIC)
-	PHP_ME(PmtaMessage, addMergeData,     arginfo_adddata,      ZEND_ACC_PUBLIC)
-	PHP_ME(PmtaMessage, addDateHeader,    arginfo_empty,        ZEND_ACC_PUBLIC)
-	PHP_ME(PmtaMessage, addRecipient,     arginfo_addrecipient, ZEND_ACC_PUBLIC)
-	PHP_ME(PmtaMessage, getLastError,     arginfo_empty,        ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, __construct,            arginfo_construct,            ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(PmtaMessage, __get,                  arginfo_get,                  ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, __set,                  arginfo_set,                  ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, __isset,                arginfo_get,                  ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, beginPart,              arginfo_beginpart,            ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addData,                arginfo_adddata,              ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addDataParts,           arginfo_adddataparts,         ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addMergeData,           arginfo_adddata,              ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addBase64Data,          arginfo_adddata,              ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addQuotedPrintableData, arginfo_adddata,              ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addFile,                arginfo_addfile,              ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addStream,              arginfo_addstream,            ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addDateHeader,          arginfo_empty,                ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addDateAndMessageId,    arginfo_adddateandmessageid,  ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addCachedPart,          arginfo_addcachedpart,        ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, clearPartCache,         arginfo_empty,                ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PmtaMessage, getPartCacheStats,      arginfo_empty,                ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PmtaMessage, addTemplate,            arginfo_addtemplate,          ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addRecipient,           arginfo_addrecipient,         ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addRecipients,          arginfo_addrecipients,        ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addRecipientsFromCsv,   arginfo_addrecipientsfromcsv, ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, addRecipientList,       arginfo_addrecipientlist,     ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, recipientCount,         arginfo_empty,                ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, memoryUsage,            arginfo_empty,                ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, bodySize,               arginfo_empty,                ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, reset,                  arginfo_construct,            ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMessage, getLastError,           arginfo_empty,                ZEND_ACC_PUBLIC)
 	PHP_ME_MAPPING(__destruct, empty_destructor, arginfo_empty, ZEND_ACC_PUBLIC | ZEND_ACC_DTOR)
 	PHP_FE_END
 };
@@ -938,7 +2946,7 @@ void pmtamsg_register_class(TSRMLS_D)
 	pmta_msg_class->unserialize   = zend_class_unserialize_deny;
 
 	pmtamsg_object_handlers = *zend_get_std_object_handlers();
-	pmtamsg_object_handlers.clone_obj            = NULL;
+	pmtamsg_object_handlers.clone_obj            = pmtamsg_clone;
 	pmtamsg_object_handlers.read_property        = pmtamsg_read_property;
 	pmtamsg_object_handlers.has_property         = pmtamsg_has_property;
 	pmtamsg_object_handlers.write_property       = pmtamsg_write_property;
@@ -951,4 +2959,9 @@ void pmtamsg_register_class(TSRMLS_D)
 	zend_declare_class_constant_long(pmta_msg_class, ZEND_STRL("ENCODING_7BIT"),   PmtaMsgENCODING_7BIT TSRMLS_CC);
 	zend_declare_class_constant_long(pmta_msg_class, ZEND_STRL("ENCODING_8BIT"),   PmtaMsgENCODING_8BIT TSRMLS_CC);
 	zend_declare_class_constant_long(pmta_msg_class, ZEND_STRL("ENCODING_BASE64"), PmtaMsgENCODING_BASE64 TSRMLS_CC);
+
+	zend_declare_class_constant_long(pmta_msg_class, ZEND_STRL("CANON_CRLF"),        PMTA_CANON_CRLF TSRMLS_CC);
+	zend_declare_class_constant_long(pmta_msg_class, ZEND_STRL("CANON_DOTS"),        PMTA_CANON_DOTS TSRMLS_CC);
+	zend_declare_class_constant_long(pmta_msg_class, ZEND_STRL("CANON_LINE_LENGTH"), PMTA_CANON_LINE_LENGTH TSRMLS_CC);
+	zend_declare_class_constant_long(pmta_msg_class, ZEND_STRL("CANON_ALL"),         PMTA_CANON_ALL TSRMLS_CC);
 }
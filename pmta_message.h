@@ -16,6 +16,11 @@ class PmtaMessage
 	const ENCODING_8BIT   = PmtaMsgENCODING_8BIT;
 	const ENCODING_BASE64 = PmtaMsgENCODING_BASE64;
 
+	const CANON_CRLF        = 1;
+	const CANON_DOTS        = 2;
+	const CANON_LINE_LENGTH = 4;
+	const CANON_ALL         = 7;
+
 	private $message;
 
 	private $originator;
@@ -26,6 +31,10 @@ class PmtaMessage
 	private $jobid;
 	private $encoding;
 	private $recipients;
+	private $retain_recipients;
+	private $recipients_digest;
+	private $canonicalize;
+	private $cloneable;
 
 	public function __construct($originator);
 	public function __destruct();
@@ -34,11 +43,28 @@ class PmtaMessage
 	public function __set($property, $value);
 	public function beginPart($number);
 	public function addData($data);
+	public function addDataParts(array $parts);
+	public function addBase64Data($data);
+	public function addQuotedPrintableData($data);
+	public function addFile($path, $encoding = self::ENCODING_BASE64);
+	public function addStream($stream, $maxlen = -1);
 	public function addMergeData($data);
 	public function addDateHeader();
+	public function addDateAndMessageId($domain);
+	public function addCachedPart($key, $data = null);
+	public static function clearPartCache();
+	public static function getPartCacheStats();
+	public function addTemplate(PmtaTemplate $template);
 	public function addRecipient(PmtaRecipient $recipient);
+	public function addRecipients(array $recipients);
+	public function addRecipientsFromCsv($path, array $columns, $offset = 0, $limit = 0, $delimiter = ',');
+	public function addRecipientList(PmtaRecipientList $list);
+	public function recipientCount();
+	public function memoryUsage();
+	public function bodySize();
+	public function reset($originator);
 	public function getLastError();
-	private function __clone();
+	public function __clone();
 }
 @endcode
  */
@@ -51,8 +77,21 @@ class PmtaMessage
 #define PMTA_MESSAGE_H
 
 #include "php_pmta.h"
+#include "pmta_common.h"
+#include "pmta_encode.h"
+#include "pmta_async.h"
 #include <submitter/PmtaMsg.h>
 
+/**
+ * @brief Part cached by @c PmtaMessage::addCachedPart() (value of @c part_cache)
+ */
+typedef struct _pmta_cached_part {
+	char* data;             /**< Canonicalized data, allocated persistently */
+	size_t len;             /**< Length of @c data */
+	pmta_uint64 digest;     /**< Digest of the data the part has been made of */
+	pmta_canon_state state; /**< Canonicalization state at the end of @c data */
+} pmta_cached_part;
+
 /**
  * @brief Extracts @c PmtaMsg from @c PmtaMessage object
  * @param object @c PmtaMessage object
@@ -61,6 +100,85 @@ class PmtaMessage
  */
 PHPPMTA_VISIBILITY_HIDDEN extern PmtaMsg getMessage(zval* object TSRMLS_DC);
 
+/**
+ * @brief Applies the body operations recorded since the last call to @c PmtaMsg
+ * @param object @c PmtaMessage object
+ * @param code Error code (output)
+ * @param error Error message (output)
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the body is ready for submission
+ * @retval SUCCESS Yes
+ * @retval FAILURE No, see @a code and @a error
+ * @note Must be called before the message returned by @c getMessage() is submitted
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern int flush_message(zval* object, int* code, const char** error TSRMLS_DC);
+
+/**
+ * @brief Appends data to the body of @c PmtaMessage object (as @c addData() does)
+ * @param object @c PmtaMessage object
+ * @param data Data
+ * @param len Length of @a data
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE if the message is locked or the data has not been accepted (@c PmtaErrorMessage has been thrown)
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern int append_message_data(zval* object, const char* data, size_t len TSRMLS_DC);
+
+/**
+ * @brief Returns the originator of @c PmtaMessage object
+ * @param object @c PmtaMessage object
+ * @param tsrm_ls Internally used by Zend
+ * @return Originator
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern const char* getMessageOriginator(zval* object TSRMLS_DC);
+
+/**
+ * @brief Returns the JobID of @c PmtaMessage object
+ * @param object @c PmtaMessage object
+ * @param tsrm_ls Internally used by Zend
+ * @return JobID or @c NULL if not set
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern const char* getMessageJobId(zval* object TSRMLS_DC);
+
+/**
+ * @brief Returns the Virtual MTA of @c PmtaMessage object
+ * @param object @c PmtaMessage object
+ * @param tsrm_ls Internally used by Zend
+ * @return Virtual MTA or @c NULL if not set
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern const char* getMessageVirtualMta(zval* object TSRMLS_DC);
+
+/**
+ * @brief Returns the address of the first recipient added to @c PmtaMessage object
+ * @param object @c PmtaMessage object
+ * @param tsrm_ls Internally used by Zend
+ * @return Recipient's address or @c NULL if the message has no recipients
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern const char* getMessageFirstRecipient(zval* object TSRMLS_DC);
+
+/**
+ * @brief Locks @c PmtaMessage object while it is being submitted in the background
+ * @param object @c PmtaMessage object
+ * @param job Pending job; the message keeps a reference to it and waits for it if it is freed while locked
+ * @param tsrm_ls Internally used by Zend
+ * @note Every call must be paired with @c unlock_message(); a message has at most one pending job
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void lock_message(zval* object, pmta_job* job TSRMLS_DC);
+
+/**
+ * @brief Releases the lock taken by @c lock_message()
+ * @param object @c PmtaMessage object
+ * @param tsrm_ls Internally used by Zend
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void unlock_message(zval* object TSRMLS_DC);
+
+/**
+ * @brief Checks whether @c PmtaMessage object is locked
+ * @param object @c PmtaMessage object
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the message is being submitted in the background
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern int is_message_locked(zval* object TSRMLS_DC);
+
 /**
  * @brief Registers @c PmtaMessage class
  * @param tsrm_ls Internally used by Zend
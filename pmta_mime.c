@@ -0,0 +1,731 @@
+/**
+ * @file pmta_mime.c
+ * @brief @c PmtaMimeBuilder class implementation
+ * @details Headers, boundaries and encoded parts are written into a growable buffer which is added
+ * to the message with @c addData() as soon as a part (or a multipart) is complete, so the buffer never holds
+ * more than one part. Base64 is encoded directly into the buffer.
+@code{.php}
+final class PmtaMimeBuilder
+{
+	private $message;
+	private $buffer     = '';
+	private $boundaries = array();
+	private $done       = false;
+
+	public function __construct(PmtaMessage $message)
+	{
+		$this->message = $message;
+	}
+
+	public function beginMultipart($subtype = 'mixed', array $headers = array())
+	{
+		$this->checkNotDone();
+		$this->checkHeader($subtype);
+		// Not random: a hash of the time, the object and the buffer length; "=_" cannot appear in base64 or quoted-printable data
+		$boundary = '=_' . hash('fnv1a64', microtime(true) . spl_object_hash($this) . strlen($this->buffer)) . '_' . count($this->boundaries);
+		$this->beginEntity();
+		$this->buffer .= "Content-Type: multipart/{$subtype}; boundary=\"{$boundary}\"\r\n" . $this->headers($headers) . "\r\n";
+		$this->boundaries[] = $boundary;
+		return $boundary;
+	}
+
+	public function addPart($content_type, $data, $encoding = null, array $headers = array())
+	{
+		$this->checkNotDone();
+		$this->checkHeader($content_type);
+		if (null === $encoding) {
+			$encoding = (preg_match('/[\x80-\xFF\x00]|[^\n]{999}/', $data)) ? PmtaMessage::ENCODING_BASE64 : PmtaMessage::ENCODING_7BIT;
+		}
+
+		$names = array(PmtaMessage::ENCODING_7BIT => '7bit', PmtaMessage::ENCODING_8BIT => '8bit', PmtaMessage::ENCODING_BASE64 => 'base64');
+		$this->beginEntity();
+		$this->buffer .= "Content-Type: {$content_type}\r\nContent-Transfer-Encoding: {$names[$encoding]}\r\n" . $this->headers($headers) . "\r\n";
+		// 7bit and 8bit data gets CRLF line endings; lines longer than 998 characters are rejected
+		$data = (PmtaMessage::ENCODING_BASE64 == $encoding) ? chunk_split(base64_encode($data)) : preg_replace('/\r\n?|\n/', "\r\n", $data);
+		$this->buffer .= (substr($data, -1) == "\n" || '' === $data) ? $data : "{$data}\r\n";
+		$this->flush();
+	}
+
+	public function endMultipart()
+	{
+		if (!$this->boundaries) {
+			throw new PmtaErrorMessage('No multipart to end');
+		}
+
+		$this->buffer .= '--' . array_pop($this->boundaries) . "--\r\n";
+		$this->flush();
+	}
+
+	public function getDepth()
+	{
+		return count($this->boundaries);
+	}
+
+	private function checkNotDone()
+	{
+		if ($this->done) {
+			throw new PmtaErrorMessage('The body has already been written to the message');
+		}
+	}
+
+	private function checkHeader($value)
+	{
+		// Line breaks would let the value inject headers or body parts
+		if (strpbrk($value, "\r\n") !== false) {
+			throw new PmtaErrorMessage('Header values cannot contain line breaks', PmtaApiERROR_IllegalArgument);
+		}
+	}
+
+	private function headers(array $headers)
+	{
+		$result = '';
+		foreach ($headers as $name => $value) {
+			$this->checkHeader($name);
+			$this->checkHeader($value);
+			$result .= (is_int($name) ? '' : "{$name}: ") . "{$value}\r\n";
+		}
+
+		return $result;
+	}
+
+	private function beginEntity()
+	{
+		// Top-level headers follow the headers added to the message with addData()
+		$this->buffer .= $this->boundaries ? '--' . end($this->boundaries) . "\r\n" : "MIME-Version: 1.0\r\n";
+	}
+
+	private function flush()
+	{
+		// The body is complete once the outermost multipart is closed; a rejected buffer is dropped
+		$data         = $this->buffer;
+		$this->buffer = '';
+		$this->message->addData($data);
+		$this->done   = !$this->boundaries;
+	}
+
+	private function __clone() {}
+}
+@endcode
+ */
+
+#include "pmta_mime.h"
+#include "pmta_message.h"
+#include "pmta_encode.h"
+#include "pmta_error.h"
+#include "pmta_common.h"
+
+/**
+ * @brief Maximum nesting level of multiparts
+ */
+#define PMTAMIME_MAX_DEPTH 8
+
+/**
+ * @brief Maximum length of a boundary
+ */
+#define PMTAMIME_BOUNDARY 32
+
+/**
+ * @brief @c PmtaMimeBuilder object handlers
+ */
+static zend_object_handlers pmtamime_object_handlers;
+
+/**
+ * @brief Internal properties of @c PmtaMimeBuilder
+ */
+typedef struct _pmtamime_object {
+	zend_object obj;                                        /**< Zend object data */
+	zval* message;                                          /**< @c PmtaMessage the body is written to */
+	char* buf;                                              /**< Buffer */
+	size_t len;                                             /**< Number of bytes used in @c buf */
+	size_t size;                                            /**< Size of @c buf */
+	int depth;                                              /**< Number of open multiparts */
+	int done;                                               /**< Whether the whole body has been written to the message */
+	char boundaries[PMTAMIME_MAX_DEPTH][PMTAMIME_BOUNDARY]; /**< Boundaries of the open multiparts */
+} pmtamime_object;
+
+/**
+ * @brief Fetches @c pmtamime_object
+ * @see pmtamime_object
+ * @param zobj @c PmtaMimeBuilder instance
+ * @return pmtamime_object associated with @a zobj
+ * @pre <tt>Z_TYPE_P(zobj) == IS_OBJECT && instanceof_function(Z_OBJCE_P(zobj), pmta_mime_class TSRMLS_CC)</tt>
+ */
+static inline pmtamime_object* fetchPmtaMimeObject(zval* zobj TSRMLS_DC)
+{
+	return (pmtamime_object*)zend_objects_get_address(zobj TSRMLS_CC);
+}
+
+/**
+ * @brief Reserves space in the buffer
+ * @param obj @c pmtamime_object
+ * @param n Number of bytes
+ * @return Pointer to the reserved space; @c obj->len is not changed
+ */
+static char* pmtamime_reserve(pmtamime_object* obj, size_t n)
+{
+	if (obj->len + n > obj->size) {
+		size_t size = obj->size ? obj->size : 4096;
+
+		while (obj->len + n > size) {
+			size *= 2;
+		}
+
+		obj->buf  = erealloc(obj->buf, size);
+		obj->size = size;
+	}
+
+	return obj->buf + obj->len;
+}
+
+/**
+ * @brief Appends data to the buffer
+ * @param obj @c pmtamime_object
+ * @param s Data
+ * @param n Length of @a s
+ */
+static inline void pmtamime_append(pmtamime_object* obj, const char* s, size_t n)
+{
+	memcpy(pmtamime_reserve(obj, n), s, n);
+	obj->len += n;
+}
+
+/**
+ * @brief Appends a @c NUL-terminated string to the buffer
+ * @param obj @c pmtamime_object
+ * @param s String
+ */
+static inline void pmtamime_append_str(pmtamime_object* obj, const char* s)
+{
+	pmtamime_append(obj, s, strlen(s));
+}
+
+/**
+ * @brief Checks that a header field does not contain line breaks (which would inject headers or body parts)
+ * @param s Value
+ * @param n Length of @a s
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the value is safe
+ * @throw pmta_error_message_class
+ */
+static int pmtamime_check_header(const char* s, size_t n TSRMLS_DC)
+{
+	if (memchr(s, '\r', n) || memchr(s, '\n', n)) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalArgument, "Header values cannot contain line breaks", NULL TSRMLS_CC);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Appends the additional headers
+ * @param obj @c pmtamime_object
+ * @param headers Headers: <tt>name => value</tt>, or complete header lines under integer keys
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE if a name or a value contains a line break (the headers appended so far stay in the buffer)
+ * @throw pmta_error_message_class
+ */
+static int pmtamime_append_headers(pmtamime_object* obj, HashTable* headers TSRMLS_DC)
+{
+	HashPosition pos;
+	zval** value;
+
+	if (!headers) {
+		return SUCCESS;
+	}
+
+	for (
+		zend_hash_internal_pointer_reset_ex(headers, &pos);
+		zend_hash_get_current_data_ex(headers, (void**)&value, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(headers, &pos)
+	) {
+		char* key;
+		uint key_len;
+		ulong idx;
+		zval tmp;
+
+		ZVAL_ZVAL(&tmp, *value, 1, 0);
+		convert_to_string(&tmp);
+
+		if (!pmtamime_check_header(Z_STRVAL(tmp), Z_STRLEN(tmp) TSRMLS_CC)) {
+			zval_dtor(&tmp);
+			return FAILURE;
+		}
+
+		if (HASH_KEY_IS_STRING == zend_hash_get_current_key_ex(headers, &key, &key_len, &idx, 0, &pos)) {
+			if (!pmtamime_check_header(key, key_len - 1 TSRMLS_CC)) {
+				zval_dtor(&tmp);
+				return FAILURE;
+			}
+
+			pmtamime_append(obj, key, key_len - 1);
+			pmtamime_append(obj, ": ", 2);
+		}
+
+		pmtamime_append(obj, Z_STRVAL(tmp), Z_STRLEN(tmp));
+		pmtamime_append(obj, "\r\n", 2);
+		zval_dtor(&tmp);
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief Starts a new entity: writes the delimiter of the enclosing multipart or @c MIME-Version header at the top level
+ * @param obj @c pmtamime_object
+ */
+static void pmtamime_begin_entity(pmtamime_object* obj)
+{
+	if (obj->depth) {
+		pmtamime_append(obj, "--", 2);
+		pmtamime_append_str(obj, obj->boundaries[obj->depth - 1]);
+		pmtamime_append(obj, "\r\n", 2);
+	}
+	else {
+		pmtamime_append_str(obj, "MIME-Version: 1.0\r\n");
+	}
+}
+
+/**
+ * @brief Chooses the transfer encoding for the data
+ * @param data Data
+ * @param len Length of @a data
+ * @return @c PmtaMsgENCODING_7BIT if the data is ASCII without @c NUL bytes and lines longer than 998 characters,
+ * @c PmtaMsgENCODING_BASE64 otherwise
+ */
+static long int pmtamime_detect_encoding(const unsigned char* data, size_t len)
+{
+	size_t line = 0;
+	size_t i;
+
+	for (i=0; i<len; ++i) {
+		unsigned char c = data[i];
+
+		if (c >= 0x80 || !c) {
+			return PmtaMsgENCODING_BASE64;
+		}
+
+		if ('\n' == c) {
+			line = 0;
+		}
+		else if (++line > 998) {
+			return PmtaMsgENCODING_BASE64;
+		}
+	}
+
+	return PmtaMsgENCODING_7BIT;
+}
+
+/**
+ * @brief Adds the buffer (a complete part or the end of a multipart) to the message
+ * @param obj @c pmtamime_object
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE (the message is locked or has not accepted the data)
+ * @details The body is complete when no multipart is open. The buffer is emptied either way, so that
+ * a rejected part is not sent with the next one.
+ */
+static int pmtamime_flush(pmtamime_object* obj TSRMLS_DC)
+{
+	size_t len = obj->len;
+
+	obj->len = 0;
+	if (FAILURE == append_message_data(obj->message, obj->buf, len TSRMLS_CC)) {
+		return FAILURE;
+	}
+
+	obj->done = !obj->depth;
+	return SUCCESS;
+}
+
+/**
+ * @brief Checks that the body has not been written to the message yet
+ * @param obj @c pmtamime_object
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether more entities may be added
+ * @throw pmta_error_message_class
+ */
+static int pmtamime_check_not_done(pmtamime_object* obj TSRMLS_DC)
+{
+	if (obj->done) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalState, "The body has already been written to the message", NULL TSRMLS_CC);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief @c PmtaMimeBuilder destructor
+ * @param v @c pmtamime_object
+ * @param tsrm_ls Internally used by Zend
+ * @details Frees all memory allocated for @c pmtamime_object and its members
+ */
+static void pmtamime_dtor(void* v TSRMLS_DC)
+{
+	pmtamime_object* obj = v;
+
+	if (obj->message) {
+		zval_ptr_dtor(&obj->message);
+	}
+
+	if (obj->buf) {
+		efree(obj->buf);
+	}
+
+	zend_object_std_dtor(&(obj->obj) TSRMLS_CC);
+	efree(obj);
+}
+
+/**
+ * @brief @c PmtaMimeBuilder constructor
+ * @param ce Class Entry for @c PmtaMimeBuilder
+ * @param tsrm_ls Internally used by Zend
+ * @return Zend Object Value
+ * @details Allocates memory for @c pmtamime_object and registers the destructor
+ */
+static zend_object_value pmtamime_ctor(zend_class_entry* ce TSRMLS_DC)
+{
+	pmtamime_object* obj = ecalloc(1, sizeof(pmtamime_object));
+	zend_object_value retval;
+
+	zend_object_std_init(&obj->obj, ce TSRMLS_CC);
+#if PHP_VERSION_ID >= 50400
+	object_properties_init(&obj->obj, ce);
+#endif
+
+	retval.handle = zend_objects_store_put(
+		obj,
+		(zend_objects_store_dtor_t)zend_objects_destroy_object,
+		pmtamime_dtor,
+		NULL TSRMLS_CC
+	);
+
+	retval.handlers = &pmtamime_object_handlers;
+
+	return retval;
+}
+
+/**
+ * @brief public function __construct(PmtaMessage $message);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaMimeBuilder, __construct)
+{
+	pmtamime_object* obj;
+	zval* message;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &message, pmta_msg_class)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMimeObject(getThis() TSRMLS_CC);
+	if (obj->message) {
+		zval_ptr_dtor(&obj->message);
+	}
+
+	Z_ADDREF_P(message);
+	obj->message = message;
+	obj->len     = 0;
+	obj->depth   = 0;
+	obj->done    = 0;
+}
+
+/**
+ * @brief public function beginMultipart($subtype = 'mixed', array $headers = array());
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ *
+ * Returns the boundary
+ */
+static PHP_METHOD(PmtaMimeBuilder, beginMultipart)
+{
+	pmtamime_object* obj;
+	char* subtype = "mixed";
+	int subtype_len;
+	zval* headers = NULL;
+	char* boundary;
+	pmta_uint64 h;
+	double now;
+	size_t mark;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|sa", &subtype, &subtype_len, &headers)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMimeObject(getThis() TSRMLS_CC);
+	if (!obj->message || !pmtamime_check_not_done(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	if (PMTAMIME_MAX_DEPTH == obj->depth) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalState, "Multiparts are nested too deep", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	if (!pmtamime_check_header(subtype, strlen(subtype) TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	/* Not random, but unique enough: the time, the object and the buffer length. "=_" cannot appear in base64 or quoted-printable data */
+	now = pmta_time_ms();
+	h   = pmta_digest_update(PMTA_DIGEST_INIT, (const char*)&now, sizeof(now));
+	h   = pmta_digest_update(h, (const char*)&obj, sizeof(obj));
+	h   = pmta_digest_update(h, (const char*)&obj->len, sizeof(obj->len));
+
+	boundary = obj->boundaries[obj->depth];
+	snprintf(boundary, PMTAMIME_BOUNDARY, "=_%08x%08x_%d", (unsigned int)(h >> 32), (unsigned int)h, obj->depth);
+
+	mark = obj->len;
+	pmtamime_begin_entity(obj);
+	pmtamime_append_str(obj, "Content-Type: multipart/");
+	pmtamime_append_str(obj, subtype);
+	pmtamime_append_str(obj, "; boundary=\"");
+	pmtamime_append_str(obj, boundary);
+	pmtamime_append_str(obj, "\"\r\n");
+	if (FAILURE == pmtamime_append_headers(obj, headers ? Z_ARRVAL_P(headers) : NULL TSRMLS_CC)) {
+		obj->len = mark;
+		RETURN_NULL();
+	}
+
+	pmtamime_append(obj, "\r\n", 2);
+
+	++obj->depth;
+	RETURN_STRING(boundary, 1);
+}
+
+/**
+ * @brief public function addPart($content_type, $data, $encoding = null, array $headers = array());
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ *
+ * @c $encoding is one of @c PmtaMessage::ENCODING_* constants; when it is @c null, @c ENCODING_7BIT is used
+ * for ASCII data with lines of at most 998 characters and @c ENCODING_BASE64 otherwise.
+ * 7bit and 8bit data is converted to CRLF line endings; lines longer than 998 characters are rejected.
+ * The part is added to the message right away, together with the headers and boundaries written before it.
+ * @c $content_type and the @c $headers cannot contain line breaks.
+ */
+static PHP_METHOD(PmtaMimeBuilder, addPart)
+{
+	pmtamime_object* obj;
+	char* content_type;
+	int content_type_len;
+	char* data;
+	int data_len;
+	zval* z_encoding = NULL;
+	zval* headers    = NULL;
+	long int encoding;
+	const char* name;
+	size_t mark;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ss|z!a", &content_type, &content_type_len, &data, &data_len, &z_encoding, &headers)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMimeObject(getThis() TSRMLS_CC);
+	if (!obj->message || !pmtamime_check_not_done(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	if (!pmtamime_check_header(content_type, content_type_len TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	if (z_encoding) {
+		zval tmp;
+
+		/* The caller's variable must not be converted */
+		ZVAL_ZVAL(&tmp, z_encoding, 1, 0);
+		convert_to_long(&tmp);
+		encoding = Z_LVAL(tmp);
+	}
+	else {
+		encoding = pmtamime_detect_encoding((const unsigned char*)data, data_len);
+	}
+
+	switch (encoding) {
+		case PmtaMsgENCODING_7BIT:   name = "7bit";   break;
+		case PmtaMsgENCODING_8BIT:   name = "8bit";   break;
+		case PmtaMsgENCODING_BASE64: name = "base64"; break;
+		default:
+			throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalArgument, "Unknown encoding", NULL TSRMLS_CC);
+			RETURN_NULL();
+	}
+
+	mark = obj->len;
+	pmtamime_begin_entity(obj);
+	pmtamime_append_str(obj, "Content-Type: ");
+	pmtamime_append(obj, content_type, content_type_len);
+	pmtamime_append_str(obj, "\r\nContent-Transfer-Encoding: ");
+	pmtamime_append_str(obj, name);
+	pmtamime_append(obj, "\r\n", 2);
+	if (FAILURE == pmtamime_append_headers(obj, headers ? Z_ARRVAL_P(headers) : NULL TSRMLS_CC)) {
+		obj->len = mark;
+		RETURN_NULL();
+	}
+
+	pmtamime_append(obj, "\r\n", 2);
+
+	if (PmtaMsgENCODING_BASE64 == encoding) {
+		char* p   = pmtamime_reserve(obj, pmta_base64_size(data_len));
+		obj->len += pmta_base64_encode((const unsigned char*)data, data_len, p);
+	}
+	else {
+		pmta_canon_state state = { 0, 0 };
+		char* p  = pmtamime_reserve(obj, 2 * (size_t)data_len);
+		size_t n = pmta_canonicalize(&state, PMTA_CANON_CRLF | PMTA_CANON_LINE_LENGTH, data, data_len, p);
+
+		if ((size_t)-1 == n) {
+			obj->len = mark;
+			throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalArgument, "Line is longer than 998 characters", NULL TSRMLS_CC);
+			RETURN_NULL();
+		}
+
+		obj->len += n;
+		if (n && p[n - 1] != '\n') {
+			pmtamime_append(obj, "\r\n", 2);
+		}
+	}
+
+	if (FAILURE == pmtamime_flush(obj TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	RETURN_TRUE;
+}
+
+/**
+ * @brief public function endMultipart();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ *
+ * Closes the innermost multipart; when it is the outermost one, the body is complete
+ */
+static PHP_METHOD(PmtaMimeBuilder, endMultipart)
+{
+	pmtamime_object* obj;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaMimeObject(getThis() TSRMLS_CC);
+	if (!obj->depth) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalState, "No multipart to end", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	--obj->depth;
+	pmtamime_append(obj, "--", 2);
+	pmtamime_append_str(obj, obj->boundaries[obj->depth]);
+	pmtamime_append(obj, "--\r\n", 4);
+
+	if (FAILURE == pmtamime_flush(obj TSRMLS_CC)) {
+		/* The multipart is still open */
+		++obj->depth;
+		RETURN_NULL();
+	}
+
+	RETURN_TRUE;
+}
+
+/**
+ * @brief public function getDepth();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns the number of open multiparts
+ */
+static PHP_METHOD(PmtaMimeBuilder, getDepth)
+{
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	RETURN_LONG(fetchPmtaMimeObject(getThis() TSRMLS_CC)->depth);
+}
+
+/**
+ * @brief arginfo for @c __construct()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_construct, 0, 0, 1)
+	ZEND_ARG_OBJ_INFO(0, message, PmtaMessage, 0)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c beginMultipart()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_beginmultipart, 0, 0, 0)
+	ZEND_ARG_INFO(0, subtype)
+	ZEND_ARG_ARRAY_INFO(0, headers, 0)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c addPart()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_addpart, 0, 0, 2)
+	ZEND_ARG_INFO(0, content_type)
+	ZEND_ARG_INFO(0, data)
+	ZEND_ARG_INFO(0, encoding)
+	ZEND_ARG_ARRAY_INFO(0, headers, 0)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief @c PmtaMimeBuilder class methods
+ */
+static
+#if ZEND_MODULE_API_NO > 20060613
+const
+#endif
+zend_function_entry pmta_mime_class_methods[] = {
+	PHP_ME(PmtaMimeBuilder, __construct,    arginfo_construct,      ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(PmtaMimeBuilder, beginMultipart, arginfo_beginmultipart, ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMimeBuilder, addPart,        arginfo_addpart,        ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMimeBuilder, endMultipart,   arginfo_empty,          ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaMimeBuilder, getDepth,       arginfo_empty,          ZEND_ACC_PUBLIC)
+	PHP_ME_MAPPING(__destruct, empty_destructor, arginfo_empty, ZEND_ACC_PUBLIC | ZEND_ACC_DTOR)
+	PHP_FE_END
+};
+
+/**
+ * Registers @c PmtaMimeBuilder class with Zend
+ */
+void pmtamime_register_class(TSRMLS_D)
+{
+	zend_class_entry e;
+
+	INIT_CLASS_ENTRY(e, "PmtaMimeBuilder", pmta_mime_class_methods);
+
+	pmta_mime_class = zend_register_internal_class(&e TSRMLS_CC);
+
+	pmta_mime_class->ce_flags     |= ZEND_ACC_FINAL_CLASS;
+	pmta_mime_class->create_object = pmtamime_ctor;
+	pmta_mime_class->serialize     = zend_class_serialize_deny;
+	pmta_mime_class->unserialize   = zend_class_unserialize_deny;
+
+	pmtamime_object_handlers = *zend_get_std_object_handlers();
+	pmtamime_object_handlers.clone_obj = NULL;
+}
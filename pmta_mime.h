@@ -0,0 +1,34 @@
+/**
+ * @file pmta_mime.h
+ * @brief Exposes @c PmtaMimeBuilder class
+ * @details
+@code{.php}
+final class PmtaMimeBuilder
+{
+	public function __construct(PmtaMessage $message);
+	public function __destruct();
+	public function beginMultipart($subtype = 'mixed', array $headers = array());
+	public function addPart($content_type, $data, $encoding = null, array $headers = array());
+	public function endMultipart();
+	public function getDepth();
+	private function __clone();
+}
+@endcode
+ */
+
+#ifdef DOXYGEN
+#	undef PMTA_MIME_H
+#endif
+
+#ifndef PMTA_MIME_H
+#define PMTA_MIME_H
+
+#include "php_pmta.h"
+
+/**
+ * @brief Registers @c PmtaMimeBuilder class
+ * @param tsrm_ls Internally used by Zend
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmtamime_register_class(TSRMLS_D);
+
+#endif /* PMTA_MIME_H */
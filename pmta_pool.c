@@ -0,0 +1,1263 @@
+/**
+ * @file pmta_pool.c
+ * @brief @c PmtaConnectionPool class (implementation)
+ * @details @c PmtaConnectionPool class implementation
+@code{.php}
+class PmtaConnectionPool
+{
+	const ROUTE_JOBID    = 1;
+	const ROUTE_VMTA     = 2;
+	const ROUTE_DOMAIN   = 3;
+	const ROUTE_ADAPTIVE = 4;
+
+	private $nodes = array(); // "host:port" => PmtaConnection (connected on first use)
+	private $ring  = array(); // hash => "host:port", 160 points per node
+
+	private $route;
+	private $username;
+	private $password;
+
+	public function __construct($servers = null, $route = self::ROUTE_DOMAIN, $username = null, $password = null, $flags = null)
+	{
+		if ($this->nodes) {
+			throw new PmtaErrorConnection('The pool has already been initialized', PmtaApiERROR_IllegalState);
+		}
+
+		if ($route < self::ROUTE_JOBID || $route > self::ROUTE_ADAPTIVE) {
+			throw new PmtaErrorConnection('Unknown route', PmtaApiERROR_IllegalArgument);
+		}
+
+		if (null === $servers) {
+			$servers = preg_split('/[\s,]+/', ini_get('pmta.servers'), -1, PREG_SPLIT_NO_EMPTY);
+		}
+
+		foreach ((array)$servers as $server) {
+			$this->nodes[$server] = null;
+			for ($i=0; $i<160; ++$i) {
+				$this->ring[hash("{$server}-{$i}")] = $server;
+			}
+		}
+
+		ksort($this->ring);
+	}
+
+	public function getServer(PmtaMessage $message)
+	{
+		switch ($this->route) {
+			case self::ROUTE_JOBID: $key = $message->jobid; break;
+			case self::ROUTE_VMTA:  $key = $message->vmta; break;
+			default:                $key = strtolower(substr(strrchr($message->recipients[0]->address, '@'), 1)); break;
+		}
+
+		// First point of the ring clockwise from hash($key)
+		return $this->ring[first_key_greater_or_equal($this->ring, hash($key))];
+	}
+
+	public function submitMessage(PmtaMessage $message)
+	{
+		// Walks the ring clockwise from getServer($message) until a node accepts the connection
+		foreach ($this->nodesFrom($this->getServer($message)) as $server) {
+			if (!$this->nodes[$server]) {
+				$this->nodes[$server] = new PmtaConnection($host, $port, $this->username, $this->password, $flags);
+			}
+
+			return $this->nodes[$server]->submitMessage($message);
+		}
+	}
+
+	public function getNodeStats()
+	{
+		// EWMA of submission latency and failure ratio are kept per process and survive requests
+		foreach ($this->nodes as $server => $conn) {
+			$stats[] = array('server' => $server, 'latency' => ..., 'error_rate' => ..., 'weight' => ..., 'submitted' => ..., 'failed' => ...);
+		}
+
+		return $stats;
+	}
+
+	public function getLastError();
+	private function __clone() {}
+}
+@endcode
+*/
+
+#include "pmta_pool.h"
+#include "pmta_connection.h"
+#include "pmta_error.h"
+#include "pmta_message.h"
+#include "pmta_common.h"
+#include <PmtaApi.h>
+#include <ext/standard/php_rand.h>
+#include <time.h>
+
+/**
+ * @brief Route messages by JobID
+ */
+#define PMTAPOOL_ROUTE_JOBID 1
+
+/**
+ * @brief Route messages by Virtual MTA
+ */
+#define PMTAPOOL_ROUTE_VMTA 2
+
+/**
+ * @brief Route messages by the domain of the first recipient
+ */
+#define PMTAPOOL_ROUTE_DOMAIN 3
+
+/**
+ * @brief Route messages to the fastest healthy node (weighted by latency and error rate)
+ */
+#define PMTAPOOL_ROUTE_ADAPTIVE 4
+
+/**
+ * @brief Smoothing factor of the exponentially weighted moving averages
+ */
+#define PMTAPOOL_EWMA_ALPHA 0.2
+
+/**
+ * @brief Minimum weight of a reachable node, relative to the best weight, so that a failing node can recover
+ */
+#define PMTAPOOL_MIN_SHARE 0.01
+
+/**
+ * @brief Number of points each node occupies on the hash ring
+ */
+#define PMTAPOOL_POINTS 160
+
+/**
+ * @brief For how long (seconds) a node which refused the connection is skipped
+ */
+#define PMTAPOOL_RETRY_INTERVAL 5
+
+/**
+ * @brief @c PmtaConnectionPool object handlers
+ */
+static zend_object_handlers pmtapool_object_handlers;
+
+/**
+ * @brief Submission statistics of a PowerMTA node
+ * @note Stored in @c PMTA_G(node_stats) so that the averages survive requests
+ */
+typedef struct _pmtapool_stats {
+	double latency;      /**< EWMA of successful submission latency, ms */
+	double error_rate;   /**< EWMA of the failure ratio, 0..1 */
+	long int submitted;  /**< Number of successful submissions */
+	long int failed;     /**< Number of failed submissions and connection attempts */
+} pmtapool_stats;
+
+/**
+ * @brief PowerMTA node
+ */
+typedef struct _pmtapool_node {
+	char* server;      /**< PowerMTA server */
+	long int port;     /**< Server port */
+	PmtaConn conn;     /**< PMTA Connection handle, @c NULL if not connected yet */
+	pmta_pconn* pconn; /**< Persistent connection @c conn is borrowed from */
+	zend_bool reused;  /**< Whether @c conn is a reused persistent connection which has not been used yet */
+	time_t down_until; /**< The node is skipped until this time after a failed connection attempt */
+	pmtapool_stats* stats; /**< Submission statistics (owned by @c PMTA_G(node_stats)) */
+} pmtapool_node;
+
+/**
+ * @brief Point on the hash ring
+ */
+typedef struct _pmtapool_point {
+	zend_uint hash; /**< Position on the ring */
+	int node;       /**< Index of the node in @c pmtapool_object::nodes */
+} pmtapool_point;
+
+/**
+ * @brief Internal properties of @c PmtaConnectionPool
+ */
+typedef struct _pmtapool_object {
+	zend_object obj;       /**< Zend object data */
+	pmtapool_node* nodes;  /**< PowerMTA nodes */
+	pmtapool_point* ring;  /**< Hash ring, sorted by @c hash */
+	char* username;        /**< Username to authenticate with */
+	char* password;        /**< Password to authenticate with */
+	char* error;           /**< Last error message */
+	int error_code;        /**< Last error code */
+	int num_nodes;         /**< Number of nodes */
+	int ring_size;         /**< Number of points on the ring */
+	int route;             /**< Routing key (@c PMTAPOOL_ROUTE_XXX) */
+	int flags;             /**< Connection flags (@c PMTACONN_PERSISTENT) */
+} pmtapool_object;
+
+/**
+ * @brief Fetches @c pmtapool_object
+ * @see pmtapool_object
+ * @param zobj @c PmtaConnectionPool instance
+ * @return pmtapool_object associated with @a zobj
+ * @pre <tt>Z_TYPE_P(zobj) == IS_OBJECT && instanceof_function(Z_OBJCE_P(zobj), pmta_pool_class TSRMLS_CC)</tt>
+ */
+static inline pmtapool_object* fetchPmtaPoolObject(zval* zobj TSRMLS_DC)
+{
+	return (pmtapool_object*)zend_objects_get_address(zobj TSRMLS_CC);
+}
+
+/**
+ * @brief Remembers the last error
+ * @param obj @c pmtapool_object
+ * @param code Error code
+ * @param message Error message
+ */
+static void pmtapool_set_error(pmtapool_object* obj, int code, const char* message)
+{
+	if (obj->error) {
+		efree(obj->error);
+	}
+
+	obj->error      = estrdup(message ? message : "");
+	obj->error_code = code;
+}
+
+/**
+ * @brief Parses <tt>host[:port]</tt> and appends the node to the pool
+ * @param obj @c pmtapool_object
+ * @param spec Server specification
+ * @param len Length of @a spec
+ * @param default_port Port to use if @a spec does not contain one
+ */
+static void pmtapool_add_node(pmtapool_object* obj, const char* spec, int len, long int default_port TSRMLS_DC)
+{
+	const char* colon;
+	long int port = default_port;
+	pmtapool_node* node;
+	char* key;
+	int key_len;
+
+	while (len > 0 && (*spec == ' ' || *spec == '\t')) {
+		++spec;
+		--len;
+	}
+
+	while (len > 0 && (spec[len-1] == ' ' || spec[len-1] == '\t')) {
+		--len;
+	}
+
+	if (!len) {
+		return;
+	}
+
+	colon = zend_memrchr(spec, ':', len);
+	if (colon && colon == memchr(spec, ':', len)) {
+		port = strtol(colon + 1, NULL, 10);
+		len  = colon - spec;
+		if (port <= 0) {
+			port = default_port;
+		}
+	}
+
+	obj->nodes = erealloc(obj->nodes, (obj->num_nodes + 1) * sizeof(pmtapool_node));
+	node       = &obj->nodes[obj->num_nodes++];
+	memset(node, 0, sizeof(pmtapool_node));
+
+	node->server = estrndup(spec, len);
+	node->port   = port;
+
+	key_len = spprintf(&key, 0, "%s:%ld", node->server, node->port);
+	if (FAILURE == zend_hash_find(&PMTA_G(node_stats), key, key_len + 1, (void**)&node->stats)) {
+		pmtapool_stats stats;
+		memset(&stats, 0, sizeof(stats));
+		zend_hash_add(&PMTA_G(node_stats), key, key_len + 1, (void*)&stats, sizeof(pmtapool_stats), (void**)&node->stats);
+	}
+
+	efree(key);
+}
+
+/**
+ * @brief Updates EWMA of the node's latency and error rate
+ * @param node Node
+ * @param ok Whether the operation succeeded
+ * @param latency How long the operation took, ms (ignored if @a ok is 0)
+ */
+static void pmtapool_update_stats(pmtapool_node* node, int ok, double latency)
+{
+	pmtapool_stats* stats = node->stats;
+
+	if (ok) {
+		stats->latency = stats->submitted ? stats->latency + PMTAPOOL_EWMA_ALPHA * (latency - stats->latency) : latency;
+		++stats->submitted;
+	}
+	else {
+		++stats->failed;
+	}
+
+	stats->error_rate += PMTAPOOL_EWMA_ALPHA * ((ok ? 0.0 : 1.0) - stats->error_rate);
+}
+
+/**
+ * @brief Calculates routing weights of the nodes
+ * @param obj @c pmtapool_object
+ * @param weights Weights (output, @c obj->num_nodes elements)
+ * @param now Current time
+ * @return Sum of the weights
+ *
+ * The weight is <tt>((1 - error_rate) / (1 + latency))^2</tt>: a node three times slower gets about a ninth
+ * of the traffic. A failing node still gets a trickle of messages so that it can recover: no reachable node
+ * weighs less than @c PMTAPOOL_MIN_SHARE of the best one. Nodes which recently refused the connection get nothing;
+ * nodes without latency samples get the best known weight.
+ */
+static double pmtapool_weights(const pmtapool_object* obj, double* weights, time_t now)
+{
+	double best  = 0;
+	double total = 0;
+	int i;
+
+	for (i=0; i<obj->num_nodes; ++i) {
+		const pmtapool_node* node = &obj->nodes[i];
+		double w;
+
+		if (!node->conn && node->down_until > now) {
+			weights[i] = -2;
+			continue;
+		}
+
+		if (!node->stats->submitted) {
+			weights[i] = -1;
+			continue;
+		}
+
+		w          = (1.0 - node->stats->error_rate) / (1.0 + node->stats->latency);
+		weights[i] = w * w;
+		if (weights[i] > best) {
+			best = weights[i];
+		}
+	}
+
+	for (i=0; i<obj->num_nodes; ++i) {
+		if (-2 == weights[i]) {
+			weights[i] = 0;
+		}
+		else if (weights[i] < 0) {
+			weights[i] = (best > 0) ? best : 1.0;
+		}
+		else if (best <= 0) {
+			/* Every reachable node keeps failing: spread the traffic evenly */
+			weights[i] = 1.0;
+		}
+		else if (weights[i] < best * PMTAPOOL_MIN_SHARE) {
+			weights[i] = best * PMTAPOOL_MIN_SHARE;
+		}
+
+		total += weights[i];
+	}
+
+	return total;
+}
+
+/**
+ * @brief @c qsort() callback to order ring points
+ * @param a First point
+ * @param b Second point
+ * @return Comparison result
+ */
+static int pmtapool_point_compare(const void* a, const void* b)
+{
+	zend_uint x = ((const pmtapool_point*)a)->hash;
+	zend_uint y = ((const pmtapool_point*)b)->hash;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+/**
+ * @brief Builds the hash ring
+ * @param obj @c pmtapool_object
+ *
+ * Point positions depend only on <tt>host:port</tt> of the node, so adding or removing a node
+ * moves only the keys which fall on the arcs owned by that node.
+ */
+static void pmtapool_build_ring(pmtapool_object* obj)
+{
+	char buf[320];
+	int i, j, k = 0;
+
+	obj->ring_size = obj->num_nodes * PMTAPOOL_POINTS;
+	obj->ring      = safe_emalloc(obj->ring_size, sizeof(pmtapool_point), 0);
+
+	for (i=0; i<obj->num_nodes; ++i) {
+		for (j=0; j<PMTAPOOL_POINTS; ++j) {
+			int len = snprintf(buf, sizeof(buf), "%s:%ld-%d", obj->nodes[i].server, obj->nodes[i].port, j);
+			if (len < 0 || len >= (int)sizeof(buf)) {
+				len = sizeof(buf) - 1;
+			}
+
+			obj->ring[k].hash = pmta_hash(buf, len);
+			obj->ring[k].node = i;
+			++k;
+		}
+	}
+
+	qsort(obj->ring, obj->ring_size, sizeof(pmtapool_point), pmtapool_point_compare);
+}
+
+/**
+ * @brief Finds the ring position which serves the message
+ * @param obj @c pmtapool_object
+ * @param message @c PmtaMessage instance
+ * @param tsrm_ls Internally used by Zend
+ * @return Index of the first ring point clockwise from the hash of the routing key
+ * @pre <tt>obj->ring_size > 0</tt>
+ */
+static int pmtapool_locate(const pmtapool_object* obj, zval* message TSRMLS_DC)
+{
+	const char* key = NULL;
+	const char* at;
+	char* lkey;
+	size_t len;
+	zend_uint h;
+	int lo = 0;
+	int hi = obj->ring_size;
+
+	switch (obj->route) {
+		case PMTAPOOL_ROUTE_JOBID: key = getMessageJobId(message TSRMLS_CC);          break;
+		case PMTAPOOL_ROUTE_VMTA:  key = getMessageVirtualMta(message TSRMLS_CC);     break;
+		default:                   key = getMessageFirstRecipient(message TSRMLS_CC); break;
+	}
+
+	if (!key || !*key) {
+		key = getMessageOriginator(message TSRMLS_CC);
+		if (!key) {
+			key = "";
+		}
+	}
+
+	if (PMTAPOOL_ROUTE_JOBID != obj->route && PMTAPOOL_ROUTE_VMTA != obj->route) {
+		/* Only the domain part of an address counts; JobIDs and VMTA names may contain '@' themselves */
+		at = strrchr(key, '@');
+		if (at) {
+			key = at + 1;
+		}
+
+		len  = strlen(key);
+		lkey = estrndup(key, len);
+		zend_str_tolower(lkey, len);
+		h    = pmta_hash(lkey, len);
+		efree(lkey);
+	}
+	else {
+		h = pmta_hash(key, strlen(key));
+	}
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (obj->ring[mid].hash < h) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return (lo == obj->ring_size) ? 0 : lo;
+}
+
+/**
+ * @brief Connects to the node if it is not connected yet
+ * @param obj @c pmtapool_object
+ * @param node Node
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the node is connected
+ * @retval SUCCESS Yes
+ * @retval FAILURE No, the error is stored in @a obj
+ */
+static int pmtapool_connect_node(pmtapool_object* obj, pmtapool_node* node TSRMLS_DC)
+{
+	if (node->conn) {
+		return SUCCESS;
+	}
+
+	if (SUCCESS == pmtaconn_open(&node->conn, &node->pconn, &node->reused, node->server, node->port, obj->username, obj->password, (obj->flags & PMTACONN_PERSISTENT) ? 1 : 0 TSRMLS_CC)) {
+		node->down_until = 0;
+		return SUCCESS;
+	}
+
+	if (!node->conn) {
+		pmtapool_set_error(obj, PmtaApiERROR_PHP_API, "PmtaConnAlloc() failed");
+	}
+	else {
+		pmtapool_set_error(obj, PmtaConnGetLastErrorType(node->conn), PmtaConnGetLastError(node->conn));
+		PmtaConnFree(node->conn);
+		node->conn = NULL;
+	}
+
+	node->down_until = time(NULL) + PMTAPOOL_RETRY_INTERVAL;
+	pmtapool_update_stats(node, 0, 0);
+	return FAILURE;
+}
+
+/**
+ * @brief Picks the node for the message and makes sure it is connected
+ * @param obj @c pmtapool_object
+ * @param message @c PmtaMessage instance
+ * @param tsrm_ls Internally used by Zend
+ * @return Connected node or @c NULL if no node accepted the connection
+ *
+ * Nodes are tried in ring order starting from the one owning the message's routing key, so that a failed
+ * node's traffic is spread over its ring successors. Nodes which recently refused the connection are tried last.
+ */
+static pmtapool_node* pmtapool_pick_node(pmtapool_object* obj, zval* message TSRMLS_DC)
+{
+	int* order     = safe_emalloc(obj->num_nodes, sizeof(int), 0);
+	char* seen     = ecalloc(obj->num_nodes, 1);
+	int count      = 0;
+	int i          = pmtapool_locate(obj, message TSRMLS_CC);
+	int k, pass;
+	time_t now     = time(NULL);
+	pmtapool_node* result = NULL;
+
+	for (k=0; k<obj->ring_size && count<obj->num_nodes; ++k) {
+		int n = obj->ring[(i + k) % obj->ring_size].node;
+		if (!seen[n]) {
+			seen[n]        = 1;
+			order[count++] = n;
+		}
+	}
+
+	for (pass=0; pass<2 && !result; ++pass) {
+		for (k=0; k<count; ++k) {
+			pmtapool_node* node = &obj->nodes[order[k]];
+			int is_down         = (!node->conn && node->down_until > now);
+
+			if ((0 == pass && is_down) || (1 == pass && !is_down)) {
+				continue;
+			}
+
+			if (SUCCESS == pmtapool_connect_node(obj, node TSRMLS_CC)) {
+				result = node;
+				break;
+			}
+		}
+	}
+
+	efree(order);
+	efree(seen);
+	return result;
+}
+
+/**
+ * @brief Picks a node at random, weighted by @c pmtapool_weights(), and makes sure it is connected
+ * @param obj @c pmtapool_object
+ * @param message @c PmtaMessage instance
+ * @param tsrm_ls Internally used by Zend
+ * @return Connected node or @c NULL if no node accepted the connection
+ */
+static pmtapool_node* pmtapool_pick_adaptive(pmtapool_object* obj, zval* message TSRMLS_DC)
+{
+	double* weights = safe_emalloc(obj->num_nodes, sizeof(double), 0);
+	pmtapool_node* result = NULL;
+	int attempt;
+
+	for (attempt=0; attempt<obj->num_nodes && !result; ++attempt) {
+		double total = pmtapool_weights(obj, weights, time(NULL));
+		double r;
+		int pick = -1;
+		int i;
+
+		if (total <= 0) {
+			break;
+		}
+
+		/* Only nodes with a positive weight can be picked, even if rounding leaves r past the last one */
+		r = total * ((double)php_rand(TSRMLS_C) / ((double)PHP_RAND_MAX + 1.0));
+		for (i=0; i<obj->num_nodes; ++i) {
+			if (weights[i] <= 0) {
+				continue;
+			}
+
+			pick = i;
+			if (r < weights[i]) {
+				break;
+			}
+
+			r -= weights[i];
+		}
+
+		if (SUCCESS == pmtapool_connect_node(obj, &obj->nodes[pick] TSRMLS_CC)) {
+			result = &obj->nodes[pick];
+		}
+	}
+
+	efree(weights);
+	return result ? result : pmtapool_pick_node(obj, message TSRMLS_CC);
+}
+
+/**
+ * @brief Lists nodes of the pool
+ * @param obj @c pmtapool_object
+ * @param ret Array of <tt>host:port</tt> strings (output)
+ */
+static void pmtapool_get_servers(const pmtapool_object* obj, zval* ret)
+{
+	int i;
+
+	array_init_size(ret, obj->num_nodes);
+	for (i=0; i<obj->num_nodes; ++i) {
+		char* s;
+		int len = spprintf(&s, 0, "%s:%ld", obj->nodes[i].server, obj->nodes[i].port);
+		add_next_index_stringl(ret, s, len, 0);
+	}
+}
+
+/**
+ * @brief Internal implementation of @c __get() method
+ * @see pmtapool_object
+ * @param obj @c pmtapool_object
+ * @param member Property to read
+ * @param type If @c BP_VAR_IS, error messages will be suppressed
+ * @return Property value
+ * @exception @c E_WARNING if @c member is not a valid property and @a type != @c BP_VAR_IS
+ * @pre <tt>Z_TYPE_P(member) == IS_STRING</tt>
+ * @note Reference count of the result value will be 0
+ */
+static zval* pmtapool_read_property_internal(pmtapool_object* obj, zval* member, int type)
+{
+	zval* ret;
+	MAKE_STD_ZVAL(ret);
+
+	if (ISSTR(member, "servers")) {
+		pmtapool_get_servers(obj, ret);
+	}
+	else if (ISSTR(member, "route")) {
+		ZVAL_LONG(ret, obj->route);
+	}
+	else if (ISSTR(member, "username")) {
+		if (obj->username) {
+			ZVAL_STRING(ret, obj->username, 1);
+		}
+		else {
+			ZVAL_NULL(ret);
+		}
+	}
+	else {
+		if (type != BP_VAR_IS) {
+			zend_error(E_WARNING, "Undefined property PmtaConnectionPool::%s", Z_STRVAL_P(member));
+		}
+
+		ZVAL_NULL(ret);
+	}
+
+	Z_SET_REFCOUNT_P(ret, 0);
+	return ret;
+}
+
+/**
+ * @brief @c read_property handler
+ * @param object @c PmtaConnectionPool instance
+ * @param member Property to read
+ * @param type Read type (@c BP_VAR_R, @c BP_VAR_IS)
+ * @param key Zend literal associated with @a member
+ * @return Property value
+ * @note Reference count of the result is not incremented
+ * @pre <tt>Z_TYPE_P(object) == IS_OBJECT && instanceof_function(Z_OBJCE_P(object), pmta_pool_class TSRMLS_CC)</tt>
+ */
+static zval* pmtapool_read_property(zval* object, zval* member, int type ZLK_DC TSRMLS_DC)
+{
+	zval tmp;
+	zval* ret;
+	pmtapool_object* obj = fetchPmtaPoolObject(object TSRMLS_CC);
+
+	if (obj->obj.ce->type != ZEND_INTERNAL_CLASS) {
+		return zend_get_std_object_handlers()->read_property(object, member, type ZLK_CC TSRMLS_CC);
+	}
+
+	if (UNEXPECTED(Z_TYPE_P(member) != IS_STRING)) {
+		ZVAL_ZVAL(&tmp, member, 1, 0);
+		convert_to_string(&tmp);
+		member = &tmp;
+	}
+
+	ret = pmtapool_read_property_internal(obj, member, type);
+
+	if (UNEXPECTED(member == &tmp)) {
+		zval_dtor(&tmp);
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Internal implementation of @c __isset() method
+ * @see pmtapool_object
+ * @see pmtapool_has_property
+ * @param obj @c pmtapool_object
+ * @param member Property to read
+ * @param has_set_exists Additional checks
+ * @return Whether property @a member exists and satisfies @a has_set_exists criterion
+ * @retval 1 Yes
+ * @retval 0 No
+ * @pre <tt>Z_TYPE_P(member) == IS_STRING</tt>
+ */
+static int pmtapool_has_property_internal(pmtapool_object* obj, zval* member, int has_set_exists)
+{
+	int retval = 1;
+
+	if (ISSTR(member, "servers")) {
+		if (1 == has_set_exists) {
+			retval = (obj->num_nodes > 0);
+		}
+	}
+	else if (ISSTR(member, "route")) {
+		if (1 == has_set_exists) {
+			retval = (obj->route != 0);
+		}
+	}
+	else if (ISSTR(member, "username")) {
+		if (0 == has_set_exists) {
+			retval = (obj->username != NULL);
+		}
+		else if (1 == has_set_exists) {
+			retval = (obj->username && obj->username[0]);
+		}
+	}
+	else {
+		retval = 0;
+	}
+
+	return retval;
+}
+
+/**
+ * @param object @c PmtaConnectionPool instance
+ * @param member Property
+ * @param has_set_exists Existence criterion
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether property @a member exists and satisfies @a has_set_exists criterion
+ * @retval 1 Yes
+ * @retval 0 No
+ * @pre <tt>Z_TYPE_P(object) == IS_OBJECT && instanceof_function(Z_OBJCE_P(object), pmta_pool_class TSRMLS_CC)</tt>
+ */
+static int pmtapool_has_property(zval* object, zval* member, int has_set_exists ZLK_DC TSRMLS_DC)
+{
+	zval tmp;
+	int retval = 1;
+	pmtapool_object* obj = fetchPmtaPoolObject(object TSRMLS_CC);
+
+	if (obj->obj.ce->type != ZEND_INTERNAL_CLASS) {
+		return zend_get_std_object_handlers()->has_property(object, member, has_set_exists ZLK_CC TSRMLS_CC);
+	}
+
+	if (UNEXPECTED(Z_TYPE_P(member) != IS_STRING)) {
+		ZVAL_ZVAL(&tmp, member, 1, 0);
+		convert_to_string(&tmp);
+		member = &tmp;
+	}
+
+	retval = pmtapool_has_property_internal(obj, member, has_set_exists);
+
+	if (UNEXPECTED(member == &tmp)) {
+		zval_dtor(&tmp);
+	}
+
+	return retval;
+}
+
+/**
+ * @brief @c get_properties handler
+ * @param object @c PmtaConnectionPool instance
+ * @param tsrm_ls Internally used by Zend
+ * @return Hash table with properties of @a object
+ * @pre <tt>Z_TYPE_P(object) == IS_OBJECT && instanceof_function(Z_OBJCE_P(object), pmta_pool_class TSRMLS_CC)</tt>
+ */
+static HashTable* pmtapool_get_properties(zval* object TSRMLS_DC)
+{
+	pmtapool_object* obj = fetchPmtaPoolObject(object TSRMLS_CC);
+	HashTable* props     = zend_std_get_properties(object TSRMLS_CC);
+	zval* zv;
+
+	MAKE_STD_ZVAL(zv);
+	pmtapool_get_servers(obj, zv);
+	zend_hash_update(props, "servers", sizeof("servers"), &zv, sizeof(zval*), NULL);
+
+	MAKE_STD_ZVAL(zv);
+	ZVAL_LONG(zv, obj->route);
+	zend_hash_update(props, "route", sizeof("route"), &zv, sizeof(zval*), NULL);
+
+	if (obj->username) {
+		MAKE_STD_ZVAL(zv);
+		ZVAL_STRING(zv, obj->username, 1);
+		zend_hash_update(props, "username", sizeof("username"), &zv, sizeof(zval*), NULL);
+	}
+
+	return props;
+}
+
+/**
+ * @brief @c PmtaConnectionPool destructor
+ * @param v @c pmtapool_object
+ * @param tsrm_ls Internally used by Zend
+ * @details Closes all connections and frees all memory allocated for @c pmtapool_object and its members
+ */
+static void pmtapool_dtor(void* v TSRMLS_DC)
+{
+	pmtapool_object* obj = v;
+	int i;
+
+	for (i=0; i<obj->num_nodes; ++i) {
+		if (obj->nodes[i].conn) {
+			pmtaconn_close(obj->nodes[i].conn, obj->nodes[i].pconn, 0 TSRMLS_CC);
+		}
+
+		efree(obj->nodes[i].server);
+	}
+
+	if (obj->nodes)    { efree(obj->nodes);    }
+	if (obj->ring)     { efree(obj->ring);     }
+	if (obj->username) { efree(obj->username); }
+	if (obj->password) { efree(obj->password); }
+	if (obj->error)    { efree(obj->error);    }
+
+	zend_object_std_dtor(&(obj->obj) TSRMLS_CC);
+	efree(obj);
+}
+
+/**
+ * @brief @c PmtaConnectionPool constructor
+ * @param ce Class Entry for @c PmtaConnectionPool
+ * @param tsrm_ls Internally used by Zend
+ * @return Zend Object Value
+ * @details Allocates memory for @c pmtapool_object and registers the destructor
+ */
+static zend_object_value pmtapool_ctor(zend_class_entry* ce TSRMLS_DC)
+{
+	pmtapool_object* obj = ecalloc(1, sizeof(pmtapool_object));
+	zend_object_value retval;
+
+	zend_object_std_init(&obj->obj, ce TSRMLS_CC);
+#if PHP_VERSION_ID >= 50400
+	object_properties_init(&obj->obj, ce);
+#endif
+
+	retval.handle = zend_objects_store_put(
+		obj,
+		(zend_objects_store_dtor_t)zend_objects_destroy_object,
+		pmtapool_dtor,
+		NULL TSRMLS_CC
+	);
+
+	retval.handlers = &pmtapool_object_handlers;
+
+	return retval;
+}
+
+/**
+ * @brief public function __construct($servers = null, $route = self::ROUTE_DOMAIN, $username = null, $password = null, $flags = null);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_connection_class
+ *
+ * @c $servers is an array of <tt>host[:port]</tt> strings or a string with comma separated servers;
+ * if it is @c null, @c pmta.servers is used. Connections are established on first use.
+ * @c $flags accepts @c PmtaConnection::PERSISTENT; if it is @c null, @c pmta.persistent is used.
+ * @c $route must be one of the @c ROUTE_XXX constants. The constructor cannot be called again on an initialized pool.
+ */
+static PHP_METHOD(PmtaConnectionPool, __construct)
+{
+	zval* servers    = NULL;
+	long int route   = PMTAPOOL_ROUTE_DOMAIN;
+	char* username   = NULL;
+	int username_len;
+	char* password   = NULL;
+	int password_len;
+	zval* zflags     = NULL;
+	long int port;
+	pmtapool_object* obj;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|zlssz", &servers, &route, &username, &username_len, &password, &password_len, &zflags)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaPoolObject(getThis() TSRMLS_CC);
+
+	if (obj->num_nodes || obj->ring) {
+		throw_pmta_error(pmta_error_connection_class, PmtaApiERROR_IllegalState, "The pool has already been initialized", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	if (route < PMTAPOOL_ROUTE_JOBID || route > PMTAPOOL_ROUTE_ADAPTIVE) {
+		throw_pmta_error(pmta_error_connection_class, PmtaApiERROR_IllegalArgument, "Unknown route", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	port = PMTA_G(port);
+	if (!port) {
+		port = 25;
+	}
+
+	if (servers && Z_TYPE_P(servers) == IS_ARRAY) {
+		HashPosition pos;
+		zval** entry;
+
+		for (
+			zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(servers), &pos);
+			zend_hash_get_current_data_ex(Z_ARRVAL_P(servers), (void**)&entry, &pos) == SUCCESS;
+			zend_hash_move_forward_ex(Z_ARRVAL_P(servers), &pos)
+		) {
+			if (Z_TYPE_PP(entry) == IS_STRING) {
+				pmtapool_add_node(obj, Z_STRVAL_PP(entry), Z_STRLEN_PP(entry), port TSRMLS_CC);
+			}
+			else {
+				zval str;
+				ZVAL_ZVAL(&str, *entry, 1, 0);
+				convert_to_string(&str);
+				pmtapool_add_node(obj, Z_STRVAL(str), Z_STRLEN(str), port TSRMLS_CC);
+				zval_dtor(&str);
+			}
+		}
+	}
+	else {
+		const char* list;
+		const char* p;
+		zval str;
+
+		if (servers && Z_TYPE_P(servers) != IS_NULL) {
+			ZVAL_ZVAL(&str, servers, 1, 0);
+			convert_to_string(&str);
+			list = Z_STRVAL(str);
+		}
+		else {
+			INIT_ZVAL(str);
+			list = PMTA_G(servers) ? PMTA_G(servers) : "";
+		}
+
+		p = list;
+		while (*p) {
+			size_t len = strcspn(p, ", \t\r\n");
+			pmtapool_add_node(obj, p, len, port TSRMLS_CC);
+			p += len;
+			p += strspn(p, ", \t\r\n");
+		}
+
+		zval_dtor(&str);
+	}
+
+	if (!obj->num_nodes) {
+		throw_pmta_error(pmta_error_connection_class, PmtaApiERROR_PHP_API, "No PowerMTA servers configured", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	if (!zflags || Z_TYPE_P(zflags) == IS_NULL) {
+		obj->flags = PMTA_G(persistent) ? PMTACONN_PERSISTENT : 0;
+	}
+	else {
+		zval lval;
+		ZVAL_ZVAL(&lval, zflags, 1, 0);
+		convert_to_long(&lval);
+		obj->flags = Z_LVAL(lval);
+		zval_dtor(&lval);
+	}
+
+	if (!username) {
+		username = PMTA_G(username);
+	}
+
+	if (!password) {
+		password = PMTA_G(password);
+	}
+
+	if (username && *username && password && *password) {
+		obj->username = estrdup(username);
+		obj->password = estrdup(password);
+	}
+
+	obj->route = route;
+	pmtapool_build_ring(obj);
+}
+
+/**
+ * @brief public function __get($property);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaConnectionPool, __get)
+{
+	zval* property;
+	zval* retval;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &property)) {
+		RETURN_NULL();
+	}
+
+	if (Z_TYPE_P(property) != IS_STRING) {
+		zend_error(E_WARNING, "Property name must be a string");
+		RETURN_NULL();
+	}
+
+	retval = pmtapool_read_property_internal(fetchPmtaPoolObject(getThis() TSRMLS_CC), property, BP_VAR_R);
+	RETURN_ZVAL(retval, 1, 0);
+}
+
+/**
+ * @brief public function __isset($property);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaConnectionPool, __isset)
+{
+	zval* property;
+	int retval;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &property)) {
+		RETURN_NULL();
+	}
+
+	if (Z_TYPE_P(property) != IS_STRING) {
+		zend_error(E_WARNING, "Property name must be a string");
+		RETURN_NULL();
+	}
+
+	retval = pmtapool_has_property_internal(fetchPmtaPoolObject(getThis() TSRMLS_CC), property, 1);
+	RETURN_BOOL(retval);
+}
+
+/**
+ * @brief public function getServer(PmtaMessage $message);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns <tt>host:port</tt> of the node which owns the message's routing key (regardless of the node's health)
+ */
+static PHP_METHOD(PmtaConnectionPool, getServer)
+{
+	pmtapool_object* obj;
+	pmtapool_node* node;
+	zval* message;
+	char* s;
+	int len;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &message, pmta_msg_class)) {
+		RETURN_NULL();
+	}
+
+	obj  = fetchPmtaPoolObject(getThis() TSRMLS_CC);
+	node = &obj->nodes[obj->ring[pmtapool_locate(obj, message TSRMLS_CC)].node];
+	len  = spprintf(&s, 0, "%s:%ld", node->server, node->port);
+	RETURN_STRINGL(s, len, 0);
+}
+
+/**
+ * @brief public function submitMessage(PmtaMessage $message);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Submits the message to the node chosen by the routing key. If that node refuses the connection,
+ * the next node on the ring is used. With @c ROUTE_ADAPTIVE the node is picked at random, weighted by
+ * its submission latency and error rate. Connection failures are always reported with @c PmtaErrorConnection
+ */
+static PHP_METHOD(PmtaConnectionPool, submitMessage)
+{
+	pmtapool_object* obj;
+	pmtapool_node* node;
+	zval* message;
+	BOOL res;
+	double started;
+	int code;
+	const char* error;
+	char* conn_error;
+	zend_bool exceptions = PMTA_G(use_exceptions);
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &message, pmta_msg_class)) {
+		RETURN_NULL();
+	}
+
+	if (is_message_locked(message TSRMLS_CC)) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_PHP_API, "The message is being submitted in the background", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	if (FAILURE == flush_message(message, &code, &error TSRMLS_CC)) {
+		throw_pmta_error(pmta_error_message_class, code, error, NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	obj  = fetchPmtaPoolObject(getThis() TSRMLS_CC);
+	node = (PMTAPOOL_ROUTE_ADAPTIVE == obj->route) ? pmtapool_pick_adaptive(obj, message TSRMLS_CC) : pmtapool_pick_node(obj, message TSRMLS_CC);
+	if (!node) {
+		throw_pmta_error(pmta_error_connection_class, obj->error_code, obj->error, NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	started = pmta_time_ms();
+	res     = pmtaconn_submit(&node->conn, &node->pconn, &node->reused, node->server, node->port, obj->username, obj->password, getMessage(message TSRMLS_CC), &code, &conn_error TSRMLS_CC);
+	pmtapool_update_stats(node, TRUE == res, pmta_time_ms() - started);
+	if (TRUE == res) {
+		RETURN_TRUE;
+	}
+
+	pmtapool_set_error(obj, code, conn_error);
+	efree(conn_error);
+	if (PmtaApiERROR_IO == obj->error_code && node->conn) {
+		pmtaconn_close(node->conn, node->pconn, 1 TSRMLS_CC);
+		node->conn  = NULL;
+		node->pconn = NULL;
+	}
+
+	if (exceptions) {
+		throw_pmta_error(pmta_error_connection_class, obj->error_code, obj->error, NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	RETURN_FALSE;
+}
+
+/**
+ * @brief public function getNodeStats();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns a list of arrays with @c server, @c latency (EWMA, ms), @c error_rate (EWMA, 0..1),
+ * @c weight (share of traffic under @c ROUTE_ADAPTIVE, 0..1), @c submitted, @c failed and @c connected keys.
+ * Statistics are kept per process and survive requests
+ */
+static PHP_METHOD(PmtaConnectionPool, getNodeStats)
+{
+	pmtapool_object* obj;
+	double* weights;
+	double total;
+	int i;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	obj     = fetchPmtaPoolObject(getThis() TSRMLS_CC);
+	weights = safe_emalloc(obj->num_nodes, sizeof(double), 0);
+	total   = pmtapool_weights(obj, weights, time(NULL));
+
+	array_init_size(return_value, obj->num_nodes);
+	for (i=0; i<obj->num_nodes; ++i) {
+		pmtapool_node* node = &obj->nodes[i];
+		zval* entry;
+		char* s;
+		int len;
+
+		MAKE_STD_ZVAL(entry);
+		array_init_size(entry, 7);
+
+		len = spprintf(&s, 0, "%s:%ld", node->server, node->port);
+		add_assoc_stringl_ex(entry, ZEND_STRS("server"), s, len, 0);
+		add_assoc_double_ex(entry, ZEND_STRS("latency"),    node->stats->latency);
+		add_assoc_double_ex(entry, ZEND_STRS("error_rate"), node->stats->error_rate);
+		add_assoc_double_ex(entry, ZEND_STRS("weight"),     (total > 0) ? weights[i] / total : 0.0);
+		add_assoc_long_ex(entry,   ZEND_STRS("submitted"),  node->stats->submitted);
+		add_assoc_long_ex(entry,   ZEND_STRS("failed"),     node->stats->failed);
+		add_assoc_bool_ex(entry,   ZEND_STRS("connected"),  node->conn ? 1 : 0);
+
+		add_next_index_zval(return_value, entry);
+	}
+
+	efree(weights);
+}
+
+/**
+ * @brief public function getLastError();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns the last error seen on any of the nodes
+ */
+static PHP_METHOD(PmtaConnectionPool, getLastError)
+{
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	if (return_value_used) {
+		pmtapool_object* obj = fetchPmtaPoolObject(getThis() TSRMLS_CC);
+		throw_pmta_error(pmta_error_connection_class, obj->error_code, obj->error ? obj->error : "", &return_value TSRMLS_CC);
+	}
+}
+
+/**
+ * @brief arginfo for @c __construct()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_construct, 0, 0, 0)
+	ZEND_ARG_INFO(0, servers)
+	ZEND_ARG_INFO(0, route)
+	ZEND_ARG_INFO(0, username)
+	ZEND_ARG_INFO(0, password)
+	ZEND_ARG_INFO(0, flags)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c getServer() and @c submitMessage()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_message, 0, 0, 1)
+	ZEND_ARG_OBJ_INFO(0, message, PmtaMessage, 0)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief @c PmtaConnectionPool class methods
+ */
+static
+#if ZEND_MODULE_API_NO > 20060613
+const
+#endif
+zend_function_entry pmta_pool_class_methods[] = {
+	PHP_ME(PmtaConnectionPool, __construct,   arginfo_construct, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+	PHP_ME(PmtaConnectionPool, __get,         arginfo_get,       ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaConnectionPool, __isset,       arginfo_get,       ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaConnectionPool, getServer,     arginfo_message,   ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaConnectionPool, submitMessage, arginfo_message,   ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaConnectionPool, getNodeStats,  arginfo_empty,     ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaConnectionPool, getLastError,  arginfo_empty,     ZEND_ACC_PUBLIC)
+	PHP_ME_MAPPING(__destruct, empty_destructor, arginfo_empty, ZEND_ACC_PUBLIC | ZEND_ACC_DTOR)
+	PHP_FE_END
+};
+
+/**
+ * Registers @c PmtaConnectionPool class with Zend
+ */
+void pmtapool_register_class(TSRMLS_D)
+{
+	zend_class_entry e;
+
+	INIT_CLASS_ENTRY(e, "PmtaConnectionPool", pmta_pool_class_methods);
+
+	pmta_pool_class = zend_register_internal_class(&e TSRMLS_CC);
+
+	pmta_pool_class->create_object = pmtapool_ctor;
+	pmta_pool_class->serialize     = zend_class_serialize_deny;
+	pmta_pool_class->unserialize   = zend_class_unserialize_deny;
+
+	pmtapool_object_handlers = *zend_get_std_object_handlers();
+	pmtapool_object_handlers.clone_obj            = NULL;
+	pmtapool_object_handlers.read_property        = pmtapool_read_property;
+	pmtapool_object_handlers.has_property         = pmtapool_has_property;
+	pmtapool_object_handlers.get_property_ptr_ptr = NULL;
+	pmtapool_object_handlers.get_properties       = pmtapool_get_properties;
+
+	zend_declare_class_constant_long(pmta_pool_class, ZEND_STRL("ROUTE_JOBID"),    PMTAPOOL_ROUTE_JOBID    TSRMLS_CC);
+	zend_declare_class_constant_long(pmta_pool_class, ZEND_STRL("ROUTE_VMTA"),     PMTAPOOL_ROUTE_VMTA     TSRMLS_CC);
+	zend_declare_class_constant_long(pmta_pool_class, ZEND_STRL("ROUTE_DOMAIN"),   PMTAPOOL_ROUTE_DOMAIN   TSRMLS_CC);
+	zend_declare_class_constant_long(pmta_pool_class, ZEND_STRL("ROUTE_ADAPTIVE"), PMTAPOOL_ROUTE_ADAPTIVE TSRMLS_CC);
+}
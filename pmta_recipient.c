@@ -83,6 +83,21 @@ class PmtaRecipient
 		return PmtaRcptDefineVariable($this->recipient, $name, $value);
 	}
 
+	public function defineVariables(array $vars, $mirror = true)
+	{
+		foreach ($vars as $name => $value) {
+			if (!PmtaRcptDefineVariable($this->recipient, $name, (string)$value)) {
+				throw new PmtaErrorRecipient(PmtaRcptGetLastError($this->recipient), PmtaRcptGetLastErrorType($this->recipient));
+			}
+
+			if ($mirror) {
+				$this->vars[$name] = (string)$value;
+			}
+		}
+
+		return true;
+	}
+
 	public function getLastError()
 	{
 		return new PmtaErrorRecipient(PmtaRcptGetLastError($this->recipient), PmtaRcptGetLastErrorType($this->recipient));
@@ -136,6 +151,11 @@ PmtaRcpt getRecipient(zval* object TSRMLS_DC)
 	return fetchPmtaRcptObject(object TSRMLS_CC)->rcpt;
 }
 
+const char* getRecipientAddress(zval* object TSRMLS_DC)
+{
+	return fetchPmtaRcptObject(object TSRMLS_CC)->address;
+}
+
 /**
  * @brief Locks @c PmtaRecipient class instance by setting its @c $locked property ro 1
  * @param object @c PmtaRecipient object
@@ -149,6 +169,183 @@ void lock_recipient(zval* object TSRMLS_DC)
 	}
 }
 
+PmtaRcpt pmtarcpt_create(const char* address TSRMLS_DC)
+{
+	PmtaRcpt rcpt = PmtaRcptAlloc();
+
+	if (!rcpt) {
+		throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_PHP_API, "PmtaRcptAlloc() failed", NULL TSRMLS_CC);
+		return NULL;
+	}
+
+	if (FALSE == PmtaRcptInit(rcpt, (char*)address)) {
+		throw_pmta_error(pmta_error_recipient_class, PmtaRcptGetLastErrorType(rcpt), PmtaRcptGetLastError(rcpt), NULL TSRMLS_CC);
+		PmtaRcptFree(rcpt);
+		return NULL;
+	}
+
+	return rcpt;
+}
+
+int pmtarcpt_define_variable(PmtaRcpt rcpt, const char* name, const char* value TSRMLS_DC)
+{
+	if (FALSE == PmtaRcptDefineVariable(rcpt, (char*)name, (char*)value)) {
+		throw_pmta_error(pmta_error_recipient_class, PmtaRcptGetLastErrorType(rcpt), PmtaRcptGetLastError(rcpt), NULL TSRMLS_CC);
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * @brief Defines mail merge variables
+ * @param rcpt Recipient
+ * @param vars Variables (<tt>name => value</tt>); values are converted to strings
+ * @param mirror If not @c NULL, the variables are also stored in this table (as @c PmtaRecipient::$vars)
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether all variables have been defined
+ * @retval SUCCESS Yes
+ * @retval FAILURE No, @c PmtaErrorRecipient has been thrown; the variables before the failed one stay defined
+ */
+static int pmtarcpt_define_variables(PmtaRcpt rcpt, HashTable* vars, HashTable* mirror TSRMLS_DC)
+{
+	HashPosition pos;
+	zval** entry;
+
+	for (
+		zend_hash_internal_pointer_reset_ex(vars, &pos);
+		zend_hash_get_current_data_ex(vars, (void**)&entry, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(vars, &pos)
+	) {
+		char buf[MAX_LENGTH_OF_LONG + 1];
+		char* name;
+		uint name_len;
+		ulong idx;
+		int key_type;
+		zval* value = NULL;
+
+		key_type = zend_hash_get_current_key_ex(vars, &name, &name_len, &idx, 0, &pos);
+		if (HASH_KEY_IS_STRING != key_type) {
+			snprintf(buf, sizeof(buf), "%lu", idx);
+			name = buf;
+		}
+
+		if (Z_TYPE_PP(entry) == IS_STRING) {
+			if (FAILURE == pmtarcpt_define_variable(rcpt, name, Z_STRVAL_PP(entry) TSRMLS_CC)) {
+				return FAILURE;
+			}
+
+			if (mirror) {
+				/* Share the value with the caller's array unless it is a reference */
+				if (!PZVAL_IS_REF(*entry)) {
+					value = *entry;
+					Z_ADDREF_P(value);
+				}
+				else {
+					MAKE_STD_ZVAL(value);
+					ZVAL_STRINGL(value, Z_STRVAL_PP(entry), Z_STRLEN_PP(entry), 1);
+				}
+			}
+		}
+		else {
+			zval str;
+			ZVAL_ZVAL(&str, *entry, 1, 0);
+			convert_to_string(&str);
+
+			if (FAILURE == pmtarcpt_define_variable(rcpt, name, Z_STRVAL(str) TSRMLS_CC)) {
+				zval_dtor(&str);
+				return FAILURE;
+			}
+
+			if (mirror) {
+				MAKE_STD_ZVAL(value);
+				ZVAL_STRINGL(value, Z_STRVAL(str), Z_STRLEN(str), 0);
+				/* Skipping zval_dtor because we stole the underlying pointer */
+			}
+			else {
+				zval_dtor(&str);
+			}
+		}
+
+		if (!value) {
+			continue;
+		}
+
+		if (HASH_KEY_IS_STRING == key_type) {
+			zend_hash_update(mirror, name, name_len, (void*)&value, sizeof(zval*), NULL);
+		}
+		else {
+			zend_hash_index_update(mirror, idx, (void*)&value, sizeof(zval*), NULL);
+		}
+	}
+
+	return SUCCESS;
+}
+
+PmtaRcpt pmtarcpt_from_zval(zval* row, const char** address TSRMLS_DC)
+{
+	PmtaRcpt rcpt;
+	zval** zaddr;
+	zval** znotify;
+	zval** zvars;
+
+	if (Z_TYPE_P(row) == IS_STRING) {
+		*address = Z_STRVAL_P(row);
+		return pmtarcpt_create(*address TSRMLS_CC);
+	}
+
+	if (
+		   Z_TYPE_P(row) != IS_ARRAY
+		|| FAILURE == zend_hash_find(Z_ARRVAL_P(row), "address", sizeof("address"), (void**)&zaddr)
+		|| Z_TYPE_PP(zaddr) != IS_STRING
+	) {
+		throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_IllegalArgument, "Recipient must be an address or an array with the 'address' key", NULL TSRMLS_CC);
+		return NULL;
+	}
+
+	rcpt = pmtarcpt_create(Z_STRVAL_PP(zaddr) TSRMLS_CC);
+	if (!rcpt) {
+		return NULL;
+	}
+
+	if (SUCCESS == zend_hash_find(Z_ARRVAL_P(row), "notify", sizeof("notify"), (void**)&znotify) && Z_TYPE_PP(znotify) != IS_NULL) {
+		long int v;
+
+		if (Z_TYPE_PP(znotify) == IS_LONG) {
+			v = Z_LVAL_PP(znotify);
+		}
+		else {
+			zval lval;
+			ZVAL_ZVAL(&lval, *znotify, 1, 0);
+			convert_to_long(&lval);
+			v = Z_LVAL(lval);
+			zval_dtor(&lval);
+		}
+
+		if (FALSE == PmtaRcptSetNotify(rcpt, v)) {
+			throw_pmta_error(pmta_error_recipient_class, PmtaRcptGetLastErrorType(rcpt), PmtaRcptGetLastError(rcpt), NULL TSRMLS_CC);
+			PmtaRcptFree(rcpt);
+			return NULL;
+		}
+	}
+
+	if (SUCCESS == zend_hash_find(Z_ARRVAL_P(row), "vars", sizeof("vars"), (void**)&zvars) && Z_TYPE_PP(zvars) != IS_NULL) {
+		if (Z_TYPE_PP(zvars) != IS_ARRAY) {
+			throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_IllegalArgument, "Recipient variables must be an array", NULL TSRMLS_CC);
+			PmtaRcptFree(rcpt);
+			return NULL;
+		}
+
+		if (FAILURE == pmtarcpt_define_variables(rcpt, Z_ARRVAL_PP(zvars), NULL TSRMLS_CC)) {
+			PmtaRcptFree(rcpt);
+			return NULL;
+		}
+	}
+
+	*address = Z_STRVAL_PP(zaddr);
+	return rcpt;
+}
+
 /**
  * @brief Internal implementation of @c __get() method
  * @see pmtarcpt_object
@@ -629,6 +826,44 @@ static PHP_METHOD(PmtaRecipient, defineVariable)
 	RETURN_FALSE;
 }
 
+/**
+ * @brief public function defineVariables(array $vars, $mirror = true);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_recipient_class
+ *
+ * Defines all variables from @c $vars (<tt>name => value</tt>). If @c $mirror is @c false, the values are passed
+ * to PMTA only and are not visible through @c $vars. If a variable cannot be defined, the exception is thrown
+ * and the variables before it stay defined.
+ */
+static PHP_METHOD(PmtaRecipient, defineVariables)
+{
+	pmtarcpt_object* obj;
+	zval* vars;
+	zend_bool mirror = 1;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|b", &vars, &mirror)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaRcptObject(getThis() TSRMLS_CC);
+
+	if (!obj->rcpt) {
+		throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_PHP_API, "Cannot modify locked object", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	if (FAILURE == pmtarcpt_define_variables(obj->rcpt, Z_ARRVAL_P(vars), mirror ? obj->vars : NULL TSRMLS_CC)) {
+		RETURN_NULL();
+	}
+
+	RETURN_TRUE;
+}
+
 /**
  * @brief public function getLastError();
  * @param ht Internally used by Zend (number of arguments)
@@ -665,6 +900,14 @@ PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_defvar, 0, 0, 2)
 	ZEND_ARG_INFO(0, value)
 ZEND_END_ARG_INFO()
 
+/**
+ * @brief arginfo for @c defineVariables()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_defvars, 0, 0, 1)
+	ZEND_ARG_ARRAY_INFO(0, vars, 0)
+	ZEND_ARG_INFO(0, mirror)
+ZEND_END_ARG_INFO()
+
 /**
  * @brief @c PmtaRecipient class methods
  */
@@ -678,6 +921,7 @@ zend_function_entry pmta_rcpt_class_methods[] = {
 	PHP_ME(PmtaRecipient, __set,            arginfo_set,       ZEND_ACC_PUBLIC)
 	PHP_ME(PmtaRecipient, __isset,          arginfo_get,       ZEND_ACC_PUBLIC)
 	PHP_ME(PmtaRecipient, defineVariable,   arginfo_defvar,    ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaRecipient, defineVariables,  arginfo_defvars,   ZEND_ACC_PUBLIC)
 	PHP_ME(PmtaRecipient, getLastError,     arginfo_empty,     ZEND_ACC_PUBLIC)
 	PHP_ME_MAPPING(__destruct, empty_destructor, arginfo_empty, ZEND_ACC_PUBLIC | ZEND_ACC_DTOR)
 	PHP_FE_END
@@ -28,6 +28,7 @@ class PmtaRecipient
 	public function __isset($property);
 	public function __set($name, $value);
 	public function defineVariable($name, $value);
+	public function defineVariables(array $vars, $mirror = true);
 	public function getLastError();
 	private function __clone();
 }
@@ -52,6 +53,14 @@ class PmtaRecipient
  */
 PHPPMTA_VISIBILITY_HIDDEN extern PmtaRcpt getRecipient(zval* object TSRMLS_DC);
 
+/**
+ * @brief Returns the address of @c PmtaRecipient object
+ * @param object @c PmtaRecipient object
+ * @param tsrm_ls Internally used by Zend
+ * @return Recipient's address
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern const char* getRecipientAddress(zval* object TSRMLS_DC);
+
 /**
  * @brief Locks @c PmtaRecipient object (when Recipient is added to the Message, Recipient must not be modified)
  * @param object @c PmtaRecipient object
@@ -59,6 +68,37 @@ PHPPMTA_VISIBILITY_HIDDEN extern PmtaRcpt getRecipient(zval* object TSRMLS_DC);
  */
 PHPPMTA_VISIBILITY_HIDDEN extern void lock_recipient(zval* object TSRMLS_DC);
 
+/**
+ * @brief Allocates and initializes @c PmtaRcpt
+ * @param address Recipient's address
+ * @param tsrm_ls Internally used by Zend
+ * @return @c PmtaRcpt or @c NULL if @c PmtaErrorRecipient has been thrown
+ * @note The caller is responsible for freeing the result with @c PmtaRcptFree()
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern PmtaRcpt pmtarcpt_create(const char* address TSRMLS_DC);
+
+/**
+ * @brief Defines a mail merge variable for @c PmtaRcpt
+ * @param rcpt Recipient
+ * @param name Variable name
+ * @param value Variable value
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the variable has been defined
+ * @retval SUCCESS Yes
+ * @retval FAILURE No, @c PmtaErrorRecipient has been thrown
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern int pmtarcpt_define_variable(PmtaRcpt rcpt, const char* name, const char* value TSRMLS_DC);
+
+/**
+ * @brief Builds @c PmtaRcpt from an address or an <tt>array('address' => ..., 'notify' => ..., 'vars' => array(...))</tt> row
+ * @param row Address or row
+ * @param address Recipient's address (output; points into @a row)
+ * @param tsrm_ls Internally used by Zend
+ * @return @c PmtaRcpt or @c NULL if @c PmtaErrorRecipient has been thrown
+ * @note The caller is responsible for freeing the result with @c PmtaRcptFree()
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern PmtaRcpt pmtarcpt_from_zval(zval* row, const char** address TSRMLS_DC);
+
 /**
  * @brief Registers @c PmtaRecipient class
  * @param tsrm_ls Internally used by Zend
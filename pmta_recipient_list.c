@@ -0,0 +1,619 @@
+/**
+ * @file pmta_recipient_list.c
+ * @brief @c PmtaRecipientList class implementation
+ * @details Recipients are stored column-wise: all strings live in one arena, addresses, notification flags and
+ * the ranges of merge variables are kept in plain arrays, and variable names are interned in a dictionary.
+ * @c PmtaRcpt handles are only created when the list is attached to a message.
+@code{.php}
+class PmtaRecipientList implements Countable
+{
+	private $arena     = '';      // NUL-terminated strings
+	private $addresses = array(); // offsets in $arena
+	private $notify    = array(); // -1 if not set
+	private $var_start = array(0);
+	private $var_names = array(); // name => index
+	private $vars      = array(); // array(name index, value offset)
+
+	public function add($address, array $vars = null, $notify = null)
+	{
+		$this->addresses[] = $this->store($address);
+		$this->notify[]    = (null === $notify) ? -1 : (int)$notify;
+		foreach ((array)$vars as $name => $value) {
+			$this->vars[] = array($this->name($name), $this->store((string)$value));
+		}
+
+		$this->var_start[] = count($this->vars);
+		return count($this->addresses) - 1;
+	}
+
+	public function addMany(array $recipients)
+	{
+		foreach ($recipients as $row) {
+			is_array($row) ? $this->add($row['address'], $row['vars'], $row['notify']) : $this->add($row);
+		}
+
+		return count($recipients);
+	}
+
+	public function get($index)
+	{
+		// array('address' => ..., 'notify' => ..., 'vars' => array(...))
+	}
+
+	public function count()
+	{
+		return count($this->addresses);
+	}
+
+	private function __clone() {}
+}
+@endcode
+ */
+
+#include "pmta_recipient_list.h"
+#include "pmta_recipient.h"
+#include "pmta_error.h"
+#include "pmta_common.h"
+
+#ifdef HAVE_SPL
+#	include <ext/spl/spl_iterators.h>
+#endif
+
+/**
+ * @brief Merge variable of a recipient
+ */
+typedef struct _pmtalist_var {
+	zend_uint name; /**< Index in @c var_names */
+	size_t value;   /**< Offset of the value in the arena */
+} pmtalist_var;
+
+/**
+ * @brief @c PmtaRecipientList object handlers
+ */
+static zend_object_handlers pmtalist_object_handlers;
+
+/**
+ * @brief Internal properties of @c PmtaRecipientList
+ */
+typedef struct _pmtalist_object {
+	zend_object obj;      /**< Zend object data */
+	char* arena;          /**< String arena; every string is @c NUL-terminated */
+	size_t arena_len;     /**< Number of bytes used in @c arena */
+	size_t arena_size;    /**< Size of @c arena */
+	size_t* addresses;    /**< Offsets of the addresses in @c arena */
+	int* notify;          /**< Notification flags, -1 if not set */
+	size_t* var_start;    /**< Index of the first variable of every recipient in @c vars (@c count + 1 elements) */
+	long int count;       /**< Number of recipients */
+	long int capacity;    /**< Number of recipients the arrays have room for */
+	pmtalist_var* vars;   /**< Merge variables */
+	size_t num_vars;      /**< Number of elements in @c vars */
+	size_t vars_size;     /**< Size of @c vars */
+	HashTable names;      /**< Variable name => index in @c var_names */
+	char** var_names;     /**< Variable names */
+	zend_uint num_names;  /**< Number of variable names */
+} pmtalist_object;
+
+/**
+ * @brief Fetches @c pmtalist_object
+ * @see pmtalist_object
+ * @param zobj @c PmtaRecipientList instance
+ * @return pmtalist_object associated with @a zobj
+ * @pre <tt>Z_TYPE_P(zobj) == IS_OBJECT && instanceof_function(Z_OBJCE_P(zobj), pmta_rcptlist_class TSRMLS_CC)</tt>
+ */
+static inline pmtalist_object* fetchPmtaListObject(zval* zobj TSRMLS_DC)
+{
+	return (pmtalist_object*)zend_objects_get_address(zobj TSRMLS_CC);
+}
+
+/**
+ * @brief Copies the string into the arena
+ * @param obj @c pmtalist_object
+ * @param s String
+ * @param len Length of @a s
+ * @return Offset of the copy
+ */
+static size_t pmtalist_store(pmtalist_object* obj, const char* s, size_t len)
+{
+	size_t offset = obj->arena_len;
+
+	if (obj->arena_len + len + 1 > obj->arena_size) {
+		while (obj->arena_len + len + 1 > obj->arena_size) {
+			obj->arena_size *= 2;
+		}
+
+		obj->arena = erealloc(obj->arena, obj->arena_size);
+	}
+
+	memcpy(obj->arena + offset, s, len);
+	obj->arena[offset + len] = '\0';
+	obj->arena_len += len + 1;
+	return offset;
+}
+
+/**
+ * @brief Interns the variable name
+ * @param obj @c pmtalist_object
+ * @param name Variable name
+ * @param len Length of @a name
+ * @return Index of the name in @c var_names
+ */
+static zend_uint pmtalist_name(pmtalist_object* obj, const char* name, uint len)
+{
+	zend_uint* idx;
+	zend_uint n;
+
+	if (SUCCESS == zend_hash_find(&obj->names, name, len + 1, (void**)&idx)) {
+		return *idx;
+	}
+
+	n                 = obj->num_names++;
+	obj->var_names    = erealloc(obj->var_names, obj->num_names * sizeof(char*));
+	obj->var_names[n] = estrndup(name, len);
+	zend_hash_add(&obj->names, name, len + 1, (void*)&n, sizeof(zend_uint), NULL);
+	return n;
+}
+
+/**
+ * @brief Appends a recipient
+ * @param obj @c pmtalist_object
+ * @param address Address
+ * @param address_len Length of @a address
+ * @param vars Merge variables (name => value) or @c NULL
+ * @param notify Notification flags, -1 if not set
+ * @param tsrm_ls Internally used by Zend
+ * @return Index of the recipient
+ */
+static long int pmtalist_append(pmtalist_object* obj, const char* address, int address_len, HashTable* vars, int notify TSRMLS_DC)
+{
+	long int idx;
+	zval* values = NULL;
+	uint num     = 0;
+	uint i;
+
+	if (vars && zend_hash_num_elements(vars)) {
+		HashPosition pos;
+		zval** entry;
+
+		/* __toString() may call add() on this list: convert the values before anything is appended */
+		values = safe_emalloc(zend_hash_num_elements(vars), sizeof(zval), 0);
+		for (
+			zend_hash_internal_pointer_reset_ex(vars, &pos);
+			num < zend_hash_num_elements(vars) && zend_hash_get_current_data_ex(vars, (void**)&entry, &pos) == SUCCESS;
+			zend_hash_move_forward_ex(vars, &pos)
+		) {
+			ZVAL_ZVAL(&values[num], *entry, 1, 0);
+			if (Z_TYPE(values[num]) != IS_STRING) {
+				convert_to_string(&values[num]);
+			}
+
+			++num;
+		}
+	}
+
+	idx = obj->count;
+	if (obj->count == obj->capacity) {
+		obj->capacity  *= 2;
+		obj->addresses  = erealloc(obj->addresses, obj->capacity * sizeof(size_t));
+		obj->notify     = erealloc(obj->notify,    obj->capacity * sizeof(int));
+		obj->var_start  = erealloc(obj->var_start, (obj->capacity + 1) * sizeof(size_t));
+	}
+
+	obj->addresses[idx] = pmtalist_store(obj, address, address_len);
+	obj->notify[idx]    = notify;
+
+	if (values) {
+		HashPosition pos;
+
+		for (
+			i = 0, zend_hash_internal_pointer_reset_ex(vars, &pos);
+			i < num && zend_hash_get_current_key_type_ex(vars, &pos) != HASH_KEY_NON_EXISTANT;
+			++i, zend_hash_move_forward_ex(vars, &pos)
+		) {
+			char buf[MAX_LENGTH_OF_LONG + 1];
+			char* name;
+			uint name_len;
+			ulong n;
+			size_t value;
+			pmtalist_var* v;
+
+			if (HASH_KEY_IS_STRING == zend_hash_get_current_key_ex(vars, &name, &name_len, &n, 0, &pos)) {
+				--name_len;
+			}
+			else {
+				name_len = snprintf(buf, sizeof(buf), "%lu", n);
+				name     = buf;
+			}
+
+			value = pmtalist_store(obj, Z_STRVAL(values[i]), Z_STRLEN(values[i]));
+
+			if (obj->num_vars == obj->vars_size) {
+				obj->vars_size *= 2;
+				obj->vars       = erealloc(obj->vars, obj->vars_size * sizeof(pmtalist_var));
+			}
+
+			v        = &obj->vars[obj->num_vars++];
+			v->name  = pmtalist_name(obj, name, name_len);
+			v->value = value;
+		}
+
+		for (i=0; i<num; ++i) {
+			zval_dtor(&values[i]);
+		}
+
+		efree(values);
+	}
+
+	obj->var_start[++obj->count] = obj->num_vars;
+	return idx;
+}
+
+/**
+ * @brief Converts @c $notify argument
+ * @param notify Notification flags or @c NULL
+ * @return Flags, -1 if @a notify is @c NULL
+ */
+static int pmtalist_notify(zval* notify)
+{
+	long int v;
+
+	if (!notify || Z_TYPE_P(notify) == IS_NULL) {
+		return -1;
+	}
+
+	if (Z_TYPE_P(notify) == IS_LONG) {
+		v = Z_LVAL_P(notify);
+	}
+	else {
+		zval lval;
+		ZVAL_ZVAL(&lval, notify, 1, 0);
+		convert_to_long(&lval);
+		v = Z_LVAL(lval);
+		zval_dtor(&lval);
+	}
+
+	return (int)v;
+}
+
+long int pmtalist_count(zval* object TSRMLS_DC)
+{
+	return fetchPmtaListObject(object TSRMLS_CC)->count;
+}
+
+PmtaRcpt pmtalist_materialize(zval* object, long int idx, const char** address TSRMLS_DC)
+{
+	pmtalist_object* obj = fetchPmtaListObject(object TSRMLS_CC);
+	PmtaRcpt rcpt;
+	size_t i;
+
+	*address = obj->arena + obj->addresses[idx];
+	rcpt     = pmtarcpt_create(*address TSRMLS_CC);
+	if (!rcpt) {
+		return NULL;
+	}
+
+	if (obj->notify[idx] >= 0 && FALSE == PmtaRcptSetNotify(rcpt, obj->notify[idx])) {
+		throw_pmta_error(pmta_error_recipient_class, PmtaRcptGetLastErrorType(rcpt), PmtaRcptGetLastError(rcpt), NULL TSRMLS_CC);
+		PmtaRcptFree(rcpt);
+		return NULL;
+	}
+
+	for (i=obj->var_start[idx]; i<obj->var_start[idx+1]; ++i) {
+		pmtalist_var* v = &obj->vars[i];
+
+		if (FAILURE == pmtarcpt_define_variable(rcpt, obj->var_names[v->name], obj->arena + v->value TSRMLS_CC)) {
+			PmtaRcptFree(rcpt);
+			return NULL;
+		}
+	}
+
+	return rcpt;
+}
+
+/**
+ * @brief @c PmtaRecipientList destructor
+ * @param v @c pmtalist_object
+ * @param tsrm_ls Internally used by Zend
+ * @details Frees all memory allocated for @c pmtalist_object and its members
+ */
+static void pmtalist_dtor(void* v TSRMLS_DC)
+{
+	pmtalist_object* obj = v;
+	zend_uint i;
+
+	for (i=0; i<obj->num_names; ++i) {
+		efree(obj->var_names[i]);
+	}
+
+	if (obj->var_names) {
+		efree(obj->var_names);
+	}
+
+	zend_hash_destroy(&obj->names);
+	efree(obj->arena);
+	efree(obj->addresses);
+	efree(obj->notify);
+	efree(obj->var_start);
+	efree(obj->vars);
+
+	zend_object_std_dtor(&(obj->obj) TSRMLS_CC);
+	efree(obj);
+}
+
+/**
+ * @brief @c PmtaRecipientList constructor
+ * @param ce Class Entry for @c PmtaRecipientList
+ * @param tsrm_ls Internally used by Zend
+ * @return Zend Object Value
+ * @details Allocates memory for @c pmtalist_object and registers the destructor
+ */
+static zend_object_value pmtalist_ctor(zend_class_entry* ce TSRMLS_DC)
+{
+	pmtalist_object* obj = ecalloc(1, sizeof(pmtalist_object));
+	zend_object_value retval;
+
+	zend_object_std_init(&obj->obj, ce TSRMLS_CC);
+#if PHP_VERSION_ID >= 50400
+	object_properties_init(&obj->obj, ce);
+#endif
+
+	obj->arena_size   = 4096;
+	obj->arena        = emalloc(obj->arena_size);
+	obj->capacity     = 64;
+	obj->addresses    = safe_emalloc(obj->capacity, sizeof(size_t), 0);
+	obj->notify       = safe_emalloc(obj->capacity, sizeof(int), 0);
+	obj->var_start    = safe_emalloc(obj->capacity + 1, sizeof(size_t), 0);
+	obj->var_start[0] = 0;
+	obj->vars_size    = 64;
+	obj->vars         = safe_emalloc(obj->vars_size, sizeof(pmtalist_var), 0);
+	zend_hash_init(&obj->names, 8, NULL, NULL, 0);
+
+	retval.handle = zend_objects_store_put(
+		obj,
+		(zend_objects_store_dtor_t)zend_objects_destroy_object,
+		pmtalist_dtor,
+		NULL TSRMLS_CC
+	);
+
+	retval.handlers = &pmtalist_object_handlers;
+
+	return retval;
+}
+
+/**
+ * @brief @c count_elements handler
+ * @param object @c PmtaRecipientList instance
+ * @param count Number of recipients (output)
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS
+ */
+static int pmtalist_count_elements(zval* object, long int* count TSRMLS_DC)
+{
+	*count = fetchPmtaListObject(object TSRMLS_CC)->count;
+	return SUCCESS;
+}
+
+/**
+ * @brief public function add($address, array $vars = null, $notify = null);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Appends a recipient and returns its index. The address is validated when the list is attached to a message.
+ */
+static PHP_METHOD(PmtaRecipientList, add)
+{
+	char* address;
+	int address_len;
+	zval* vars   = NULL;
+	zval* notify = NULL;
+	long int idx;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s|a!z", &address, &address_len, &vars, &notify)) {
+		RETURN_NULL();
+	}
+
+	idx = pmtalist_append(fetchPmtaListObject(getThis() TSRMLS_CC), address, address_len, vars ? Z_ARRVAL_P(vars) : NULL, pmtalist_notify(notify) TSRMLS_CC);
+	RETURN_LONG(idx);
+}
+
+/**
+ * @brief public function addMany(array $recipients);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_recipient_class
+ *
+ * Appends recipients given as addresses or <tt>array('address' => ..., 'notify' => ..., 'vars' => array(...))</tt> rows.
+ * Returns the number of recipients added. If a row is invalid, the rows before it stay in the list.
+ */
+static PHP_METHOD(PmtaRecipientList, addMany)
+{
+	pmtalist_object* obj;
+	zval* recipients;
+	zval** entry;
+	HashTable* ht;
+	HashPosition pos;
+	long int added = 0;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &recipients)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaListObject(getThis() TSRMLS_CC);
+	ht  = Z_ARRVAL_P(recipients);
+
+	for (
+		zend_hash_internal_pointer_reset_ex(ht, &pos);
+		zend_hash_get_current_data_ex(ht, (void**)&entry, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(ht, &pos)
+	) {
+		zval** zaddr;
+		zval** znotify;
+		zval** zvars;
+
+		if (Z_TYPE_PP(entry) == IS_STRING) {
+			pmtalist_append(obj, Z_STRVAL_PP(entry), Z_STRLEN_PP(entry), NULL, -1 TSRMLS_CC);
+			++added;
+			continue;
+		}
+
+		if (
+			   Z_TYPE_PP(entry) != IS_ARRAY
+			|| FAILURE == zend_hash_find(Z_ARRVAL_PP(entry), "address", sizeof("address"), (void**)&zaddr)
+			|| Z_TYPE_PP(zaddr) != IS_STRING
+		) {
+			throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_IllegalArgument, "Recipient must be an address or an array with the 'address' key", NULL TSRMLS_CC);
+			RETURN_NULL();
+		}
+
+		if (FAILURE == zend_hash_find(Z_ARRVAL_PP(entry), "notify", sizeof("notify"), (void**)&znotify)) {
+			znotify = NULL;
+		}
+
+		if (FAILURE == zend_hash_find(Z_ARRVAL_PP(entry), "vars", sizeof("vars"), (void**)&zvars) || Z_TYPE_PP(zvars) == IS_NULL) {
+			zvars = NULL;
+		}
+		else if (Z_TYPE_PP(zvars) != IS_ARRAY) {
+			throw_pmta_error(pmta_error_recipient_class, PmtaApiERROR_IllegalArgument, "Recipient variables must be an array", NULL TSRMLS_CC);
+			RETURN_NULL();
+		}
+
+		pmtalist_append(obj, Z_STRVAL_PP(zaddr), Z_STRLEN_PP(zaddr), zvars ? Z_ARRVAL_PP(zvars) : NULL, pmtalist_notify(znotify ? *znotify : NULL) TSRMLS_CC);
+		++added;
+	}
+
+	RETURN_LONG(added);
+}
+
+/**
+ * @brief public function get($index);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns <tt>array('address' => ..., 'notify' => ..., 'vars' => array(...))</tt> or @c null if there is no such recipient
+ */
+static PHP_METHOD(PmtaRecipientList, get)
+{
+	pmtalist_object* obj;
+	long int idx;
+	size_t i;
+	zval* vars;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &idx)) {
+		RETURN_NULL();
+	}
+
+	obj = fetchPmtaListObject(getThis() TSRMLS_CC);
+	if (idx < 0 || idx >= obj->count) {
+		RETURN_NULL();
+	}
+
+	MAKE_STD_ZVAL(vars);
+	array_init_size(vars, obj->var_start[idx+1] - obj->var_start[idx]);
+	for (i=obj->var_start[idx]; i<obj->var_start[idx+1]; ++i) {
+		const char* name = obj->var_names[obj->vars[i].name];
+		add_assoc_string_ex(vars, (char*)name, strlen(name) + 1, obj->arena + obj->vars[i].value, 1);
+	}
+
+	array_init_size(return_value, 3);
+	add_assoc_string_ex(return_value, ZEND_STRS("address"), obj->arena + obj->addresses[idx], 1);
+	if (obj->notify[idx] >= 0) {
+		add_assoc_long_ex(return_value, ZEND_STRS("notify"), obj->notify[idx]);
+	}
+	else {
+		add_assoc_null_ex(return_value, ZEND_STRS("notify"));
+	}
+
+	add_assoc_zval_ex(return_value, ZEND_STRS("vars"), vars);
+}
+
+/**
+ * @brief public function count();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaRecipientList, count)
+{
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	RETURN_LONG(fetchPmtaListObject(getThis() TSRMLS_CC)->count);
+}
+
+/**
+ * @brief arginfo for @c add()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_add, 0, 0, 1)
+	ZEND_ARG_INFO(0, address)
+	ZEND_ARG_ARRAY_INFO(0, vars, 1)
+	ZEND_ARG_INFO(0, notify)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c addMany()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_addmany, 0, 0, 1)
+	ZEND_ARG_ARRAY_INFO(0, recipients, 0)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c get()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_getrcpt, 0, 0, 1)
+	ZEND_ARG_INFO(0, index)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief @c PmtaRecipientList class methods
+ */
+static
+#if ZEND_MODULE_API_NO > 20060613
+const
+#endif
+zend_function_entry pmta_rcptlist_class_methods[] = {
+	PHP_ME(PmtaRecipientList, add,     arginfo_add,     ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaRecipientList, addMany, arginfo_addmany, ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaRecipientList, get,     arginfo_getrcpt, ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaRecipientList, count,   arginfo_empty,   ZEND_ACC_PUBLIC)
+	PHP_ME_MAPPING(__destruct, empty_destructor, arginfo_empty, ZEND_ACC_PUBLIC | ZEND_ACC_DTOR)
+	PHP_FE_END
+};
+
+/**
+ * Registers @c PmtaRecipientList class with Zend
+ */
+void pmtalist_register_class(TSRMLS_D)
+{
+	zend_class_entry e;
+
+	INIT_CLASS_ENTRY(e, "PmtaRecipientList", pmta_rcptlist_class_methods);
+
+	pmta_rcptlist_class = zend_register_internal_class(&e TSRMLS_CC);
+
+	pmta_rcptlist_class->create_object = pmtalist_ctor;
+	pmta_rcptlist_class->serialize     = zend_class_serialize_deny;
+	pmta_rcptlist_class->unserialize   = zend_class_unserialize_deny;
+
+#ifdef HAVE_SPL
+	zend_class_implements(pmta_rcptlist_class TSRMLS_CC, 1, spl_ce_Countable);
+#endif
+
+	pmtalist_object_handlers = *zend_get_std_object_handlers();
+	pmtalist_object_handlers.clone_obj      = NULL;
+	pmtalist_object_handlers.count_elements = pmtalist_count_elements;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file pmta_recipient_list.h
+ * @brief Exposes @c PmtaRecipientList class
+ * @details
+@code{.php}
+class PmtaRecipientList implements Countable
+{
+	public function __destruct();
+	public function add($address, array $vars = null, $notify = null);
+	public function addMany(array $recipients);
+	public function get($index);
+	public function count();
+	private function __clone();
+}
+@endcode
+ */
+
+#ifdef DOXYGEN
+#	undef PMTA_RECIPIENT_LIST_H
+#endif
+
+#ifndef PMTA_RECIPIENT_LIST_H
+#define PMTA_RECIPIENT_LIST_H
+
+#include "php_pmta.h"
+#include <submitter/PmtaRcpt.h>
+
+/**
+ * @brief Returns the number of recipients in @c PmtaRecipientList object
+ * @param object @c PmtaRecipientList object
+ * @param tsrm_ls Internally used by Zend
+ * @return Number of recipients
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern long int pmtalist_count(zval* object TSRMLS_DC);
+
+/**
+ * @brief Creates @c PmtaRcpt for the recipient stored in @c PmtaRecipientList object
+ * @param object @c PmtaRecipientList object
+ * @param idx Recipient index
+ * @param address Recipient's address (output; valid while @a object is not modified)
+ * @param tsrm_ls Internally used by Zend
+ * @return @c PmtaRcpt or @c NULL if @c PmtaErrorRecipient has been thrown
+ * @pre <tt>0 <= idx && idx < pmtalist_count(object)</tt>
+ * @note The caller is responsible for freeing the result with @c PmtaRcptFree()
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern PmtaRcpt pmtalist_materialize(zval* object, long int idx, const char** address TSRMLS_DC);
+
+/**
+ * @brief Registers @c PmtaRecipientList class
+ * @param tsrm_ls Internally used by Zend
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmtalist_register_class(TSRMLS_D);
+
+#endif /* PMTA_RECIPIENT_LIST_H */
@@ -0,0 +1,564 @@
+/**
+ * @file pmta_recipients_view.c
+ * @brief @c PmtaRecipientsView class implementation
+ * @details The view shares the recipients array of @c PmtaMessage (it only adds a reference to it),
+ * so reading @c $message->recipients takes constant time regardless of the number of recipients.
+ * Iteration, @c count() and @c [] are implemented by object handlers and do not call PHP methods.
+@code{.php}
+final class PmtaRecipientsView implements Traversable, Countable, ArrayAccess
+{
+	private $recipients; // shared with PmtaMessage
+
+	private function __construct() {}
+
+	public function count()
+	{
+		return count($this->recipients);
+	}
+
+	public function offsetExists($offset)
+	{
+		return isset($this->recipients[$offset]);
+	}
+
+	public function offsetGet($offset)
+	{
+		return $this->recipients[$offset];
+	}
+
+	public function offsetSet($offset, $value)
+	{
+		throw new PmtaErrorMessage('Recipients cannot be modified through the view');
+	}
+
+	public function offsetUnset($offset)
+	{
+		throw new PmtaErrorMessage('Recipients cannot be modified through the view');
+	}
+
+	private function __clone() {}
+}
+@endcode
+ */
+
+#include "pmta_recipients_view.h"
+#include "pmta_error.h"
+#include "pmta_common.h"
+#include <PmtaApi.h>
+
+#ifdef HAVE_SPL
+#	include <ext/spl/spl_iterators.h>
+#endif
+
+/**
+ * @brief @c PmtaRecipientsView object handlers
+ */
+static zend_object_handlers pmtaview_object_handlers;
+
+/**
+ * @brief Internal properties of @c PmtaRecipientsView
+ */
+typedef struct _pmtaview_object {
+	zend_object obj; /**< Zend object data */
+	zval* array;     /**< Recipients array shared with @c PmtaMessage */
+} pmtaview_object;
+
+/**
+ * @brief Iterator over @c PmtaRecipientsView
+ */
+typedef struct _pmtaview_iterator {
+	zend_object_iterator it; /**< Zend iterator; @c it.data holds @c PmtaRecipientsView instance */
+	HashTable* ht;           /**< Recipients */
+	HashPosition pos;        /**< Current position */
+} pmtaview_iterator;
+
+/**
+ * @brief Fetches @c pmtaview_object
+ * @see pmtaview_object
+ * @param zobj @c PmtaRecipientsView instance
+ * @return pmtaview_object associated with @a zobj
+ * @pre <tt>Z_TYPE_P(zobj) == IS_OBJECT && instanceof_function(Z_OBJCE_P(zobj), pmta_view_class TSRMLS_CC)</tt>
+ */
+static inline pmtaview_object* fetchPmtaViewObject(zval* zobj TSRMLS_DC)
+{
+	return (pmtaview_object*)zend_objects_get_address(zobj TSRMLS_CC);
+}
+
+/**
+ * @brief Finds the recipient
+ * @param obj @c pmtaview_object
+ * @param offset Index
+ * @return Recipient or @c NULL if there is no such index
+ */
+static zval** pmtaview_find(pmtaview_object* obj, zval* offset)
+{
+	HashTable* ht = Z_ARRVAL_P(obj->array);
+	zval** entry;
+	long int idx;
+
+	if (!offset) {
+		return NULL;
+	}
+
+	if (Z_TYPE_P(offset) == IS_STRING) {
+		return (SUCCESS == zend_symtable_find(ht, Z_STRVAL_P(offset), Z_STRLEN_P(offset) + 1, (void**)&entry)) ? entry : NULL;
+	}
+
+	if (Z_TYPE_P(offset) == IS_LONG) {
+		idx = Z_LVAL_P(offset);
+	}
+	else {
+		zval lval;
+		ZVAL_ZVAL(&lval, offset, 1, 0);
+		convert_to_long(&lval);
+		idx = Z_LVAL(lval);
+		zval_dtor(&lval);
+	}
+
+	return (SUCCESS == zend_hash_index_find(ht, idx, (void**)&entry)) ? entry : NULL;
+}
+
+/**
+ * @brief Throws @c PmtaErrorMessage on an attempt to modify the view
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtaview_readonly(TSRMLS_D)
+{
+	throw_pmta_error(pmta_error_message_class, PmtaApiERROR_PHP_API, "Recipients cannot be modified through the view", NULL TSRMLS_CC);
+}
+
+/**
+ * @brief @c read_dimension handler
+ * @param object @c PmtaRecipientsView instance
+ * @param offset Index
+ * @param type If @c BP_VAR_IS, notices will be suppressed
+ * @param tsrm_ls Internally used by Zend
+ * @return @c PmtaRecipient or @c null
+ */
+static zval* pmtaview_read_dimension(zval* object, zval* offset, int type TSRMLS_DC)
+{
+	zval** entry = pmtaview_find(fetchPmtaViewObject(object TSRMLS_CC), offset);
+
+	if (entry) {
+		return *entry;
+	}
+
+	if (type != BP_VAR_IS) {
+		zend_error(E_NOTICE, "Undefined offset in PmtaRecipientsView");
+	}
+
+	return EG(uninitialized_zval_ptr);
+}
+
+/**
+ * @brief @c has_dimension handler
+ * @param object @c PmtaRecipientsView instance
+ * @param offset Index
+ * @param check_empty Whether to check the value with @c empty() semantics
+ * @param tsrm_ls Internally used by Zend
+ * @return Whether the recipient exists
+ */
+static int pmtaview_has_dimension(zval* object, zval* offset, int check_empty TSRMLS_DC)
+{
+	zval** entry = pmtaview_find(fetchPmtaViewObject(object TSRMLS_CC), offset);
+
+	if (!entry) {
+		return 0;
+	}
+
+	return check_empty ? zend_is_true(*entry) : (Z_TYPE_PP(entry) != IS_NULL);
+}
+
+/**
+ * @brief @c write_dimension handler
+ * @param object @c PmtaRecipientsView instance
+ * @param offset Index
+ * @param value Value
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtaview_write_dimension(zval* object, zval* offset, zval* value TSRMLS_DC)
+{
+	pmtaview_readonly(TSRMLS_C);
+}
+
+/**
+ * @brief @c unset_dimension handler
+ * @param object @c PmtaRecipientsView instance
+ * @param offset Index
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtaview_unset_dimension(zval* object, zval* offset TSRMLS_DC)
+{
+	pmtaview_readonly(TSRMLS_C);
+}
+
+/**
+ * @brief @c count_elements handler
+ * @param object @c PmtaRecipientsView instance
+ * @param count Number of recipients (output)
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS
+ */
+static int pmtaview_count_elements(zval* object, long int* count TSRMLS_DC)
+{
+	*count = zend_hash_num_elements(Z_ARRVAL_P(fetchPmtaViewObject(object TSRMLS_CC)->array));
+	return SUCCESS;
+}
+
+/**
+ * @brief Iterator destructor
+ * @param it Iterator
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtaview_it_dtor(zend_object_iterator* it TSRMLS_DC)
+{
+	zval* object = (zval*)it->data;
+
+	zval_ptr_dtor(&object);
+	efree(it);
+}
+
+/**
+ * @brief Checks whether the iterator points to a recipient
+ * @param it Iterator
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE
+ */
+static int pmtaview_it_valid(zend_object_iterator* it TSRMLS_DC)
+{
+	pmtaview_iterator* iter = (pmtaview_iterator*)it;
+	return zend_hash_has_more_elements_ex(iter->ht, &iter->pos);
+}
+
+/**
+ * @brief Returns the current recipient
+ * @param it Iterator
+ * @param data Current recipient (output)
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtaview_it_get_current_data(zend_object_iterator* it, zval*** data TSRMLS_DC)
+{
+	pmtaview_iterator* iter = (pmtaview_iterator*)it;
+
+	if (FAILURE == zend_hash_get_current_data_ex(iter->ht, (void**)data, &iter->pos)) {
+		*data = NULL;
+	}
+}
+
+#if PHP_VERSION_ID >= 50500
+/**
+ * @brief Returns the current index
+ * @param it Iterator
+ * @param key Current index (output)
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtaview_it_get_current_key(zend_object_iterator* it, zval* key TSRMLS_DC)
+{
+	pmtaview_iterator* iter = (pmtaview_iterator*)it;
+	zend_hash_get_current_key_zval_ex(iter->ht, key, &iter->pos);
+}
+#else
+/**
+ * @brief Returns the current index
+ * @param it Iterator
+ * @param str_key String key (output)
+ * @param str_key_len Length of @a str_key (output)
+ * @param int_key Integer key (output)
+ * @param tsrm_ls Internally used by Zend
+ * @return Key type
+ */
+static int pmtaview_it_get_current_key(zend_object_iterator* it, char** str_key, uint* str_key_len, ulong* int_key TSRMLS_DC)
+{
+	pmtaview_iterator* iter = (pmtaview_iterator*)it;
+	return zend_hash_get_current_key_ex(iter->ht, str_key, str_key_len, int_key, 1, &iter->pos);
+}
+#endif
+
+/**
+ * @brief Advances the iterator
+ * @param it Iterator
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtaview_it_move_forward(zend_object_iterator* it TSRMLS_DC)
+{
+	pmtaview_iterator* iter = (pmtaview_iterator*)it;
+	zend_hash_move_forward_ex(iter->ht, &iter->pos);
+}
+
+/**
+ * @brief Rewinds the iterator
+ * @param it Iterator
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtaview_it_rewind(zend_object_iterator* it TSRMLS_DC)
+{
+	pmtaview_iterator* iter = (pmtaview_iterator*)it;
+	zend_hash_internal_pointer_reset_ex(iter->ht, &iter->pos);
+}
+
+/**
+ * @brief Iterator functions
+ */
+static zend_object_iterator_funcs pmtaview_iterator_funcs = {
+	pmtaview_it_dtor,
+	pmtaview_it_valid,
+	pmtaview_it_get_current_data,
+	pmtaview_it_get_current_key,
+	pmtaview_it_move_forward,
+	pmtaview_it_rewind,
+	NULL
+};
+
+/**
+ * @brief @c get_iterator handler
+ * @param ce Class Entry for @c PmtaRecipientsView
+ * @param object @c PmtaRecipientsView instance
+ * @param by_ref Whether iteration by reference has been requested
+ * @param tsrm_ls Internally used by Zend
+ * @return Iterator or @c NULL if @a by_ref is set
+ */
+static zend_object_iterator* pmtaview_get_iterator(zend_class_entry* ce, zval* object, int by_ref TSRMLS_DC)
+{
+	pmtaview_iterator* iter;
+
+	if (by_ref) {
+		pmtaview_readonly(TSRMLS_C);
+		return NULL;
+	}
+
+	iter = emalloc(sizeof(pmtaview_iterator));
+	memset(&iter->it, 0, sizeof(zend_object_iterator));
+
+	Z_ADDREF_P(object);
+	iter->it.data  = object;
+	iter->it.funcs = &pmtaview_iterator_funcs;
+	iter->ht       = Z_ARRVAL_P(fetchPmtaViewObject(object TSRMLS_CC)->array);
+	zend_hash_internal_pointer_reset_ex(iter->ht, &iter->pos);
+
+	return &iter->it;
+}
+
+/**
+ * @brief @c get_properties handler
+ * @param object @c PmtaRecipientsView instance
+ * @param tsrm_ls Internally used by Zend
+ * @return Recipients (so that @c var_dump() shows them)
+ */
+static HashTable* pmtaview_get_properties(zval* object TSRMLS_DC)
+{
+	return Z_ARRVAL_P(fetchPmtaViewObject(object TSRMLS_CC)->array);
+}
+
+/**
+ * @brief @c PmtaRecipientsView destructor
+ * @param v @c pmtaview_object
+ * @param tsrm_ls Internally used by Zend
+ * @details Releases the recipients array and frees the memory allocated for @c pmtaview_object
+ */
+static void pmtaview_dtor(void* v TSRMLS_DC)
+{
+	pmtaview_object* obj = v;
+
+	if (obj->array) {
+		zval_ptr_dtor(&obj->array);
+	}
+
+	zend_object_std_dtor(&(obj->obj) TSRMLS_CC);
+	efree(obj);
+}
+
+/**
+ * @brief @c PmtaRecipientsView constructor
+ * @param ce Class Entry for @c PmtaRecipientsView
+ * @param tsrm_ls Internally used by Zend
+ * @return Zend Object Value
+ * @details Allocates memory for @c pmtaview_object and registers the destructor
+ */
+static zend_object_value pmtaview_ctor(zend_class_entry* ce TSRMLS_DC)
+{
+	pmtaview_object* obj = ecalloc(1, sizeof(pmtaview_object));
+	zend_object_value retval;
+
+	zend_object_std_init(&obj->obj, ce TSRMLS_CC);
+#if PHP_VERSION_ID >= 50400
+	object_properties_init(&obj->obj, ce);
+#endif
+
+	retval.handle = zend_objects_store_put(
+		obj,
+		(zend_objects_store_dtor_t)zend_objects_destroy_object,
+		pmtaview_dtor,
+		NULL TSRMLS_CC
+	);
+
+	retval.handlers = &pmtaview_object_handlers;
+
+	return retval;
+}
+
+void pmtaview_create(zval* result, zval* array TSRMLS_DC)
+{
+	pmtaview_object* obj;
+
+	object_init_ex(result, pmta_view_class);
+	obj = fetchPmtaViewObject(result TSRMLS_CC);
+
+	Z_ADDREF_P(array);
+	obj->array = array;
+}
+
+/**
+ * @brief public function count();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaRecipientsView, count)
+{
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	RETURN_LONG(zend_hash_num_elements(Z_ARRVAL_P(fetchPmtaViewObject(getThis() TSRMLS_CC)->array)));
+}
+
+/**
+ * @brief public function offsetExists($offset);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaRecipientsView, offsetExists)
+{
+	zval* offset;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &offset)) {
+		RETURN_NULL();
+	}
+
+	RETURN_BOOL(pmtaview_has_dimension(getThis(), offset, 0 TSRMLS_CC));
+}
+
+/**
+ * @brief public function offsetGet($offset);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaRecipientsView, offsetGet)
+{
+	zval* offset;
+	zval* retval;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &offset)) {
+		RETURN_NULL();
+	}
+
+	retval = pmtaview_read_dimension(getThis(), offset, BP_VAR_R TSRMLS_CC);
+	RETURN_ZVAL(retval, 1, 0);
+}
+
+/**
+ * @brief public function offsetSet($offset, $value);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ */
+static PHP_METHOD(PmtaRecipientsView, offsetSet)
+{
+	pmtaview_readonly(TSRMLS_C);
+}
+
+/**
+ * @brief public function offsetUnset($offset);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ */
+static PHP_METHOD(PmtaRecipientsView, offsetUnset)
+{
+	pmtaview_readonly(TSRMLS_C);
+}
+
+/**
+ * @brief arginfo for @c offsetExists(), @c offsetGet() and @c offsetUnset()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_offset, 0, 0, 1)
+	ZEND_ARG_INFO(0, offset)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c offsetSet()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_offsetset, 0, 0, 2)
+	ZEND_ARG_INFO(0, offset)
+	ZEND_ARG_INFO(0, value)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief @c PmtaRecipientsView class methods
+ */
+static
+#if ZEND_MODULE_API_NO > 20060613
+const
+#endif
+zend_function_entry pmta_view_class_methods[] = {
+	PHP_ME(PmtaRecipientsView, count,        arginfo_empty,     ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaRecipientsView, offsetExists, arginfo_offset,    ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaRecipientsView, offsetGet,    arginfo_offset,    ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaRecipientsView, offsetSet,    arginfo_offsetset, ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaRecipientsView, offsetUnset,  arginfo_offset,    ZEND_ACC_PUBLIC)
+	PHP_ME_MAPPING(__construct, empty_destructor, arginfo_empty, ZEND_ACC_PRIVATE | ZEND_ACC_CTOR)
+	PHP_ME_MAPPING(__destruct,  empty_destructor, arginfo_empty, ZEND_ACC_PUBLIC | ZEND_ACC_DTOR)
+	PHP_FE_END
+};
+
+/**
+ * Registers @c PmtaRecipientsView class with Zend
+ */
+void pmtaview_register_class(TSRMLS_D)
+{
+	zend_class_entry e;
+
+	INIT_CLASS_ENTRY(e, "PmtaRecipientsView", pmta_view_class_methods);
+
+	pmta_view_class = zend_register_internal_class(&e TSRMLS_CC);
+
+	pmta_view_class->ce_flags            |= ZEND_ACC_FINAL_CLASS;
+	pmta_view_class->create_object        = pmtaview_ctor;
+	pmta_view_class->get_iterator         = pmtaview_get_iterator;
+	pmta_view_class->iterator_funcs.funcs = &pmtaview_iterator_funcs;
+	pmta_view_class->serialize            = zend_class_serialize_deny;
+	pmta_view_class->unserialize          = zend_class_unserialize_deny;
+
+	zend_class_implements(pmta_view_class TSRMLS_CC, 2, zend_ce_traversable, zend_ce_arrayaccess);
+#ifdef HAVE_SPL
+	zend_class_implements(pmta_view_class TSRMLS_CC, 1, spl_ce_Countable);
+#endif
+
+	pmtaview_object_handlers = *zend_get_std_object_handlers();
+	pmtaview_object_handlers.clone_obj       = NULL;
+	pmtaview_object_handlers.read_dimension  = pmtaview_read_dimension;
+	pmtaview_object_handlers.write_dimension = pmtaview_write_dimension;
+	pmtaview_object_handlers.has_dimension   = pmtaview_has_dimension;
+	pmtaview_object_handlers.unset_dimension = pmtaview_unset_dimension;
+	pmtaview_object_handlers.count_elements  = pmtaview_count_elements;
+	pmtaview_object_handlers.get_properties  = pmtaview_get_properties;
+}
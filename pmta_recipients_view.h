@@ -0,0 +1,43 @@
+/**
+ * @file pmta_recipients_view.h
+ * @brief Exposes @c PmtaRecipientsView class (read-only view of @c PmtaMessage::$recipients)
+ * @details
+@code{.php}
+final class PmtaRecipientsView implements Traversable, Countable, ArrayAccess
+{
+	private function __construct();
+	public function __destruct();
+	public function count();
+	public function offsetExists($offset);
+	public function offsetGet($offset);
+	public function offsetSet($offset, $value);
+	public function offsetUnset($offset);
+	private function __clone();
+}
+@endcode
+ */
+
+#ifdef DOXYGEN
+#	undef PMTA_RECIPIENTS_VIEW_H
+#endif
+
+#ifndef PMTA_RECIPIENTS_VIEW_H
+#define PMTA_RECIPIENTS_VIEW_H
+
+#include "php_pmta.h"
+
+/**
+ * @brief Creates @c PmtaRecipientsView over the array
+ * @param result @c PmtaRecipientsView instance (output)
+ * @param array Array of @c PmtaRecipient objects; the view keeps a reference to it, the array is not copied
+ * @param tsrm_ls Internally used by Zend
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmtaview_create(zval* result, zval* array TSRMLS_DC);
+
+/**
+ * @brief Registers @c PmtaRecipientsView class
+ * @param tsrm_ls Internally used by Zend
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmtaview_register_class(TSRMLS_D);
+
+#endif /* PMTA_RECIPIENTS_VIEW_H */
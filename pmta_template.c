@@ -0,0 +1,743 @@
+/**
+ * @file pmta_template.c
+ * @brief @c PmtaTemplate class implementation
+ * @details Compiled templates live in a storage area created at @c MINIT. Where anonymous shared mappings are
+ * available, the area is shared by all processes forked from the master (FPM, Apache prefork), so a template
+ * compiled by one worker is visible to the others. Otherwise (Windows, or if @c mmap() fails) every process
+ * has its own copy. Templates are never removed: compiling a template with the same name and different parts
+ * adds a new version which hides the old one, the space taken by the old version is reclaimed on restart.
+@code{.php}
+final class PmtaTemplate
+{
+	private $name;
+	private $body;
+	private $size;
+	private $shared;
+
+	private function __construct() {}
+
+	public static function compile($name, array $parts)
+	{
+		$body = array();
+		foreach ($parts as $part) {
+			// string => addData(), array('data' => ...), array('merge' => ...), array('part' => n), array('date' => true)
+			$body[] = $part;
+		}
+
+		// Stored once in the shared area; an identical template compiled earlier is reused
+		return shm_store($name, $body);
+	}
+
+	public static function get($name)
+	{
+		return shm_find($name); // or null
+	}
+
+	public function getName()
+	{
+		return $this->name;
+	}
+
+	public function getSize()
+	{
+		return $this->size;
+	}
+
+	public function isShared()
+	{
+		return $this->shared; // whether mmap(MAP_SHARED | MAP_ANONYMOUS) succeeded at MINIT
+	}
+
+	private function __clone() {}
+}
+@endcode
+ */
+
+#include "pmta_template.h"
+#include "pmta_body.h"
+#include "pmta_error.h"
+#include "pmta_common.h"
+#include <PmtaApi.h>
+
+#if !defined(PHP_WIN32) && defined(__GNUC__)
+#	include <sys/mman.h>
+#	include <sched.h>
+#	include <signal.h>
+#	include <errno.h>
+#	include <unistd.h>
+#	if defined(MAP_ANONYMOUS) || defined(MAP_ANON)
+/**
+ * @brief Defined if the template storage can be shared between processes
+ */
+#		define PMTA_TEMPLATE_SHM 1
+#		ifndef MAP_ANONYMOUS
+#			define MAP_ANONYMOUS MAP_ANON
+#		endif
+#		ifdef HAVE_PTHREAD_MUTEX_CONSISTENT
+#			include <pthread.h>
+/**
+ * @brief Defined if writers can use a robust process-shared mutex
+ */
+#			define PMTA_TEMPLATE_MUTEX 1
+#		endif
+#	endif
+/**
+ * @brief Lets the lock owner run
+ */
+#	define PMTA_TEMPLATE_YIELD() sched_yield()
+#elif defined(PHP_WIN32)
+#	define PMTA_TEMPLATE_YIELD() SwitchToThread()
+#else
+#	define PMTA_TEMPLATE_YIELD()
+#endif
+
+/**
+ * @brief How long a writer waits for the spinlock before it takes the lock over, seconds
+ * @details Storing a template takes well under a millisecond; a lock held longer than this has an owner
+ * which died without its PID being seen as free (the PID has been reused)
+ */
+#define PMTA_TEMPLATE_LOCK_TIMEOUT 10
+
+/**
+ * @brief Template storage header
+ */
+typedef struct _pmta_template_store {
+#ifdef PMTA_TEMPLATE_MUTEX
+	pthread_mutex_t mutex; /**< Robust process-shared mutex taken by writers if @c has_mutex; readers do not lock */
+	int has_mutex;         /**< Whether @c mutex has been initialized */
+#endif
+	volatile int lock;     /**< Process ID of the writer holding the spinlock, 0 if free; used if there is no @c mutex */
+	volatile size_t first; /**< Offset of the most recently compiled template, 0 if there are none */
+	size_t used;           /**< Number of bytes used, including the header */
+	size_t size;           /**< Size of the storage */
+} pmta_template_store;
+
+/**
+ * @brief Compiled template
+ * @details Entries are immutable once published
+ */
+typedef struct _pmta_template_entry {
+	size_t next;        /**< Offset of the previously compiled template, 0 if there are none */
+	zend_uint hash;     /**< @c pmta_hash() of the name */
+	zend_uint name_len; /**< Length of the name */
+	size_t body_len;    /**< Length of the body records */
+	char data[1];       /**< Name, @c NUL, body records */
+} pmta_template_entry;
+
+/**
+ * @brief Template storage, @c NULL if templates are disabled
+ */
+static pmta_template_store* pmta_templates = NULL;
+
+/**
+ * @brief Whether @c pmta_templates is shared between processes
+ */
+static int pmta_templates_shared = 0;
+
+/**
+ * @brief @c PmtaTemplate object handlers
+ */
+static zend_object_handlers pmtatpl_object_handlers;
+
+/**
+ * @brief Internal properties of @c PmtaTemplate
+ */
+typedef struct _pmtatpl_object {
+	zend_object obj;                  /**< Zend object data */
+	const pmta_template_entry* entry; /**< Compiled template */
+} pmtatpl_object;
+
+/**
+ * @brief Fetches @c pmtatpl_object
+ * @see pmtatpl_object
+ * @param zobj @c PmtaTemplate instance
+ * @return pmtatpl_object associated with @a zobj
+ * @pre <tt>Z_TYPE_P(zobj) == IS_OBJECT && instanceof_function(Z_OBJCE_P(zobj), pmta_template_class TSRMLS_CC)</tt>
+ */
+static inline pmtatpl_object* fetchPmtaTplObject(zval* zobj TSRMLS_DC)
+{
+	return (pmtatpl_object*)zend_objects_get_address(zobj TSRMLS_CC);
+}
+
+/**
+ * @brief Returns the body records of the template
+ * @param e Template
+ * @return Body records
+ */
+static inline const char* pmta_template_body(const pmta_template_entry* e)
+{
+	return e->data + e->name_len + 1;
+}
+
+/**
+ * @brief Takes the storage lock
+ * @details Writers use a robust mutex where the platform has one: if its owner dies, the next writer gets
+ * @c EOWNERDEAD and marks the mutex consistent. Otherwise the spinlock holds the process ID of its owner,
+ * and is taken over once the owner is found to be gone, or after @c PMTA_TEMPLATE_LOCK_TIMEOUT seconds
+ * in case the PID of the dead owner has been reused. Either way this is safe because a template becomes
+ * reachable only when it is complete: a dead owner has at most left some unreachable bytes behind.
+ */
+static void pmta_template_lock(void)
+{
+#if defined(__GNUC__)
+#	ifdef PMTA_TEMPLATE_SHM
+	int self           = (int)getpid();
+	unsigned int spins = 0;
+	time_t since       = 0;
+#	else
+	int self           = 1;
+#	endif
+	int owner;
+
+#	ifdef PMTA_TEMPLATE_MUTEX
+	if (pmta_templates->has_mutex) {
+		if (EOWNERDEAD == pthread_mutex_lock(&pmta_templates->mutex)) {
+			pthread_mutex_consistent(&pmta_templates->mutex);
+		}
+
+		return;
+	}
+#	endif
+
+	while (0 != (owner = __sync_val_compare_and_swap(&pmta_templates->lock, 0, self))) {
+#	ifdef PMTA_TEMPLATE_SHM
+		if (!(++spins & 63)) {
+			time_t now = time(NULL);
+			int dead   = (-1 == kill((pid_t)owner, 0) && ESRCH == errno);
+
+			if (!since) {
+				since = now;
+			}
+
+			if ((dead || now - since > PMTA_TEMPLATE_LOCK_TIMEOUT) && __sync_bool_compare_and_swap(&pmta_templates->lock, owner, self)) {
+				break;
+			}
+		}
+#	endif
+
+		PMTA_TEMPLATE_YIELD();
+	}
+#elif defined(_MSC_VER)
+	while (InterlockedExchange((volatile LONG*)&pmta_templates->lock, 1)) {
+		while (pmta_templates->lock) {
+			PMTA_TEMPLATE_YIELD();
+		}
+	}
+#endif
+}
+
+/**
+ * @brief Releases the storage lock
+ */
+static void pmta_template_unlock(void)
+{
+#ifdef PMTA_TEMPLATE_MUTEX
+	if (pmta_templates->has_mutex) {
+		pthread_mutex_unlock(&pmta_templates->mutex);
+		return;
+	}
+#endif
+
+#if defined(__GNUC__)
+	__sync_lock_release(&pmta_templates->lock);
+#elif defined(_MSC_VER)
+	InterlockedExchange((volatile LONG*)&pmta_templates->lock, 0);
+#endif
+}
+
+#ifdef PMTA_TEMPLATE_MUTEX
+/**
+ * @brief Initializes the robust process-shared mutex of the storage
+ * @return Whether the mutex can be used
+ */
+static int pmta_template_init_mutex(void)
+{
+	pthread_mutexattr_t attr;
+	int ok;
+
+	if (0 != pthread_mutexattr_init(&attr)) {
+		return 0;
+	}
+
+	ok = 0 == pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED)
+	  && 0 == pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST)
+	  && 0 == pthread_mutex_init(&pmta_templates->mutex, &attr);
+
+	pthread_mutexattr_destroy(&attr);
+	return ok;
+}
+#endif
+
+void pmta_template_startup(size_t size)
+{
+	void* p = NULL;
+
+	if (size < sizeof(pmta_template_store)) {
+		return;
+	}
+
+#ifdef PMTA_TEMPLATE_SHM
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == p) {
+		p = NULL;
+	}
+	else {
+		pmta_templates_shared = 1;
+	}
+#endif
+
+	if (!p) {
+		p = pemalloc(size, 1);
+	}
+
+	pmta_templates        = p;
+	pmta_templates->lock  = 0;
+	pmta_templates->first = 0;
+	pmta_templates->used  = ZEND_MM_ALIGNED_SIZE(sizeof(pmta_template_store));
+	pmta_templates->size  = size;
+
+#ifdef PMTA_TEMPLATE_MUTEX
+	pmta_templates->has_mutex = pmta_templates_shared && pmta_template_init_mutex();
+#endif
+}
+
+void pmta_template_shutdown(void)
+{
+	if (!pmta_templates) {
+		return;
+	}
+
+#ifdef PMTA_TEMPLATE_MUTEX
+	if (pmta_templates->has_mutex) {
+		pthread_mutex_destroy(&pmta_templates->mutex);
+	}
+#endif
+
+#ifdef PMTA_TEMPLATE_SHM
+	if (pmta_templates_shared) {
+		munmap((void*)pmta_templates, pmta_templates->size);
+	}
+	else
+#endif
+	{
+		pefree(pmta_templates, 1);
+	}
+
+	pmta_templates        = NULL;
+	pmta_templates_shared = 0;
+}
+
+/**
+ * @brief Finds the most recent version of the template
+ * @param name Name
+ * @param name_len Length of @a name
+ * @return Template or @c NULL if not found
+ */
+static const pmta_template_entry* pmta_template_find(const char* name, uint name_len)
+{
+	zend_uint hash = pmta_hash(name, name_len);
+	size_t off     = pmta_templates->first;
+
+	while (off) {
+		const pmta_template_entry* e = (const pmta_template_entry*)((const char*)pmta_templates + off);
+
+		if (e->hash == hash && e->name_len == name_len && !memcmp(e->data, name, name_len)) {
+			return e;
+		}
+
+		off = e->next;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Stores the template unless an identical one exists
+ * @param name Name
+ * @param name_len Length of @a name
+ * @param body Body records
+ * @param body_len Length of @a body
+ * @return Template or @c NULL if the storage is full
+ */
+static const pmta_template_entry* pmta_template_store_entry(const char* name, uint name_len, const char* body, size_t body_len)
+{
+	size_t need = ZEND_MM_ALIGNED_SIZE(offsetof(pmta_template_entry, data) + name_len + 1 + body_len);
+	const pmta_template_entry* found;
+	pmta_template_entry* e;
+
+	pmta_template_lock();
+
+	/* Every worker compiles its templates on start; do not store the same template over and over */
+	found = pmta_template_find(name, name_len);
+	if (found && found->body_len == body_len && !memcmp(pmta_template_body(found), body, body_len)) {
+		pmta_template_unlock();
+		return found;
+	}
+
+	if (pmta_templates->used + need > pmta_templates->size) {
+		pmta_template_unlock();
+		return NULL;
+	}
+
+	e = (pmta_template_entry*)((char*)pmta_templates + pmta_templates->used);
+	pmta_templates->used += need;
+
+	e->next     = pmta_templates->first;
+	e->hash     = pmta_hash(name, name_len);
+	e->name_len = name_len;
+	e->body_len = body_len;
+	memcpy(e->data, name, name_len);
+	e->data[name_len] = '\0';
+	memcpy(e->data + name_len + 1, body, body_len);
+
+	/* Readers do not lock: the entry must be complete before it becomes reachable */
+#if defined(__GNUC__)
+	__sync_synchronize();
+#elif defined(_MSC_VER)
+	MemoryBarrier();
+#endif
+	pmta_templates->first = (const char*)e - (const char*)pmta_templates;
+
+	pmta_template_unlock();
+	return e;
+}
+
+/**
+ * @brief Appends one element of @c $parts to the body
+ * @param body Body (input/output)
+ * @param len Length of the body (input/output)
+ * @param part Element of @c $parts
+ * @param tsrm_ls Internally used by Zend
+ * @return @c SUCCESS or @c FAILURE if @c PmtaErrorMessage has been thrown
+ */
+static int pmtatpl_add_part(pmta_body** body, size_t* len, zval* part TSRMLS_DC)
+{
+	zval** value;
+	enum pmta_body_op op = PMTA_BODY_DATA;
+
+	if (Z_TYPE_P(part) == IS_STRING) {
+		*body = pmta_body_append(*body, len, PMTA_BODY_DATA, Z_STRVAL_P(part), Z_STRLEN_P(part));
+		return SUCCESS;
+	}
+
+	if (Z_TYPE_P(part) == IS_ARRAY && 1 == zend_hash_num_elements(Z_ARRVAL_P(part))) {
+		if (SUCCESS == zend_hash_find(Z_ARRVAL_P(part), "part", sizeof("part"), (void**)&value)) {
+			zval lval;
+			int number;
+
+			ZVAL_ZVAL(&lval, *value, 1, 0);
+			convert_to_long(&lval);
+			number = (int)Z_LVAL(lval);
+
+			*body = pmta_body_append(*body, len, PMTA_BODY_PART, (const char*)&number, sizeof(int));
+			return SUCCESS;
+		}
+
+		if (SUCCESS == zend_hash_find(Z_ARRVAL_P(part), "date", sizeof("date"), (void**)&value)) {
+			if (zend_is_true(*value)) {
+				*body = pmta_body_append(*body, len, PMTA_BODY_DATE, NULL, 0);
+			}
+
+			return SUCCESS;
+		}
+
+		if (SUCCESS == zend_hash_find(Z_ARRVAL_P(part), "data", sizeof("data"), (void**)&value)) {
+			op = PMTA_BODY_DATA;
+		}
+		else if (SUCCESS == zend_hash_find(Z_ARRVAL_P(part), "merge", sizeof("merge"), (void**)&value)) {
+			op = PMTA_BODY_MERGE;
+		}
+		else {
+			value = NULL;
+		}
+
+		if (value) {
+			if (Z_TYPE_PP(value) == IS_STRING) {
+				*body = pmta_body_append(*body, len, op, Z_STRVAL_PP(value), Z_STRLEN_PP(value));
+			}
+			else {
+				zval str;
+				ZVAL_ZVAL(&str, *value, 1, 0);
+				convert_to_string(&str);
+				*body = pmta_body_append(*body, len, op, Z_STRVAL(str), Z_STRLEN(str));
+				zval_dtor(&str);
+			}
+
+			return SUCCESS;
+		}
+	}
+
+	throw_pmta_error(pmta_error_message_class, PmtaApiERROR_IllegalArgument, "Template part must be a string or an array with one of 'data', 'merge', 'part' or 'date' keys", NULL TSRMLS_CC);
+	return FAILURE;
+}
+
+const char* pmtatpl_get_body(zval* object, size_t* len TSRMLS_DC)
+{
+	const pmta_template_entry* e = fetchPmtaTplObject(object TSRMLS_CC)->entry;
+
+	*len = e->body_len;
+	return pmta_template_body(e);
+}
+
+/**
+ * @brief Creates @c PmtaTemplate object
+ * @param result @c PmtaTemplate instance (output)
+ * @param e Template
+ * @param tsrm_ls Internally used by Zend
+ */
+static void pmtatpl_create(zval* result, const pmta_template_entry* e TSRMLS_DC)
+{
+	object_init_ex(result, pmta_template_class);
+	fetchPmtaTplObject(result TSRMLS_CC)->entry = e;
+}
+
+/**
+ * @brief @c PmtaTemplate destructor
+ * @param v @c pmtatpl_object
+ * @param tsrm_ls Internally used by Zend
+ * @details Frees the memory allocated for @c pmtatpl_object; the template itself stays in the storage
+ */
+static void pmtatpl_dtor(void* v TSRMLS_DC)
+{
+	pmtatpl_object* obj = v;
+
+	zend_object_std_dtor(&(obj->obj) TSRMLS_CC);
+	efree(obj);
+}
+
+/**
+ * @brief @c PmtaTemplate constructor
+ * @param ce Class Entry for @c PmtaTemplate
+ * @param tsrm_ls Internally used by Zend
+ * @return Zend Object Value
+ * @details Allocates memory for @c pmtatpl_object and registers the destructor
+ */
+static zend_object_value pmtatpl_ctor(zend_class_entry* ce TSRMLS_DC)
+{
+	pmtatpl_object* obj = ecalloc(1, sizeof(pmtatpl_object));
+	zend_object_value retval;
+
+	zend_object_std_init(&obj->obj, ce TSRMLS_CC);
+#if PHP_VERSION_ID >= 50400
+	object_properties_init(&obj->obj, ce);
+#endif
+
+	retval.handle = zend_objects_store_put(
+		obj,
+		(zend_objects_store_dtor_t)zend_objects_destroy_object,
+		pmtatpl_dtor,
+		NULL TSRMLS_CC
+	);
+
+	retval.handlers = &pmtatpl_object_handlers;
+
+	return retval;
+}
+
+/**
+ * @brief public static function compile($name, array $parts);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ * @throw pmta_error_message_class
+ *
+ * Every element of @c $parts is either a string (static data) or an array with one key:
+ * @c data (static data), @c merge (data with merge variables), @c part (starts a new part) or @c date
+ * (adds the @c Date header when true). Returns @c PmtaTemplate.
+ */
+static PHP_METHOD(PmtaTemplate, compile)
+{
+	char* name;
+	int name_len;
+	zval* parts;
+	pmta_body* body = NULL;
+	size_t len      = 0;
+	const pmta_template_entry* e;
+	HashPosition pos;
+	zval** entry;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "sa", &name, &name_len, &parts)) {
+		RETURN_NULL();
+	}
+
+	if (!pmta_templates) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_PHP_API, "Templates are disabled (pmta.template_shm_size = 0)", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	for (
+		zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(parts), &pos);
+		zend_hash_get_current_data_ex(Z_ARRVAL_P(parts), (void**)&entry, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(Z_ARRVAL_P(parts), &pos)
+	) {
+		if (FAILURE == pmtatpl_add_part(&body, &len, *entry TSRMLS_CC)) {
+			if (body) {
+				pmta_body_release(body);
+			}
+
+			RETURN_NULL();
+		}
+	}
+
+	e = pmta_template_store_entry(name, name_len, body ? body->buf : "", len);
+	if (body) {
+		pmta_body_release(body);
+	}
+
+	if (!e) {
+		throw_pmta_error(pmta_error_message_class, PmtaApiERROR_OutOfMemory, "Template storage is full (pmta.template_shm_size)", NULL TSRMLS_CC);
+		RETURN_NULL();
+	}
+
+	pmtatpl_create(return_value, e TSRMLS_CC);
+}
+
+/**
+ * @brief public static function get($name);
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns @c PmtaTemplate compiled by this or (if the storage is shared) any other process, or @c null
+ */
+static PHP_METHOD(PmtaTemplate, get)
+{
+	char* name;
+	int name_len;
+	const pmta_template_entry* e;
+
+	if (FAILURE == zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &name, &name_len)) {
+		RETURN_NULL();
+	}
+
+	if (!pmta_templates) {
+		RETURN_NULL();
+	}
+
+	e = pmta_template_find(name, name_len);
+	if (!e) {
+		RETURN_NULL();
+	}
+
+	pmtatpl_create(return_value, e TSRMLS_CC);
+}
+
+/**
+ * @brief public function getName();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ */
+static PHP_METHOD(PmtaTemplate, getName)
+{
+	const pmta_template_entry* e;
+
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	e = fetchPmtaTplObject(getThis() TSRMLS_CC)->entry;
+	RETURN_STRINGL(e->data, e->name_len, 1);
+}
+
+/**
+ * @brief public function getSize();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns the number of bytes the compiled body takes in the storage
+ */
+static PHP_METHOD(PmtaTemplate, getSize)
+{
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	RETURN_LONG((long int)fetchPmtaTplObject(getThis() TSRMLS_CC)->entry->body_len);
+}
+
+/**
+ * @brief public function isShared();
+ * @param ht Internally used by Zend (number of arguments)
+ * @param return_value Internally used by Zend (return value)
+ * @param return_value_ptr Internally used by Zend
+ * @param this_ptr Internally used by Zend (@c $this)
+ * @param return_value_used Internally used by Zend (whether the return value is used)
+ * @param tsrm_ls Internally used by Zend
+ *
+ * Returns whether the template is visible to the other worker processes
+ */
+static PHP_METHOD(PmtaTemplate, isShared)
+{
+	if (zend_parse_parameters_none() == FAILURE) {
+		RETURN_NULL();
+	}
+
+	RETURN_BOOL(pmta_templates_shared);
+}
+
+/**
+ * @brief arginfo for @c compile()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_compile, 0, 0, 2)
+	ZEND_ARG_INFO(0, name)
+	ZEND_ARG_ARRAY_INFO(0, parts, 0)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief arginfo for @c get()
+ */
+PHPPMTA_STATIC ZEND_BEGIN_ARG_INFO_EX(arginfo_gettpl, 0, 0, 1)
+	ZEND_ARG_INFO(0, name)
+ZEND_END_ARG_INFO()
+
+/**
+ * @brief @c PmtaTemplate class methods
+ */
+static
+#if ZEND_MODULE_API_NO > 20060613
+const
+#endif
+zend_function_entry pmta_template_class_methods[] = {
+	PHP_ME(PmtaTemplate, compile,  arginfo_compile, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PmtaTemplate, get,      arginfo_gettpl,  ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	PHP_ME(PmtaTemplate, getName,  arginfo_empty,   ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaTemplate, getSize,  arginfo_empty,   ZEND_ACC_PUBLIC)
+	PHP_ME(PmtaTemplate, isShared, arginfo_empty,   ZEND_ACC_PUBLIC)
+	PHP_ME_MAPPING(__construct, empty_destructor, arginfo_empty, ZEND_ACC_PRIVATE | ZEND_ACC_CTOR)
+	PHP_ME_MAPPING(__destruct,  empty_destructor, arginfo_empty, ZEND_ACC_PUBLIC | ZEND_ACC_DTOR)
+	PHP_FE_END
+};
+
+/**
+ * Registers @c PmtaTemplate class with Zend
+ */
+void pmtatpl_register_class(TSRMLS_D)
+{
+	zend_class_entry e;
+
+	INIT_CLASS_ENTRY(e, "PmtaTemplate", pmta_template_class_methods);
+
+	pmta_template_class = zend_register_internal_class(&e TSRMLS_CC);
+
+	pmta_template_class->ce_flags     |= ZEND_ACC_FINAL_CLASS;
+	pmta_template_class->create_object = pmtatpl_ctor;
+	pmta_template_class->serialize     = zend_class_serialize_deny;
+	pmta_template_class->unserialize   = zend_class_unserialize_deny;
+
+	pmtatpl_object_handlers = *zend_get_std_object_handlers();
+	pmtatpl_object_handlers.clone_obj = NULL;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file pmta_template.h
+ * @brief Exposes @c PmtaTemplate class
+ * @details
+@code{.php}
+final class PmtaTemplate
+{
+	private function __construct();
+	public function __destruct();
+	public static function compile($name, array $parts);
+	public static function get($name);
+	public function getName();
+	public function getSize();
+	public function isShared();
+	private function __clone();
+}
+@endcode
+ */
+
+#ifdef DOXYGEN
+#	undef PMTA_TEMPLATE_H
+#endif
+
+#ifndef PMTA_TEMPLATE_H
+#define PMTA_TEMPLATE_H
+
+#include "php_pmta.h"
+
+/**
+ * @brief Creates the template storage
+ * @param size Size of the storage, bytes (@c pmta.template_shm_size); 0 disables templates
+ * @details Called from @c MINIT so that the shared segment is inherited by the worker processes
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_template_startup(size_t size);
+
+/**
+ * @brief Releases the template storage
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmta_template_shutdown(void);
+
+/**
+ * @brief Returns the compiled body of @c PmtaTemplate object
+ * @param object @c PmtaTemplate object
+ * @param len Length of the body (output)
+ * @param tsrm_ls Internally used by Zend
+ * @return Body records (see @c pmta_body.h); valid until the module is shut down
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern const char* pmtatpl_get_body(zval* object, size_t* len TSRMLS_DC);
+
+/**
+ * @brief Registers @c PmtaTemplate class
+ * @param tsrm_ls Internally used by Zend
+ */
+PHPPMTA_VISIBILITY_HIDDEN extern void pmtatpl_register_class(TSRMLS_D);
+
+#endif /* PMTA_TEMPLATE_H */
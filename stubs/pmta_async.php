@@ -0,0 +1,12 @@
+<?php
+
+final class PmtaSubmitFuture
+{
+	private function __construct();
+	public function __destruct();
+	public function isDone();
+	public function wait($timeout = null);
+	public function result();
+	public function getLastError();
+	private function __clone();
+}
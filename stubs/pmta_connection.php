@@ -4,6 +4,8 @@ class PmtaConnection
 {
 	const LOCAL_SERVER = "127.0.0.1";
 	const DEFAULT_PORT = 25;
+	const PERSISTENT   = 1;
+	const LAZY         = 2;
 
 	private $connection;
 
@@ -11,11 +13,14 @@ class PmtaConnection
 	private $port;
 	private $username;
 	private $password;
+	private $persistent;
 
-	public function __construct($server = '127.0.0.1', $port = 25, $username = null, $password = null);
+	public function __construct($server = '127.0.0.1', $port = 25, $username = null, $password = null, $flags = null);
 	public function __destruct();
 	public function getLastError();
 	public function submitMessage(PmtaMessage $message);
+	public function submitMessages($messages); // array or Traversable
+	public function submitAsync(PmtaMessage $message);
 	public function __get($property);
 	public function __isset($property);
 	private function __clone();
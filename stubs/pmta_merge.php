@@ -0,0 +1,11 @@
+<?php
+
+final class PmtaMergeTemplate
+{
+	public function __construct($body);
+	public function __destruct();
+	public function getPlaceholders();
+	public function render(array $vars);
+	public function renderTo(PmtaMessage $message, array $vars);
+	private function __clone();
+}
@@ -9,6 +9,11 @@ class PmtaMessage
 	const ENCODING_8BIT   = PmtaMsgENCODING_8BIT;
 	const ENCODING_BASE64 = PmtaMsgENCODING_BASE64;
 
+	const CANON_CRLF        = 1;
+	const CANON_DOTS        = 2;
+	const CANON_LINE_LENGTH = 4;
+	const CANON_ALL         = 7;
+
 	private $message;
 
 	private $originator;
@@ -19,6 +24,10 @@ class PmtaMessage
 	private $jobid;
 	private $encoding;
 	private $recipients;
+	private $retain_recipients;
+	private $recipients_digest;
+	private $canonicalize;
+	private $cloneable;
 
 	public function __construct($originator);
 	public function __destruct();
@@ -27,9 +36,26 @@ class PmtaMessage
 	public function __set($property, $value);
 	public function beginPart($number);
 	public function addData($data);
+	public function addDataParts(array $parts);
+	public function addBase64Data($data);
+	public function addQuotedPrintableData($data);
+	public function addFile($path, $encoding = self::ENCODING_BASE64);
+	public function addStream($stream, $maxlen = -1);
 	public function addMergeData($data);
 	public function addDateHeader();
+	public function addDateAndMessageId($domain);
+	public function addCachedPart($key, $data = null);
+	public static function clearPartCache();
+	public static function getPartCacheStats();
+	public function addTemplate(PmtaTemplate $template);
 	public function addRecipient(PmtaRecipient $recipient);
+	public function addRecipients(array $recipients);
+	public function addRecipientsFromCsv($path, array $columns, $offset = 0, $limit = 0, $delimiter = ',');
+	public function addRecipientList(PmtaRecipientList $list);
+	public function recipientCount();
+	public function memoryUsage();
+	public function bodySize();
+	public function reset($originator);
 	public function getLastError();
-	private function __clone();
+	public function __clone();
 }
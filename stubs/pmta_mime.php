@@ -0,0 +1,12 @@
+<?php
+
+final class PmtaMimeBuilder
+{
+	public function __construct(PmtaMessage $message);
+	public function __destruct();
+	public function beginMultipart($subtype = 'mixed', array $headers = array());
+	public function addPart($content_type, $data, $encoding = null, array $headers = array());
+	public function endMultipart();
+	public function getDepth();
+	private function __clone();
+}
@@ -0,0 +1,24 @@
+<?php
+
+class PmtaConnectionPool
+{
+	const ROUTE_JOBID    = 1;
+	const ROUTE_VMTA     = 2;
+	const ROUTE_DOMAIN   = 3;
+	const ROUTE_ADAPTIVE = 4;
+
+	private $servers;
+	private $route;
+	private $username;
+	private $password;
+
+	public function __construct($servers = null, $route = self::ROUTE_DOMAIN, $username = null, $password = null, $flags = null);
+	public function __destruct();
+	public function __get($property);
+	public function __isset($property);
+	public function getServer(PmtaMessage $message);
+	public function submitMessage(PmtaMessage $message);
+	public function getNodeStats();
+	public function getLastError();
+	private function __clone();
+}
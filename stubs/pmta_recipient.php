@@ -21,6 +21,7 @@ class PmtaRecipient
 	public function __isset($property);
 	public function __set($name, $value);
 	public function defineVariable($name, $value);
+	public function defineVariables(array $vars, $mirror = true);
 	public function getLastError();
 	private function __clone();
 }
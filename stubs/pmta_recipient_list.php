@@ -0,0 +1,11 @@
+<?php
+
+class PmtaRecipientList implements Countable
+{
+	public function __destruct();
+	public function add($address, array $vars = null, $notify = null);
+	public function addMany(array $recipients);
+	public function get($index);
+	public function count();
+	private function __clone();
+}
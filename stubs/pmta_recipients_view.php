@@ -0,0 +1,13 @@
+<?php
+
+final class PmtaRecipientsView implements Traversable, Countable, ArrayAccess
+{
+	private function __construct();
+	public function __destruct();
+	public function count();
+	public function offsetExists($offset);
+	public function offsetGet($offset);
+	public function offsetSet($offset, $value);
+	public function offsetUnset($offset);
+	private function __clone();
+}
@@ -0,0 +1,13 @@
+<?php
+
+final class PmtaTemplate
+{
+	private function __construct();
+	public function __destruct();
+	public static function compile($name, array $parts);
+	public static function get($name);
+	public function getName();
+	public function getSize();
+	public function isShared();
+	private function __clone();
+}